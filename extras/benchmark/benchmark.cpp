@@ -0,0 +1,673 @@
+/*
+                                  ********************
+                                  *  MPU Benchmark   *
+                                  ********************
+
+   Host benchmark and replay harness for the math path of the MPU library (refineValues() onwards). The library is compiled
+   against the stubs in extras/benchmark/stubs, so no board is needed. The path is measured in ns per sample, and the angle
+   error of each estimator against a reference is reported, with the size of MpuDev (SRAM) of the profile (make FLAGS="-DMPU_LEAN_PROFILE").
+   Before the measurements the numeric paths are checked against their expected values (see CHECKS), and the benchmark exits with 1
+   if any check fails, so it can also be used as a host test (make run).
+
+   - Usage -
+      make                                -->  Builds the benchmark (make FLAGS="-DMPU_FIXED_POINT -DMPU_FAST_TRIG" for the options)
+      ./benchmark                         -->  Replays a synthetic log (30 s at 1 kHz with a known reference)
+      ./benchmark log.txt [repetitions]   -->  Replays a recorded log
+      ./benchmark --write log.txt         -->  Writes the synthetic log, so it can be used as a template
+
+   - Log format -
+   One sample per line: time ax ay az gx gy gz [ref_x ref_y]
+      -) time:          Time stamp of the sample (see MPU_TIMING_MODE, us by default).
+      -) ax ... gz:     Raw int16 measurements, as captured by mpu_test.ino (getParameter6()).
+      -) ref_x ref_y:   Optional reference angles in rad (same convention as state). Without them only the time is reported.
+   The values can be separated by spaces, commas or semicolons. Empty lines and lines starting with '#' are ignored.
+   The offset correction isn't known by the host, so the raw values should already be corrected (or be taken after initialize_2()
+   and logged with the offset_correction subtracted).
+*/
+
+#include "mpu_6050_library.h"
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+
+//            **************************
+//            *         STUBS          *
+//            **************************
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+  unsigned long end_time = millis() + ms;
+  while (millis() < end_time) {
+    // Just wait
+  }
+}
+
+
+//            **************************
+//            *          LOG           *
+//            **************************
+
+#define BENCHMARK_SYNTHETIC_RATE          1000              // Sample rate of the synthetic log in Hz
+#define BENCHMARK_SYNTHETIC_TIME          30                // Length of the synthetic log in s
+#define BENCHMARK_WARM_UP                 0.1               // Part of the log ignored for the error (convergence of the filters)
+#define BENCHMARK_REPETITIONS             20                // Default number of repetitions (the fastest one is reported)
+#define BENCHMARK_BATCH_SIZE              32                // Samples of each block of refineBatch()
+#define BENCHMARK_BATCH_TOLERANCE         1e-5              // Maximum difference between refineBatch() (float) and refineValues()
+
+struct LogSample {
+  unsigned long time;                                       // Time stamp (see MPU_TIMING_MODE)
+  int16_t raw[6];                                           // Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
+  double reference[2];                                      // Reference angles (X, Y) in rad
+};
+
+static bool has_reference = false;                          // The log has reference angles
+
+static bool loadLog(const char *file_name, std::vector<LogSample> &samples) {
+  /*
+   * This function loads a recorded log (check the format at the top of the file).
+   *
+   * Parameters:
+   *      @param *file_name         --> (char) Path of the log
+   *      @param &samples           --> (std::vector<LogSample>) Samples of the log
+   *      @return status            --> (bool) true if the log has been loaded
+   */
+
+  FILE *file = fopen(file_name, "r");
+  char line[256];
+  long values[7];
+  double reference[2];
+  int fields;
+
+  if (file == NULL) return false;
+
+  has_reference = true;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    // -- Separators --
+    for (char *c = line; *c != 0; c++) {
+      if ((*c == ',') || (*c == ';')) *c = ' ';
+    }
+    if (line[0] == '#') continue;
+
+    // -- Values --
+    fields = sscanf(line, "%ld %ld %ld %ld %ld %ld %ld %lf %lf", &values[0], &values[1], &values[2], &values[3], &values[4],
+                    &values[5], &values[6], &reference[0], &reference[1]);
+    if (fields < 7) continue;
+
+    LogSample sample;
+    sample.time = values[0];
+    for (uint8_t i = 0; i < 6; i++) sample.raw[i] = (int16_t)values[i + 1];
+    sample.reference[0] = (fields == 9) ? reference[0] : 0;
+    sample.reference[1] = (fields == 9) ? reference[1] : 0;
+    if (fields != 9) has_reference = false;
+    samples.push_back(sample);
+  }
+
+  fclose(file);
+  return !samples.empty();
+}
+
+static double square(double x) {
+  return x * x;
+}
+
+static double referenceAngle(double t, uint8_t axis) {
+  /*
+   * This function gives the reference angles of the synthetic log: a slow oscillation on each axis (starting at 0, like the estimators).
+   */
+
+  return (axis == 0) ? 0.5 * sin(1.3 * t) : 0.3 * sin(0.7 * t);
+}
+
+static void syntheticLog(std::vector<LogSample> &samples) {
+  /*
+   * This function generates a log that follows the model of the filters: the accelerometer measures the gravity given by the reference
+   * angles and the gyroscope measures the angular speed that rotate() turns into the derivative of the reference (with G_Z = 0).
+   * Gaussian noise and a small gyroscope bias are added.
+   *
+   * Parameters:
+   *      @param &samples           --> (std::vector<LogSample>) Generated samples
+   */
+
+  std::mt19937 generator(1);
+  std::normal_distribution<double> noise(0, 1);
+  const double period = 1.0 / BENCHMARK_SYNTHETIC_RATE;
+  const double gyro_lsb = 180 / M_PI * gyro_1dps_value;  // LSB per rad/s
+  double angle[2], speed[2], gravity[3], gyro[2];
+
+  has_reference = true;
+  for (long k = 0; k < (long)BENCHMARK_SYNTHETIC_RATE * BENCHMARK_SYNTHETIC_TIME; k++) {
+    double t = k * period;
+
+    // -- Reference --
+    for (uint8_t i = 0; i < 2; i++) {
+      angle[i] = referenceAngle(t, i);
+      speed[i] = (referenceAngle(t + 1e-6, i) - referenceAngle(t - 1e-6, i)) / 2e-6;
+    }
+
+    // -- Gravity with the accelState() convention --
+    // accelState() gives exactly the reference angles with this vector
+    gravity[0] = -sin(angle[1]);
+    gravity[1] = sin(angle[0]);
+    gravity[2] = sqrt(1 - square(gravity[0]) - square(gravity[1]));
+
+    // -- Gyroscope with the rotate() convention --
+    gyro[0] = speed[0] / cos(angle[0]);
+    gyro[1] = (speed[1] - gyro[0] * sin(angle[0]) * sin(angle[1])) / cos(angle[0]);
+
+    // -- Raw values --
+    LogSample sample;
+    sample.time = (unsigned long)(t * MPU_TIME_UNITS_PER_SECOND);
+    for (uint8_t i = 0; i < 3; i++) sample.raw[i] = (int16_t)lround((gravity[i] + 0.01 * noise(generator)) * accel_1g_value);
+    sample.raw[3] = (int16_t)lround((gyro[0] + 0.004 + 0.002 * noise(generator)) * gyro_lsb);
+    sample.raw[4] = (int16_t)lround((gyro[1] - 0.002 + 0.002 * noise(generator)) * gyro_lsb);
+    sample.raw[5] = (int16_t)lround(0.002 * noise(generator) * gyro_lsb);
+    sample.reference[0] = angle[0];
+    sample.reference[1] = angle[1];
+    samples.push_back(sample);
+  }
+}
+
+static bool writeLog(const char *file_name, const std::vector<LogSample> &samples) {
+  /*
+   * This function writes the samples with the log format.
+   */
+
+  FILE *file = fopen(file_name, "w");
+  if (file == NULL) return false;
+
+  fprintf(file, "# time ax ay az gx gy gz ref_x ref_y\n");
+  for (size_t k = 0; k < samples.size(); k++) {
+    const LogSample &s = samples[k];
+    fprintf(file, "%lu %d %d %d %d %d %d %.6f %.6f\n", s.time, s.raw[0], s.raw[1], s.raw[2], s.raw[3], s.raw[4], s.raw[5],
+            s.reference[0], s.reference[1]);
+  }
+
+  fclose(file);
+  return true;
+}
+
+
+//            **************************
+//            *         CHECKS         *
+//            **************************
+// Each check prints its result, and main() returns 1 if any of them fails
+
+static uint16_t failed_checks = 0;                          // Number of failed checks
+
+static void check(const char *name, bool passed, double value, double expected) {
+  /*
+   * This function records and prints the result of a check.
+   *
+   * Parameters:
+   *      @param *name              --> (char) Name of the check
+   *      @param passed             --> (bool) Result of the check
+   *      @param value              --> (double) Value obtained (printed)
+   *      @param expected           --> (double) Expected value (printed)
+   */
+
+  if (!passed) failed_checks++;
+  printf("%-36s %s (%.6g, expected %.6g)\n", name, passed ? "passed" : "FAILED", value, expected);
+}
+
+static int16_t rescaledCorrection(int16_t correction, uint8_t old_reg, uint8_t new_reg) {
+  /*
+   * This function gives the expected offset correction after a full-scale change: each range step halves the sensitivity (LSB per unit),
+   * so the correction is multiplied by 2 for each step to a more sensitive range and divided by 2 (rounded) for each step to a less one.
+   */
+
+  int8_t steps = (int8_t)(old_reg >> MPU_FULL_SCALE_SHIFT) - (int8_t)(new_reg >> MPU_FULL_SCALE_SHIFT);
+
+  return (int16_t)floor(correction * pow(2.0, steps) + 0.5);
+}
+
+static void checkFullScale() {
+  /*
+   * This function checks that setFullScale() keeps the offset correction consistent: with a known correction, it changes the ranges
+   * and refines a raw sample of 1g and 100 dps (plus the expected correction), which has to give the same values with any range.
+   * With MPU_TEMP_COMPENSATION the gyroscope correction is a point of the temperature table (setOffsetCorrection()), and it is
+   * interpolated again after each change, so the points of the table have to be rescaled too.
+   */
+
+  const int16_t correction[6] = {100, -60, 41, 30, -21, 11};  // Offset correction of the working ranges (odd values to check the rounding)
+  const uint8_t accel_regs[] = {0x00, 0x18, 0x08};           // 2g, 16g and 4g (more and less sensitive steps)
+  const uint8_t gyro_regs[] = {0x18, 0x00, 0x10};            // 2000, 250 and 1000 dps
+  MpuDev device;
+  int16_t expected[6], raw[6];
+  uint8_t previous_regs[2] = {MPU_ACCEL_CONFIG_VALUE, MPU_GYRO_CONFIG_VALUE};
+  mpu_real_t measurements[6];
+  char name[40];
+
+  device.mpu_state_global = MPU_CORRECT;
+  for (uint8_t i = 0; i < 6; i++) expected[i] = correction[i];
+  device.setOffsetCorrection(expected);
+
+  for (uint8_t step = 0; step < sizeof(accel_regs); step++) {
+    bool passed = device.setFullScale(accel_regs[step], gyro_regs[step]);
+    #ifdef MPU_TEMP_COMPENSATION
+      device.updateTemperatureCompensation(0, true);         // The stub registers give a raw temperature of 0
+    #endif
+    uint8_t accel_range = accel_regs[step] >> MPU_FULL_SCALE_SHIFT;
+    uint8_t gyro_range = gyro_regs[step] >> MPU_FULL_SCALE_SHIFT;
+
+    // -- Raw sample --
+    // The expected correction follows the previous one (the resolution lost in a less sensitive range can't be recovered)
+    for (uint8_t i = 0; i < 6; i++) {
+      expected[i] = rescaledCorrection(expected[i], previous_regs[i / 3], (i < 3) ? accel_regs[step] : gyro_regs[step]);
+      double signal = (i == 2) ? MPU_SENSITIVITY(accel_1g_values, accel_range) :
+                      (i >= 3) ? lround(100 * MPU_SENSITIVITY(gyro_1dps_values, gyro_range)) : 0;
+      raw[i] = (int16_t)(expected[i] + signal);
+    }
+    previous_regs[0] = accel_regs[step];
+    previous_regs[1] = gyro_regs[step];
+    device.refineValues(raw, measurements);
+
+    // -- Refined values --
+    snprintf(name, sizeof(name), "setFullScale 0x%02X 0x%02X accel", accel_regs[step], gyro_regs[step]);
+    check(name, passed && (fabs(measurements[2] - 1) < 1e-4) && (fabs(measurements[0]) < 1e-4) && (fabs(measurements[1]) < 1e-4),
+          measurements[2], 1);
+    snprintf(name, sizeof(name), "setFullScale 0x%02X 0x%02X gyro", accel_regs[step], gyro_regs[step]);
+    double speed = measurements[3] * 180 / M_PI;
+    check(name, passed && (fabs(speed - 100) < 0.1), speed, 100);
+  }
+}
+
+
+static void checkRefineBatch(const std::vector<LogSample> &samples) {
+  /*
+   * This function checks that refineBatch() gives the same values as refineValues() (within the float resolution) for all the samples
+   * of the log, refined in blocks of BENCHMARK_BATCH_SIZE as in the measurements, with an offset correction on every axis.
+   *
+   * Parameters:
+   *      @param &samples           --> (std::vector<LogSample>) Samples of the log
+   */
+
+  int16_t correction[6] = {37, -12, 5, -8, 3, 21};          // Offset correction of the check
+  int16_t raw_axes[BENCHMARK_BATCH_SIZE * 6];
+  float refined_axes[BENCHMARK_BATCH_SIZE * 6];
+  mpu_real_t measurements[6];
+  double max_difference = 0;
+  MpuDev device;
+
+  device.setOffsetCorrection(correction);
+
+  for (size_t first = 0; first < samples.size(); first += BENCHMARK_BATCH_SIZE) {
+    uint16_t count = std::min((size_t)BENCHMARK_BATCH_SIZE, samples.size() - first);
+
+    // -- Block --
+    for (uint16_t n = 0; n < count; n++) {
+      for (uint8_t i = 0; i < 6; i++) raw_axes[i * count + n] = samples[first + n].raw[i];
+    }
+    device.refineBatch(raw_axes, refined_axes, count);
+
+    // -- Compare --
+    for (uint16_t n = 0; n < count; n++) {
+      device.refineValues((int16_t *)samples[first + n].raw, measurements);
+      for (uint8_t i = 0; i < 6; i++) {
+        double difference = fabs(refined_axes[i * count + n] - measurements[i]);
+        if (!(difference <= max_difference)) max_difference = difference;  // NaN is kept
+      }
+    }
+  }
+
+  check("refineBatch vs refineValues", max_difference <= BENCHMARK_BATCH_TOLERANCE, max_difference, 0);
+}
+
+#ifdef MPU_PREFILTER
+static void checkPrefilter() {
+  /*
+   * This function checks the DC response of the pre-filter: after each step of a constant input the decimated output has to settle at
+   * exactly the input (the DC gain is 1), without a dead band around it. Build it with make FLAGS="-DMPU_PREFILTER" (CIC) or
+   * make FLAGS="-DMPU_PREFILTER -DMPU_PREFILTER_TYPE=1" (biquad with the default coefficients).
+   */
+
+  const int16_t steps[] = {0, 100, 0, -37, 5000, -1};      // Constant input of each step
+  MpuDev device;
+  int16_t raw[6];
+  char name[40];
+
+  device.setPrefilter(MPU_PREFILTER_DECIMATION);
+
+  for (uint8_t step = 0; step < sizeof(steps) / sizeof(steps[0]); step++) {
+    int16_t output = 0;
+    bool ready = false;
+
+    // -- Settle --
+    for (uint16_t k = 0; k < 400 * MPU_PREFILTER_DECIMATION; k++) {
+      for (uint8_t i = 0; i < 6; i++) raw[i] = steps[step];
+      if (device.prefilterSample(raw)) {
+        output = raw[0];
+        ready = true;
+      }
+    }
+
+    snprintf(name, sizeof(name), "prefilter DC %d LSB", steps[step]);
+    check(name, ready && (output == steps[step]) && (raw[5] == raw[0]), output, steps[step]);
+  }
+}
+#endif
+
+#ifdef MPU_HEALTH_MONITOR
+static void checkHealth() {
+  /*
+   * This function drives the health monitor through a frozen data fault and a saturation fault (make FLAGS="-DMPU_HEALTH_MONITOR").
+   * Each fault has to be detected after its number of samples (MPU_HEALTH_BUS_RECOVERY), then the bus is recovered and the MPU reset
+   * (MPU_HEALTH_RESETTING), and after MPU_HEALTH_RESET_TIME it is initialized again from the EEPROM record (MPU_HEALTH_OK), with the
+   * faults and the recoveries counted in health_stats. The stub registers keep their values, so the MPU answers after the reset.
+   */
+
+  const uint8_t faults[] = {MPU_FAULT_FROZEN, MPU_FAULT_SATURATED};
+  const uint16_t fault_samples[] = {MPU_HEALTH_FROZEN_SAMPLES, MPU_HEALTH_SATURATED_SAMPLES};  // Samples that have to be detected
+  MpuDev device;
+  int16_t offsets[6] = {0, 0, 0, 0, 0, 0};
+  float temperature = 25;
+  char name[40];
+
+  // --- Calibrated MPU ---
+  I2Cdev::registers()[MPU_DEVICE_ID_REG] = MPU_DEVICE_ID_VALUE;
+  device.saveOnEEPROM(&temperature, offsets);
+  check("health initializeFast", device.initializeFast(), device.mpu_state_global, MPU_CORRECT);
+
+  for (uint8_t f = 0; f < sizeof(faults); f++) {
+    int16_t raw[6];
+    uint16_t samples = 0;
+    uint8_t state = MPU_HEALTH_OK;
+
+    // -- Detection --
+    // The frozen samples are identical, the saturated ones have the noise of the gyroscope and A_X at the limit. The sample is
+    // written every time, the pre-filter replaces it with the filtered one
+    while ((state == MPU_HEALTH_OK) && (samples <= 2 * fault_samples[f])) {
+      for (uint8_t i = 0; i < 6; i++) raw[i] = (i == 2) ? 16384 : 0;
+      if (faults[f] == MPU_FAULT_SATURATED) {
+        raw[0] = INT16_MAX;
+        raw[3] = samples % 7;
+      }
+      device.updateEstimators(samples * 1000UL, raw);
+      samples++;
+      state = device.updateHealth();
+    }
+    snprintf(name, sizeof(name), "health fault %u detected", faults[f]);
+    check(name, (state == MPU_HEALTH_BUS_RECOVERY) && (device.health_stats.last_fault == faults[f]) &&
+                (samples >= fault_samples[f]) && (samples <= fault_samples[f] + 1), samples, fault_samples[f]);
+
+    // -- Bus recovery and reset --
+    state = device.updateHealth();
+    snprintf(name, sizeof(name), "health fault %u reset", faults[f]);
+    check(name, (state == MPU_HEALTH_RESETTING) && (device.mpu_state_global != MPU_CORRECT), state, MPU_HEALTH_RESETTING);
+
+    // -- Initialization --
+    state = device.updateHealth();   // Still waiting for the reset
+    delay(MPU_HEALTH_RESET_TIME + 1);
+    if (state == MPU_HEALTH_RESETTING) state = device.updateHealth();
+    snprintf(name, sizeof(name), "health fault %u recovered", faults[f]);
+    check(name, (state == MPU_HEALTH_OK) && (device.mpu_state_global == MPU_CORRECT) && (device.health_stats.recoveries == f + 1) &&
+                (device.health_stats.faults[faults[f] - 1] == 1) && (device.health_stats.failed_recoveries == 0),
+          device.health_stats.recoveries, f + 1);
+  }
+  check("health saturated samples", device.health_stats.saturated_samples == MPU_HEALTH_SATURATED_SAMPLES,
+        device.health_stats.saturated_samples, MPU_HEALTH_SATURATED_SAMPLES);
+}
+#endif
+
+
+//            **************************
+//            *       BENCHMARK        *
+//            **************************
+
+// --- Estimators ---
+// Each one is run over the whole log with a new MpuDev and returns the estimated angles (X, Y) of the current sample
+enum Estimator {
+  ESTIMATOR_KF,
+  ESTIMATOR_KF_BIAS,
+  ESTIMATOR_MAHONY,
+  #ifdef MPU_FIXED_POINT
+    ESTIMATOR_KF_FIXED,
+  #endif
+  ESTIMATOR_COUNT
+};
+
+static const char *estimator_names[] = {"simplifiedKF", "biasKF", "mahonyFilter",
+  #ifdef MPU_FIXED_POINT
+    "simplifiedKFFixed",
+  #endif
+};
+
+// Maximum RMS error in mrad of each estimator with the synthetic log (the current errors with some margin), so the accuracy
+// regressions fail the benchmark. The recorded logs aren't checked, their errors depend on the log.
+static const double estimator_max_rms[] = {14.0, 3.5, 10.0,
+  #ifdef MPU_FIXED_POINT
+    21.0,
+  #endif
+};
+
+static volatile double sink;                                // Keeps the results so the compiler can't remove the calculations
+
+static void resetDevice(MpuDev &device, const std::vector<LogSample> &samples) {
+  device.mpu_state_global = MPU_CORRECT;
+  device.prev_time = samples[0].time;
+  #ifdef MPU_FIXED_POINT
+    device.prev_time_fixed = samples[0].time;
+  #endif
+}
+
+static void runEstimator(uint8_t estimator, MpuDev &device, const LogSample &sample, mpu_real_t *measurements, mpu_real_t *angles) {
+  /*
+   * This function updates one estimator with a sample. The angles are only calculated if angles != NULL, since the Mahony filter
+   * needs trigonometric functions for them (getMahonyState()).
+   */
+
+  mpu_real_t *state_funct = NULL;
+
+  switch (estimator) {
+    case ESTIMATOR_KF:
+      state_funct = device.simplifiedKF(sample.time, measurements);
+      break;
+    case ESTIMATOR_KF_BIAS:
+      state_funct = device.biasKF(sample.time, measurements);
+      device.prev_time = sample.time;
+      break;
+    case ESTIMATOR_MAHONY:
+      device.mahonyFilter(sample.time, measurements);
+      device.prev_time = sample.time;
+      if (angles != NULL) state_funct = device.getMahonyState();
+      break;
+    #ifdef MPU_FIXED_POINT
+      case ESTIMATOR_KF_FIXED:
+        device.simplifiedKFFixed(sample.time, (int16_t *)sample.raw);
+        if (angles != NULL) {
+          device.getFixedState(angles);
+          return;
+        }
+        break;
+    #endif
+  }
+
+  if ((angles != NULL) && (state_funct != NULL)) {
+    angles[0] = state_funct[0];
+    angles[1] = state_funct[1];
+  }
+}
+
+template <class Function>
+static double timeLoop(const std::vector<LogSample> &samples, uint16_t repetitions, Function function) {
+  /*
+   * This function runs function(k) for every sample and returns the fastest repetition in ns per sample.
+   */
+
+  double best = 1e30;
+
+  for (uint16_t r = 0; r < repetitions; r++) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < samples.size(); k++) function(k);
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    if (elapsed < best) best = elapsed;
+  }
+
+  return best / samples.size();
+}
+
+int main(int argc, char **argv) {
+  std::vector<LogSample> samples;
+  uint16_t repetitions = BENCHMARK_REPETITIONS;
+  const char *source = "synthetic";
+
+  // --- Load the log ---
+  if ((argc == 3) && (strcmp(argv[1], "--write") == 0)) {
+    syntheticLog(samples);
+    if (!writeLog(argv[2], samples)) {
+      fprintf(stderr, "Can't write %s\n", argv[2]);
+      return 1;
+    }
+    return 0;
+  }
+  if (argc >= 2) {
+    source = argv[1];
+    if (!loadLog(argv[1], samples)) {
+      fprintf(stderr, "Can't load %s\n", argv[1]);
+      return 1;
+    }
+  } else {
+    syntheticLog(samples);
+  }
+  if (argc >= 3) repetitions = atoi(argv[2]);
+  if (repetitions == 0) repetitions = 1;
+
+  // --- Checks ---
+  printf("%-36s %s\n", "Check", "Result");
+  checkFullScale();
+  checkRefineBatch(samples);
+  #ifdef MPU_PREFILTER
+    checkPrefilter();
+  #endif
+  #ifdef MPU_HEALTH_MONITOR
+    checkHealth();
+  #endif
+  printf("\n");
+
+  printf("Log: %s (%u samples), %u repetitions\n", source, (unsigned)samples.size(), repetitions);
+  printf("MpuDev: %u bytes (%s, mpu_real_t of %u bytes)\n\n", (unsigned)sizeof(MpuDev),
+  #ifdef MPU_LEAN_PROFILE
+         "lean profile",
+  #else
+         "default profile",
+  #endif
+         (unsigned)sizeof(mpu_real_t));
+
+  // --- Stages ---
+  MpuDev device;
+  std::vector<mpu_real_t> measurements(samples.size() * 6);
+  mpu_real_t result[2], other[2] = {0, 0}, covariance;
+
+  std::vector<int16_t> raw_axes(samples.size() * 6);
+  std::vector<float> refined_axes(samples.size() * 6);
+
+  resetDevice(device, samples);
+
+  // -- Blocks of refineBatch() --
+  // Each block is stored as a structure of arrays (the last one can be shorter)
+  for (size_t k = 0; k < samples.size(); k++) {
+    size_t first = k - k % BENCHMARK_BATCH_SIZE;
+    size_t count = std::min((size_t)BENCHMARK_BATCH_SIZE, samples.size() - first);
+    for (uint8_t i = 0; i < 6; i++) raw_axes[first * 6 + i * count + (k - first)] = samples[k].raw[i];
+  }
+
+  printf("%-20s %12s\n", "Stage", "ns/sample");
+  printf("%-20s %12.1f\n", "refineValues", timeLoop(samples, repetitions, [&](size_t k) {
+    device.refineValues((int16_t *)samples[k].raw, &measurements[k * 6]);
+  }));
+  printf("%-20s %12.1f\n", "refineBatch", timeLoop(samples, repetitions, [&](size_t k) {
+    if (k % BENCHMARK_BATCH_SIZE) return;
+    uint16_t count = std::min((size_t)BENCHMARK_BATCH_SIZE, samples.size() - k);
+    device.refineBatch(&raw_axes[k * 6], &refined_axes[k * 6], count);
+    sink = refined_axes[k * 6];
+  }));
+  printf("%-20s %12.1f\n", "rotate", timeLoop(samples, repetitions, [&](size_t k) {
+    device.rotate(&measurements[k * 6], result);
+    sink = result[0];
+  }));
+  printf("%-20s %12.1f\n", "integrate", timeLoop(samples, repetitions, [&](size_t k) {
+    device.integrate(0.001, &measurements[k * 6 + 3], other, result);
+    sink = result[0];
+  }));
+  printf("%-20s %12.1f\n", "accelState", timeLoop(samples, repetitions, [&](size_t k) {
+    device.accelState(&measurements[k * 6], result, &covariance);
+    sink = result[0];
+  }));
+
+  // --- Estimators ---
+  printf("\n%-20s %12s %12s %12s %12s %12s\n", "Estimator", "ns/sample", "RMS X mrad", "RMS Y mrad", "max X mrad", "max Y mrad");
+  for (uint8_t estimator = 0; estimator < ESTIMATOR_COUNT; estimator++) {
+    double time_ns = 0;
+    double squared_error[2] = {0, 0}, max_error[2] = {0, 0};
+    mpu_real_t angles[2];
+    size_t first_sample = (size_t)(samples.size() * BENCHMARK_WARM_UP);
+    std::vector<mpu_real_t> work(6);
+
+    // -- Time --
+    for (uint16_t r = 0; r < repetitions; r++) {
+      MpuDev *filter = new MpuDev();
+      resetDevice(*filter, samples);
+      double elapsed = timeLoop(samples, 1, [&](size_t k) {
+        // The estimators may modify the measurements, so they get a copy (also done by updateEstimators())
+        for (uint8_t i = 0; i < 6; i++) work[i] = measurements[k * 6 + i];
+        runEstimator(estimator, *filter, samples[k], &work[0], NULL);
+      });
+      if ((r == 0) || (elapsed < time_ns)) time_ns = elapsed;
+      delete filter;
+    }
+
+    // -- Error --
+    MpuDev *filter = new MpuDev();
+    resetDevice(*filter, samples);
+    for (size_t k = 0; k < samples.size(); k++) {
+      for (uint8_t i = 0; i < 6; i++) work[i] = measurements[k * 6 + i];
+      runEstimator(estimator, *filter, samples[k], &work[0], angles);
+      if (k < first_sample) continue;
+      for (uint8_t i = 0; i < 2; i++) {
+        double error = fabs(angles[i] - samples[k].reference[i]);
+        squared_error[i] += error * error;
+        if (error > max_error[i]) max_error[i] = error;
+      }
+    }
+    delete filter;
+
+    // -- Print --
+    if (has_reference) {
+      double count = samples.size() - first_sample;
+      double rms[2] = {1000 * sqrt(squared_error[0] / count), 1000 * sqrt(squared_error[1] / count)};
+      printf("%-20s %12.1f %12.2f %12.2f %12.2f %12.2f\n", estimator_names[estimator], time_ns, rms[0], rms[1],
+             1000 * max_error[0], 1000 * max_error[1]);
+
+      // -- Accuracy regression --
+      if ((argc < 2) && !((rms[0] <= estimator_max_rms[estimator]) && (rms[1] <= estimator_max_rms[estimator]))) {
+        fprintf(stderr, "%s: RMS error above %.1f mrad\n", estimator_names[estimator], estimator_max_rms[estimator]);
+        failed_checks++;
+      }
+    } else {
+      printf("%-20s %12.1f %12s %12s %12s %12s\n", estimator_names[estimator], time_ns, "-", "-", "-", "-");
+    }
+  }
+
+  // --- Result ---
+  if (failed_checks != 0) {
+    fprintf(stderr, "\n%u checks failed\n", failed_checks);
+    return 1;
+  }
+
+  return 0;
+}
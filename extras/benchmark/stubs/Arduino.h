@@ -0,0 +1,85 @@
+/*
+ * Host stub of the Arduino core for the benchmark (extras/benchmark). Only the parts used by the MPU library are defined.
+ */
+#ifndef _BENCHMARK_ARDUINO_H_
+#define _BENCHMARK_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+// --- Binary constants (binary.h) ---
+#define B1101000 0x68
+#define B1101001 0x69
+
+// --- Program memory (avr/pgmspace.h) ---
+#define PROGMEM
+#define F(x) (x)
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+
+#define HEX 16
+
+// --- Time ---
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void delayMicroseconds(unsigned int) {}
+
+// --- Pins ---
+// Only used by the bus recovery of the health monitor, SDA always reads high (the bus is never stuck)
+#define SDA 18
+#define SCL 19
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+
+// --- Interrupts ---
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// --- Serial ---
+// Nothing is printed, the benchmark has its own output
+class String {
+  public:
+    template <class T> String(T) {}
+    String operator+(const String &) const { return *this; }
+    friend String operator+(const char *, const String &s) { return s; }
+};
+
+class Print {
+  public:
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while ((n < size) && write(buffer[n])) n++;
+      return n;
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual ~Print() {}
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(long) {}
+    template <class T> size_t print(T) { return 0; }
+    template <class T> size_t print(T, int) { return 0; }
+    template <class T> size_t println(T) { return 0; }
+    template <class T> size_t println(T, int) { return 0; }
+    size_t println() { return 0; }
+    size_t write(uint8_t) { return 1; }
+    using Print::write;
+    int availableForWrite() { return 64; }
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * Host stub of the EEPROM library for the benchmark (1 kB in RAM).
+ */
+#ifndef _BENCHMARK_EEPROM_H_
+#define _BENCHMARK_EEPROM_H_
+
+#include "Arduino.h"
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address) { return data[address]; }
+    void update(int address, uint8_t value) { data[address] = value; }
+    template <class T> T &get(int address, T &value) { memcpy(&value, data + address, sizeof(T)); return value; }
+    template <class T> const T &put(int address, const T &value) { memcpy(data + address, &value, sizeof(T)); return value; }
+  private:
+    uint8_t data[1024];
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Host stub of the I2Cdev library for the benchmark. The registers are kept in RAM (all zeros at the start), so the readings return
+ * zeros unless a register has been written, and the writes are verified by the library as with the real MPU. The math path can be
+ * measured on its own with the replayed samples, and the configuration functions (setFullScale()...) can be checked.
+ */
+#ifndef _BENCHMARK_I2CDEV_H_
+#define _BENCHMARK_I2CDEV_H_
+
+#include "Arduino.h"
+
+class I2Cdev {
+  public:
+    static uint8_t *registers() {
+      static uint8_t values[128];
+      return values;
+    }
+    static int8_t readBytes(uint8_t, uint8_t address, uint8_t length, uint8_t *data, uint16_t = 1000) {
+      memcpy(data, registers() + (address & 0x7F), length);
+      return length;
+    }
+    static bool writeBytes(uint8_t, uint8_t address, uint8_t length, uint8_t *data) {
+      memcpy(registers() + (address & 0x7F), data, length);
+      return true;
+    }
+    static bool writeByte(uint8_t, uint8_t address, uint8_t data) {
+      registers()[address & 0x7F] = data;
+      return true;
+    }
+};
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * Host stub of the Wire library for the benchmark. There is no bus: every transfer fails.
+ */
+#ifndef _BENCHMARK_WIRE_H_
+#define _BENCHMARK_WIRE_H_
+
+#include "Arduino.h"
+
+class TwoWire {
+  public:
+    void begin() {}
+    void end() {}
+    void setClock(uint32_t) {}
+    void beginTransmission(uint8_t) {}
+    size_t write(uint8_t) { return 1; }
+    uint8_t endTransmission(bool = true) { return 2; }
+    uint8_t requestFrom(uint8_t, uint8_t, uint8_t = 1) { return 0; }
+    int read() { return 0; }
+};
+extern TwoWire Wire;
+
+#endif
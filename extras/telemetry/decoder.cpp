@@ -0,0 +1,115 @@
+/*
+                                  ********************
+                                  * MPU Telemetry PC *
+                                  ********************
+
+   PC decoder of the binary telemetry frames sent by MpuTelemetry. It uses the same frame coding as the library (MpuTelemetryDecoder),
+   which is compiled against the stubs of extras/benchmark, and prints one CSV line per frame.
+
+   - Usage -
+      make                                -->  Builds the decoder
+      ./decoder capture.bin               -->  Decodes a capture of the serial port
+      ./decoder /dev/ttyUSB0              -->  Decodes the serial port (set it up first: stty -F /dev/ttyUSB0 115200 raw -echo)
+      ./decoder --degrees -               -->  Reads stdin and prints the angles in degrees (rad by default)
+
+   - Output -
+   raw,sequence,time,ax,ay,az,gx,gy,gz      -->  MPU_TELEMETRY_RAW frames (LSB)
+   angles,sequence,time,a0,a1,a2,a3,a4,a5   -->  MPU_TELEMETRY_ANGLES frames (the values not sent are 0)
+   The number of frames, lost frames (sequence gaps), CRC errors and framing errors are printed on stderr at the end.
+*/
+
+#include "mpu_6050_library.h"
+#include <stdio.h>
+
+
+//            **************************
+//            *         STUBS          *
+//            **************************
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+unsigned long micros() {
+  return 0;
+}
+
+unsigned long millis() {
+  return 0;
+}
+
+void delay(unsigned long) {
+  // Nothing to wait for, the MPU isn't used
+}
+
+
+//            **************************
+//            *          MAIN          *
+//            **************************
+
+static void printFrame(const MpuTelemetryFrame *frame, bool degrees) {
+  /*
+   * This function prints a frame as a CSV line.
+   *
+   * Parameters:
+   *      @param *frame             --> (MpuTelemetryFrame) Decoded frame
+   *      @param degrees            --> (bool) Print the angles in degrees instead of rad
+   */
+
+  double scale = 1 / MPU_TELEMETRY_ANGLE_SCALE;           // Angles resolution
+
+  if (degrees) scale *= 180 / M_PI;
+
+  if (frame->type == MPU_TELEMETRY_RAW) printf("raw");
+  else if (frame->type == MPU_TELEMETRY_ANGLES) printf("angles");
+  else printf("type_%u", frame->type);
+  printf(",%u,%lu", frame->sequence, (unsigned long)frame->time_stamp);
+
+  for (uint8_t i = 0; i < MPU_TELEMETRY_VALUES; i++) {
+    if (frame->type == MPU_TELEMETRY_ANGLES) printf(",%.4f", frame->values[i] * scale);
+    else printf(",%d", frame->values[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  bool degrees = false;
+  const char *file_name = NULL;
+  FILE *input;
+  MpuTelemetryDecoder decoder;
+  MpuTelemetryFrame frame;
+  int data;
+
+  // --- Arguments ---
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--degrees") == 0) degrees = true;
+    else file_name = argv[i];
+  }
+  if (file_name == NULL) {
+    fprintf(stderr, "Usage: %s [--degrees] capture.bin|/dev/ttyX|-\n", argv[0]);
+    return 1;
+  }
+
+  if (strcmp(file_name, "-") == 0) input = stdin;
+  else input = fopen(file_name, "rb");
+  if (input == NULL) {
+    fprintf(stderr, "Couldn't open %s\n", file_name);
+    return 1;
+  }
+
+  // --- Decode ---
+  // The stream may start in the middle of a frame, that part is counted as a framing error
+  while ((data = fgetc(input)) != EOF) {
+    if (decoder.feed((uint8_t)data, &frame)) {
+      printFrame(&frame, degrees);
+      fflush(stdout);
+    }
+  }
+
+  if (input != stdin) fclose(input);
+
+  fprintf(stderr, "frames: %lu, lost: %lu, crc errors: %u, framing errors: %u\n", (unsigned long)decoder.frames,
+          (unsigned long)decoder.lost_frames, decoder.crc_errors, decoder.framing_errors);
+
+  return 0;
+}
@@ -41,44 +41,116 @@
  *     -) Approximated EKF implemented.
  *     -) Removed redundancies.
  *     -) Updated initialization code.
+ * V1.1 14/10/2026 Third issue.
+ *     -) FIFO burst reading mode.
+ *     -) Asynchronous (non-blocking) register reading.
+ *     -) Estimators can share the same sample (updateEstimators()).
+ *     -) Fixed-point Kalman filter (MPU_FIXED_POINT).
+ *     -) Reciprocal scale factors and lookup table trigonometry (MPU_FAST_TRIG).
+ *     -) Runtime full-scale range and sample rate (setWorkingConfig()).
+ *     -) Burst register writing (writeMpuRegisters()), used for the offsets.
+ *     -) Faster calibration: parallel secant search and means with early termination.
+ *     -) The calibrated axes are frozen and per-axis calibration statistics (calibration_stats).
+ *     -) Non-blocking calibration (startCalibration() and calibrationStep()).
+ *     -) Microsecond and sample sequence time stamps (MPU_TIMING_MODE).
+ *     -) Ring buffer of time stamped samples (MPU_SAMPLE_BUFFER).
+ *     -) Several MPUs on the same bus: per object address, data ready flag, time stamp and EEPROM slot, and MpuScheduler.
+ *     -) DMP quaternion, gravity and yaw-pitch-roll output (MPU_DMP_MODE).
+ *     -) Kalman filter with gyroscope bias estimation (biasKF()) and the Y axis gain of simplifiedKF() fixed.
+ *     -) Mahony filter with quaternion state and decimated accelerometer correction (mahonyFilter()).
+ *     -) Decimated accelerometer update of simplifiedKF() (MPU_KF_ACCEL_PERIOD).
+ *     -) Profiling of the pipeline stages and I2C errors (MPU_PROFILING).
+ *     -) Host benchmark and replay harness (extras/benchmark).
+ *     -) Binary telemetry frames with COBS framing and CRC, non-blocking output and PC decoder (MpuTelemetry, extras/telemetry).
+ *     -) Power states: cycle mode with the gyroscopes in standby, wake-on-motion and wake-up latency (setPowerState()).
+ *     -) Versioned EEPROM calibration records with CRC, offset correction and full-scale ranges, written in turns (MPU_EEPROM_RECORDS).
+ *     -) Temperature table of the gyroscope offset correction, learned while still and interpolated (MPU_TEMP_COMPENSATION), stored
+ *        when idle (flushEEPROM()).
+ *     -) Fast initialization from the EEPROM record for warm restarts with a background self-test (initializeFast(), selfTestStep()).
+ *     -) Stillness detector and gyroscope bias tracking during the operation (MPU_BIAS_TRACKING).
+ *     -) Refinement of sample blocks as structures of arrays (refineBatch()).
+ *     -) Integer CIC/biquad pre-filter with decimation before the estimators (MPU_PREFILTER).
+ *     -) Memory-lean profile without the test estimators, with float values and PROGMEM tables (MPU_LEAN_PROFILE, mpu_real_t).
+ *     -) Health monitor with I2C bus recovery and re-initialization in steps (MPU_HEALTH_MONITOR, updateHealth()).
+ *     -) Interrupt configuration (configureInterrupt()): INT_ENABLE and INT_PIN_CFG, and INT_STATUS read with the measurements.
  */
 
 #include "mpu_6050_library.h"
 #include "I2Cdev.h"
 
-// External variables:
-extern volatile bool mpu_data_ready;              // This variable is used as an interrupt
-extern volatile unsigned long time_buffer;        // This is to get the timing correct
+// DMP firmware:
+#ifdef MPU_DMP_MODE
+  #include "MPU6050_6Axis_MotionApps20.h"         // It defines the firmware, so it can only be included once
+#endif
+
+// Asynchronous I2C:
+#if defined(__AVR__) && defined(TWCR)
+  #include <util/twi.h>
+  #define MPU_ASYNC_TWI                           // The asynchronous readings are done with the TWI peripheral
+#endif
+
+// Profiling:
+#ifdef MPU_PROFILING
+  #define MPU_PROFILE_START(name)         unsigned long name = micros()
+  #define MPU_PROFILE_END(stage, name)    profileStage(stage, name)
+  #define MPU_PROFILE_COUNT(counter)      profile.counter++
+#else
+  #define MPU_PROFILE_START(name)
+  #define MPU_PROFILE_END(stage, name)
+  #define MPU_PROFILE_COUNT(counter)
+#endif
+
+// Trigonometric functions:
+#ifdef MPU_FAST_TRIG
+  #define MPU_SIN(x)        fastSin(x)
+  #define MPU_COS(x)        fastCos(x)
+  #define MPU_ATAN2(y, x)   fastAtan2(y, x)
+#else
+  #define MPU_SIN(x)        sin(x)
+  #define MPU_COS(x)        cos(x)
+  #define MPU_ATAN2(y, x)   atan2(y, x)
+#endif
 
 
 //            **************************
 //            *      TOOLS - OTHER     *
 //            **************************
 
-bool MpuDev::readMpuRegisters(uint8_t address_funct, uint8_t *buffer_funct, uint8_t length_funct) {
+bool MpuDev::readMpuRegisters(uint8_t address_funct, uint8_t *buffer_funct, uint8_t length_funct, uint8_t attempts_funct) {
   /* This function reads consecutive registers of the MPU. 
    * The first register is set by address_funct and the number of registers read by length. The values will be stored 
    * in the byte array given by *buffer_funct.
    * 
    * The I2C interface will be done as follows:
    *      1) The communication will be established normally.
-   *      2) If there is a timeout, the communication will be tried again I2C_MPU_RETRIES times.
+   *      2) If there is a timeout, the communication will be tried again up to attempts_funct times (I2C_MPU_RETRIES by default).
    *      3) If the communication keeps failing it will raise an error.
+   * The registers that change when they are read (FIFO_R_W) have to be read with one attempt: a failed reading has already removed
+   * some bytes, so a retry would "succeed" with data shifted by part of a frame.
    * 
    * Parameters:
    *      @param address_funct      --> (uint8_t) Address of the first register.
    *      @param *buffer_funct      --> (uint8_t) Pointer to a byte array where the data will be stored.
    *      @param length_funct       --> (uint8_t) Length of *buffer_funct and number of registers that will be read.
+   *      @param attempts_funct     --> (uint8_t) Maximum number of attempts (1 = no retries)
    *      @return status            --> (bool) State of the register reading process (true = success)
    */
 
+  MPU_PROFILE_START(profile_start);
+
   // --- Loop for the retires ---
-  for (uint8_t i = 0; i < I2C_MPU_RETRIES; i++) {
+  for (uint8_t i = 0; i < attempts_funct; i++) {
     // -- Check if the communication is correct --
-    if (I2Cdev::readBytes(I2C_ADDRESS_MPU, address_funct, length_funct, buffer_funct, I2C_TIMEOUT_CON) == length_funct) return true;
+    // I2Cdev returns the count as int8_t, so the bursts over 127 bytes (FIFO) are compared as uint8_t (-1 is an error up to 254 bytes)
+    if ((uint8_t)I2Cdev::readBytes(i2c_address, address_funct, length_funct, buffer_funct, I2C_TIMEOUT_CON) == length_funct) {
+      MPU_PROFILE_END(MPU_STAGE_I2C_READ, profile_start);
+      return true;
+    }
+    MPU_PROFILE_COUNT(i2c_retries);
   }
 
   // -- Communication error --
+  MPU_PROFILE_COUNT(i2c_errors);
   mpu_state_global = MPU_I2C_ERROR;  // Change state of the MPU to error
   for (uint8_t i = 0; i < length_funct; i++) {  // Set the output to zero
     *(buffer_funct + i) = 0;
@@ -127,30 +199,37 @@ bool MpuDev::readMpuData(uint8_t address_funct, int16_t *data_funct) {
 
 bool MpuDev::readMpuMeasurements(int16_t *data_funct) {
   /* This function reads the accelerometer and gyroscope measurements.
-   * To take advantage in the consecutive register reading, the temperature will also be read, then ignored.
+   * To take advantage in the consecutive register reading, the temperature will also be read and stored in temperature_raw.
+   * The interrupt status is read in the same burst (MPU_MEASUREMENTS_ADDR), which clears the interrupt, and its bits are added to
+   * interrupt_status.
    * 
    * Parameters:
    *      @param *buffer_funct      --> (uint16_t) Pointer a int16_t array to store the measurements (6 in total).
    */
 
-  uint8_t buffer_funct[14];         // This variable is to holds the raw data from the registers
+  uint8_t buffer_funct[MPU_MEASUREMENTS_LENGTH];  // This variable is to holds the raw data from the registers
   bool communication_successful;   // This is used to know is the communication is correct or not
   
   // --- Read data form the device ---
-  communication_successful = readMpuRegisters(MPU_ACCEL_REG_BASE, buffer_funct, 14);  // Communication failed
+  communication_successful = readMpuRegisters(MPU_MEASUREMENTS_ADDR, buffer_funct, MPU_MEASUREMENTS_LENGTH);  // Communication failed
 
   // --- Convert data ---
-  data_funct[0] = (buffer_funct[ 0] << 8) | (buffer_funct[ 1]);
-  data_funct[1] = (buffer_funct[ 2] << 8) | (buffer_funct[ 3]);
-  data_funct[2] = (buffer_funct[ 4] << 8) | (buffer_funct[ 5]);
-  data_funct[3] = (buffer_funct[ 8] << 8) | (buffer_funct[ 9]);
-  data_funct[4] = (buffer_funct[10] << 8) | (buffer_funct[11]);
-  data_funct[5] = (buffer_funct[12] << 8) | (buffer_funct[13]);
+  // buffer_funct[0] is the interrupt status
+  data_funct[0] = (buffer_funct[ 1] << 8) | (buffer_funct[ 2]);
+  data_funct[1] = (buffer_funct[ 3] << 8) | (buffer_funct[ 4]);
+  data_funct[2] = (buffer_funct[ 5] << 8) | (buffer_funct[ 6]);
+  data_funct[3] = (buffer_funct[ 9] << 8) | (buffer_funct[10]);
+  data_funct[4] = (buffer_funct[11] << 8) | (buffer_funct[12]);
+  data_funct[5] = (buffer_funct[13] << 8) | (buffer_funct[14]);
+  if (communication_successful) {
+    temperature_raw = (buffer_funct[7] << 8) | (buffer_funct[8]);
+    interrupt_status |= buffer_funct[0];
+  }
 
   return communication_successful;
 }
 
-bool MpuDev::writeMpuRegister(uint8_t address_funct, uint8_t buffer_funct, bool check_funct = true) {
+bool MpuDev::writeMpuRegister(uint8_t address_funct, uint8_t buffer_funct, bool check_funct) {
   /* This function writes one register of the MPU. 
    * The register address is set by address_funct and the value by buffer_funct 
    * 
@@ -169,9 +248,12 @@ bool MpuDev::writeMpuRegister(uint8_t address_funct, uint8_t buffer_funct, bool
 
   // --- Loop for the retires ---
   for (uint8_t i = 0; i <= I2C_MPU_RETRIES; i++) {
+    #ifdef MPU_PROFILING
+      if (i > 0) profile.i2c_retries++;
+    #endif
     
     // -- write --
-    if (!I2Cdev::writeBytes(I2C_ADDRESS_MPU, address_funct, 1, &buffer_funct)) continue;
+    if (!I2Cdev::writeBytes(i2c_address, address_funct, 1, &buffer_funct)) continue;
     // Writing is correct
     
     if (check_funct) {
@@ -187,6 +269,7 @@ bool MpuDev::writeMpuRegister(uint8_t address_funct, uint8_t buffer_funct, bool
   }
 
   // -- Communication error --
+  MPU_PROFILE_COUNT(i2c_errors);
   mpu_state_global = MPU_I2C_ERROR;
   // Debug
   #ifdef DEBUG_MODE_MPU
@@ -197,7 +280,61 @@ bool MpuDev::writeMpuRegister(uint8_t address_funct, uint8_t buffer_funct, bool
 
 
 
-bool MpuDev::updateMpuRegister(uint8_t address_funct, uint8_t values_funct, uint8_t mask_funct, bool check_funct = true) {
+bool MpuDev::writeMpuRegisters(uint8_t address_funct, uint8_t *buffer_funct, uint8_t length_funct, bool check_funct) {
+  /* This function writes multiple sequential registers of the MPU in one I2C burst (the MPU increments the address automatically).
+   * The first register address is set by address_funct and the values by buffer_funct.
+   * 
+   * The I2C interface will be done as follows:
+   *      1) Write all the MPU registers.
+   *      2) Read all the MPU registers back in one burst. This can be disabled by setting check_funct = false
+   *      2) If there is a timeout or any read value is not correct, the communication will be retried again I2C_MPU_RETRIES times.
+   *      3) If the communication keeps failing it will raise an error.
+   * 
+   * Parameters:
+   *      @param address_funct      --> (uint8_t) Address of the first register.
+   *      @param *buffer_funct      --> (uint8_t) Pointer to the values of the registers to be written
+   *      @param length_funct       --> (uint8_t) Number of registers to be written (up to I2C_BURST_WRITE_LENGTH)
+   *      @param check_funct        --) (bool) It is set to true by default, but if set to false it will skip the verification process
+   *      @return status            --> (bool) State of the register writing process (true = success)
+   */
+
+  // --- Check the length ---
+  if ((length_funct == 0) || (length_funct > I2C_BURST_WRITE_LENGTH)) return false;
+
+  // --- Loop for the retires ---
+  for (uint8_t i = 0; i <= I2C_MPU_RETRIES; i++) {
+    #ifdef MPU_PROFILING
+      if (i > 0) profile.i2c_retries++;
+    #endif
+    
+    // -- write --
+    if (!I2Cdev::writeBytes(i2c_address, address_funct, length_funct, buffer_funct)) continue;
+    // Writing is correct
+    
+    if (check_funct) {
+      // -- Read --
+      uint8_t buffer_funct2[I2C_BURST_WRITE_LENGTH];
+      if (!readMpuRegisters(address_funct, buffer_funct2, length_funct)) continue;
+
+      // -- Check the values --
+      if (memcmp(buffer_funct, buffer_funct2, length_funct) == 0) return true;
+    } else {
+      return true;
+    }
+  }
+
+  // -- Communication error --
+  MPU_PROFILE_COUNT(i2c_errors);
+  mpu_state_global = MPU_I2C_ERROR;
+  // Debug
+  #ifdef DEBUG_MODE_MPU
+    Serial.println(F("I2C_Error (*.*) burst writing"));
+  #endif
+  return false;
+}
+
+
+bool MpuDev::updateMpuRegister(uint8_t address_funct, uint8_t values_funct, uint8_t mask_funct, bool check_funct) {
   /* This function is to only changes the given values in the register.
    * This function will access the register set by "address_funct" and only update the bits set as '1' in "mask_funct" to the 
    * value on "values_funct"
@@ -224,38 +361,290 @@ bool MpuDev::updateMpuRegister(uint8_t address_funct, uint8_t values_funct, uint
 }
 
 
+bool MpuDev::startReadMpuRegisters(uint8_t address_funct, uint8_t length_funct) {
+  /* This function starts the asynchronous reading of consecutive registers of the MPU.
+   * It only sends the start condition and returns, the rest of the transfer is done by pollReadMpuRegisters(), so the rest of the
+   * code can be executed while the data is being transferred (for example filtering the previous sample).
+   * On the boards without the asynchronous TWI support the reading is done here (blocking) and the poll will just return the result.
+   * 
+   * Parameters:
+   *      @param address_funct      --> (uint8_t) Address of the first register.
+   *      @param length_funct       --> (uint8_t) Number of registers that will be read (up to I2C_ASYNC_BUFFER_LENGTH).
+   *      @return status            --> (bool) true if the transfer has been started
+   */
+
+  // --- Check ---
+  if (async_state == MPU_ASYNC_BUSY) return false;                                 // There is a transfer in progress
+  if ((length_funct == 0) || (length_funct > I2C_ASYNC_BUFFER_LENGTH)) return false;
+
+  async_address = address_funct;
+  async_length = length_funct;
+  async_retries = 0;
+
+  #ifdef MPU_ASYNC_TWI
+    // --- Send start condition ---
+    async_index = 0;
+    async_step = 0;
+    async_step_time = micros();
+    async_state = MPU_ASYNC_BUSY;
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);  // Without TWIE, so the interrupt of the Wire library isn't called
+  #else
+    // --- Blocking reading ---
+    async_state = readMpuRegisters(async_address, async_buffer, async_length) ? MPU_ASYNC_DONE : MPU_ASYNC_ERROR;
+    async_notified = false;  // The callback is called by the first poll
+  #endif
+
+  return true;
+}
+
+uint8_t MpuDev::pollReadMpuRegisters() {
+  /* This function advances the asynchronous reading started by startReadMpuRegisters() without waiting for the bus.
+   * Each call processes all the steps of the transfer that have already been completed by the TWI peripheral and returns. The transfer
+   * is done as follows:
+   *      1) Start --> address + write --> register address --> repeated start --> address + read.
+   *      2) Receive the registers, the last one is not acknowledged.
+   *      3) Stop.
+   * If there is an unexpected response or the bus doesn't progress for I2C_ASYNC_TIMEOUT_US, the transfer will be started again up to
+   * I2C_MPU_RETRIES times. If it keeps failing the state of the MPU will be set to MPU_I2C_ERROR, as done by readMpuRegisters().
+   * Once the transfer is done, async_callback is called (if set) once. The registers are obtained with getAsyncRegisters().
+   * 
+   * Parameters:
+   *      @return state             --> (uint8_t) State of the transfer: MPU_ASYNC_IDLE, MPU_ASYNC_BUSY, MPU_ASYNC_DONE or MPU_ASYNC_ERROR
+   */
+
+  #ifdef MPU_ASYNC_TWI
+    // --- Process the completed steps ---
+    while (async_state == MPU_ASYNC_BUSY) {
+      
+      // -- Check the bus --
+      if (!(TWCR & _BV(TWINT))) {  // Waiting for the TWI peripheral
+        if ((micros() - async_step_time) < I2C_ASYNC_TIMEOUT_US) return MPU_ASYNC_BUSY;
+        
+        // Timeout
+        async_step = 0xFF;
+      }
+
+      // -- Next step --
+      async_step_time = micros();
+      
+      switch (async_step) {
+        case 0:  // Start sent
+          if (TW_STATUS != TW_START) break;
+          TWDR = (i2c_address << 1) | TW_WRITE;
+          TWCR = _BV(TWINT) | _BV(TWEN);
+          async_step++;
+          continue;
+
+        case 1:  // Address + write sent
+          if (TW_STATUS != TW_MT_SLA_ACK) break;
+          TWDR = async_address;
+          TWCR = _BV(TWINT) | _BV(TWEN);
+          async_step++;
+          continue;
+
+        case 2:  // Register address sent
+          if (TW_STATUS != TW_MT_DATA_ACK) break;
+          TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+          async_step++;
+          continue;
+
+        case 3:  // Repeated start sent
+          if (TW_STATUS != TW_REP_START) break;
+          TWDR = (i2c_address << 1) | TW_READ;
+          TWCR = _BV(TWINT) | _BV(TWEN);
+          async_step++;
+          continue;
+
+        case 4:  // Address + read sent
+          if (TW_STATUS != TW_MR_SLA_ACK) break;
+          TWCR = (async_length > 1) ? (_BV(TWINT) | _BV(TWEN) | _BV(TWEA)) : (_BV(TWINT) | _BV(TWEN));  // Don't ACK the last one
+          async_step++;
+          continue;
+
+        case 5:  // Register received
+          if ((TW_STATUS != TW_MR_DATA_ACK) && (TW_STATUS != TW_MR_DATA_NACK)) break;
+          async_buffer[async_index++] = TWDR;
+          
+          if (async_index < async_length) {
+            TWCR = (async_index < (async_length - 1)) ? (_BV(TWINT) | _BV(TWEN) | _BV(TWEA)) : (_BV(TWINT) | _BV(TWEN));
+            continue;
+          }
+
+          // - Done -
+          releaseAsyncBus();
+          async_state = MPU_ASYNC_DONE;
+          if (async_callback != NULL) async_callback(this);
+          return async_state;
+
+        default:  // Timeout
+          break;
+      }
+
+      // -- Communication error --
+      if (async_retries++ < I2C_MPU_RETRIES) {  // Try again
+        async_index = 0;
+        async_step = 0;
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO) | _BV(TWSTA);  // Stop followed by a new start
+        continue;
+      }
+
+      releaseAsyncBus();
+      mpu_state_global = MPU_I2C_ERROR;           // Change state of the MPU to error
+      for (uint8_t i = 0; i < async_length; i++) async_buffer[i] = 0;
+      async_state = MPU_ASYNC_ERROR;
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.println(F("I2C_Error (*.*) async reading"));
+      #endif
+    }
+  #else
+    // --- The reading is already done ---
+    // The callback is only called once, as with the asynchronous TWI
+    if ((async_state == MPU_ASYNC_DONE) && !async_notified) {
+      async_notified = true;
+      if (async_callback != NULL) async_callback(this);
+    }
+  #endif
+
+  return async_state;
+}
+
+uint8_t MpuDev::getAsyncRegisters(uint8_t *buffer_funct) {
+  /* This function gets the registers of a completed asynchronous reading (startReadMpuRegisters()) and frees it, so a new one can be
+   * started. It has to be called once pollReadMpuRegisters() returns MPU_ASYNC_DONE or MPU_ASYNC_ERROR (the registers are zeros then).
+   *
+   * Parameters:
+   *      @param *buffer_funct      --> (uint8_t) Pointer to an array for the registers (the length of the reading)
+   *      @return length            --> (uint8_t) Number of registers copied (0 if the reading isn't completed)
+   */
+
+  if ((async_state != MPU_ASYNC_DONE) && (async_state != MPU_ASYNC_ERROR)) return 0;
+
+  for (uint8_t i = 0; i < async_length; i++) buffer_funct[i] = async_buffer[i];
+  async_state = MPU_ASYNC_IDLE;
+
+  return async_length;
+}
+
+#ifdef MPU_ASYNC_TWI
+void MpuDev::releaseAsyncBus() {
+  /* This function ends an asynchronous transfer with a stop and gives the bus back to the Wire library. The TWI peripheral clears TWSTO
+   * once the stop has been sent (a few us), so it waits up to I2C_ASYNC_TIMEOUT_US for it before enabling the interrupt of the Wire
+   * library again. Otherwise the next transfer of Wire could be started while the stop is still being sent.
+   *
+   * Parameters:
+   *      NA        --> This function doesn't require or return any parameter
+   */
+
+  unsigned long start_time_funct;
+
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);   // Stop
+  start_time_funct = micros();
+  while ((TWCR & _BV(TWSTO)) && ((micros() - start_time_funct) < I2C_ASYNC_TIMEOUT_US)) {
+    // Just wait
+  }
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);     // Idle state of the Wire library
+}
+#endif
+
+bool MpuDev::startReadMpuMeasurements() {
+  /* This function starts the asynchronous reading of the accelerometer and gyroscope measurements (MPU_MEASUREMENTS_LENGTH registers,
+   * the interrupt status and the temperature included). The values are obtained with pollReadMpuMeasurements().
+   *
+   * Parameters:
+   *      @return status            --> (bool) true if the transfer has been started
+   */
+
+  return startReadMpuRegisters(MPU_MEASUREMENTS_ADDR, MPU_MEASUREMENTS_LENGTH);
+}
+
+uint8_t MpuDev::pollReadMpuMeasurements(int16_t *data_funct) {
+  /* This function advances the asynchronous measurements reading and loads the values once the transfer is completed.
+   * When MPU_ASYNC_DONE or MPU_ASYNC_ERROR is returned the values have been loaded (as zeros if it failed) and a new reading can be started.
+   *
+   * Parameters:
+   *      @param *data_funct        --> (int16_t) Pointer a int16_t array to store the measurements (6 in total): A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return state             --> (uint8_t) State of the transfer: MPU_ASYNC_IDLE, MPU_ASYNC_BUSY, MPU_ASYNC_DONE or MPU_ASYNC_ERROR
+   */
+
+  uint8_t state_funct = pollReadMpuRegisters();
+
+  if ((state_funct == MPU_ASYNC_DONE) || (state_funct == MPU_ASYNC_ERROR)) {
+    // --- Convert data ---
+    // async_buffer[0] is the interrupt status (zero if the transfer failed)
+    data_funct[0] = (async_buffer[ 1] << 8) | (async_buffer[ 2]);
+    data_funct[1] = (async_buffer[ 3] << 8) | (async_buffer[ 4]);
+    data_funct[2] = (async_buffer[ 5] << 8) | (async_buffer[ 6]);
+    data_funct[3] = (async_buffer[ 9] << 8) | (async_buffer[10]);
+    data_funct[4] = (async_buffer[11] << 8) | (async_buffer[12]);
+    data_funct[5] = (async_buffer[13] << 8) | (async_buffer[14]);
+    if (state_funct == MPU_ASYNC_DONE) {
+      temperature_raw = (async_buffer[7] << 8) | (async_buffer[8]);
+      interrupt_status |= async_buffer[0];
+    }
+
+    // --- Ready for the next one ---
+    async_state = MPU_ASYNC_IDLE;
+  }
+
+  return state_funct;
+}
+
+
 //            **************************
 //            *     CONFIGURATION      *
 //            **************************
 
-bool MpuDev::initialize_1() {
-	/* This function initializes the MPU.
-	 * It will initialize the I2C communication, wake up the device, perform the self-test, configure the MPU and loads the calibration data
-   * from the EEPROM if it is available.
-   * This function should be called as soon as possible as this will turn on the MPU so it starts reaching the thermal stabilization.
-   * Once thermal stabilization has been achieved, intialization_2 should be called to finish configuring the device. 
+MpuDev::MpuDev(uint8_t i2c_address_funct, uint8_t eeprom_slot) {
+  /* Constructor of the class. Each MPU on the bus has its own address (AD0 low or high) and its own calibration data in the EEPROM.
+   * 
+   * Parameters:
+   *      @param i2c_address_funct  --> (uint8_t) I2C address of the MPU (I2C_ADDRESS_MPU_LOW or I2C_ADDRESS_MPU_HIGH)
+   *      @param eeprom_slot        --> (uint8_t) Slot of the calibration data, starting at MPU_EEPROM_OFFSET_ADDRESS
+   */
+
+  i2c_address = i2c_address_funct;
+  eeprom_address = MPU_EEPROM_OFFSET_ADDRESS + (int)eeprom_slot * MPU_EEPROM_SLOT_SIZE;
+}
+
+bool MpuDev::startMpu() {
+  /* This function starts the I2C bus (and the serial debug), checks the device ID (WHO_AM_I) and wakes up the MPU with the Gyro-Z
+   * clock. It is the first step of initialize_1() and initializeFast().
+   * The I2C and the serial are only started the first time, so the recoveries of updateHealth() don't restart the serial port (the
+   * bus is started again by recoverBus()).
    *
    * Parameters:
-   *      @return status      --> (bool) Status of the MPU (true = correct, false = error) 
-	 */
+   *      @return status      --> (bool) false if the MPU doesn't answer or the ID is wrong (MPU_I2C_ERROR)
+   */
 
   //--------------------------------------------------
   // System initialization
   //--------------------------------------------------
   // This is only needed if it is not being done elsewhere
 
-	// -- Start I2C --
-	#ifdef I2C_CONFIGURE_MPU
-		// Configure the I2C bus
-		Wire.begin();
-		Wire.setClock(I2C_CLK_SPEED); // I2C 400kHz fast mode
-	#endif
-
-	// --- State serial debug mode ---
-	#ifdef SERIAL_INIT_MPU  //Start serial only in debug mode
-		//initialize serial interface
-		Serial.begin(SERIAL_SPEED);
-		Serial.println(F("Serial debug mode for the MPU initialized :)"));
+	if (!system_started) {
+		// -- Start I2C --
+		#ifdef I2C_CONFIGURE_MPU
+			// Configure the I2C bus
+			Wire.begin();
+			Wire.setClock(I2C_CLK_SPEED); // I2C 400kHz fast mode
+		#endif
+
+		// --- State serial debug mode ---
+		#ifdef SERIAL_INIT_MPU  //Start serial only in debug mode
+			//initialize serial interface
+			Serial.begin(SERIAL_SPEED);
+			Serial.println(F("Serial debug mode for the MPU initialized :)"));
+		#endif
+
+		system_started = true;
+	}
+
+	// -- I2C timeout --
+	// Without it the Wire library waits forever if SDA is stuck low, so the health monitor could never start the recovery
+	#if defined(MPU_HEALTH_MONITOR) && defined(WIRE_HAS_TIMEOUT)
+		Wire.setWireTimeout(MPU_HEALTH_WIRE_TIMEOUT, true);
 	#endif
 
 	//--------------------------------------------------
@@ -263,7 +652,7 @@ bool MpuDev::initialize_1() {
   //--------------------------------------------------
 
   // --- Check communication ---
-  // The communication is checked by reading the MPU ID
+  // The communication is checked by reading the MPU ID (WHO_AM_I)
 
   uint8_t buffer_funct; // This is to hold the register value
   
@@ -303,6 +692,26 @@ bool MpuDev::initialize_1() {
   // --- Wakeup device ---
   setLowPowerMode(false);
 
+  return mpu_state_global != MPU_I2C_ERROR;
+}
+
+bool MpuDev::initialize_1() {
+	/* This function initializes the MPU.
+	 * It will initialize the I2C communication, wake up the device, perform the self-test, configure the MPU and loads the calibration data
+   * from the EEPROM if it is available.
+   * This function should be called as soon as possible as this will turn on the MPU so it starts reaching the thermal stabilization.
+   * Once thermal stabilization has been achieved, intialization_2 should be called to finish configuring the device. 
+   *
+   * Parameters:
+   *      @return status      --> (bool) Status of the MPU (true = correct, false = error) 
+	 */
+
+  //--------------------------------------------------
+  // Start MPU
+  //--------------------------------------------------
+
+  if (!startMpu()) return false;
+
   //--------------------------------------------------
   // Self-test
   //--------------------------------------------------
@@ -317,6 +726,15 @@ bool MpuDev::initialize_1() {
     return false; 
   }
 
+  //--------------------------------------------------
+  // DMP firmware
+  //--------------------------------------------------
+  // The MPU is reset to load the firmware, so it has to be done before the configuration and the offsets
+
+  #ifdef MPU_DMP_MODE
+    if (!loadDmpFirmware()) return false;
+  #endif
+
   //--------------------------------------------------
   // Configure MPU
   //--------------------------------------------------
@@ -357,11 +775,7 @@ bool MpuDev::initialize_2() {
   if (mpu_state_global == MPU_NOT_CALIBRATED) {   // Check is calibration is required
     
     // -- Configure MPU for calibration --
-    changeFullScale(MPU_DEFAULT_ACCEL_REG_VALUE, MPU_DEFAULT_GYRO_REG_VALUE);            // Sets the full-scale to the most sensitive one
-    updateMpuRegister(MPU_DLPF_ADDR, MPU_DLPF_REG_VALUE_DEFAULT, MPU_DLPF_MASK);         // Set the low pass filter. Check .h for more info
-    I2Cdev::writeByte(I2C_ADDRESS_MPU, MPU_SAMPLE_RATE_ADDR, MPU_SAMPLE_RATE_DEFAULT);   // Sets the sample rate. Check .h for more info
-    resetSignalPath();                                                                   // Resets the signal path of the MPU
-    if (mpu_state_global == MPU_I2C_ERROR) return false;
+    if (!configureCalibration()) return false;
     
     // -- Calibrate the MPU --
     correct_funct = performCalibration();
@@ -372,41 +786,149 @@ bool MpuDev::initialize_2() {
   }
 
   // --- Get offset correction ---
+  // With the temperature table it may not be needed (the gyroscope correction is interpolated)
+  if (needsOffsetCorrection()) {
+    // -- Set the sampling rate --
+    if (!configureOffsetCorrection()) return false;
 
-  // -- Set the sampling rate --
-  #ifdef FAST_CALIBRATION_CORRECTION
-    updateMpuRegister(MPU_DLPF_ADDR, MPU_DLPF_REG_VALUE_DEFAULT, MPU_DLPF_MASK);         // Set the low pass filter. Check .h for more info 
-                                                                                         // (needs to be changed also to avoid issues)
-    I2Cdev::writeByte(I2C_ADDRESS_MPU, MPU_SAMPLE_RATE_ADDR, MPU_SAMPLE_RATE_DEFAULT);   // Sets the sample rate. Check .h for more info
+    // -- Get values --
+    getOffsetCorrection();
+  }
+
+  // -- Re-configure the system and start the DMP --
+  return finishInitialization();
+}
+
+bool MpuDev::initializeFast() {
+  /* This function is a fast alternative to initialize_1() + initialize_2() for warm restarts (watchdog reset, brown-out...), when the
+   * MPU has already been calibrated. It only checks the device ID (startMpu()), loads the newest EEPROM record and restores the
+   * working configuration and the offsets in bursts, so the samples are available after a few ms:
+   *      -) Sample rate, DLPF, gyroscope and accelerometer configuration (0x19 to 0x1C) in one burst.
+   *      -) Offsets (setOffsets(), one burst per sensor) and offset correction from the record.
+   *      -) Interrupt configuration.
+   * The self-test, the signal path reset and the offset correction averaging are skipped. The self-test is deferred (self_test_state =
+   * MPU_SELF_TEST_PENDING) and it can be done later with selfTestStep().
+   * If there is no valid record, or its offset correction was taken with other full-scale ranges, it returns false with
+   * MPU_NOT_CALIBRATED and the normal initialization has to be used.
+   * With MPU_DMP_MODE the firmware is loaded (and the DMP is started) as in the normal initialization, so it is slower.
+   *
+   * Parameters:
+   *      @return status      --> (bool) Status of the MPU (true = correct, false = error)
+   */
+
+  int16_t offsets_funct[6];                               // Offsets of the record
+  float temperature_funct;                                // Calibration temperature of the record
+  uint8_t config_funct[4];                                // Registers 0x19 to 0x1C
+
+  // --- Start ---
+  if (!startMpu()) return false;
+
+  // --- Load the record ---
+  offset_correction_loaded = false;
+  if (!loadFromEEPROM(&temperature_funct, offsets_funct) || !offset_correction_loaded) {
+    mpu_state_global = MPU_NOT_CALIBRATED;
+    return false;
+  }
+
+  // --- DMP firmware ---
+  #ifdef MPU_DMP_MODE
+    if (!loadDmpFirmware()) return false;
   #endif
-  
-  // -- Reset the signal path --
-  resetSignalPath();
+
+  // --- Restore the configuration ---
+  config_funct[0] = working_sample_rate_reg;            // MPU_SAMPLE_RATE_ADDR
+  config_funct[1] = working_dlpf_reg;                   // MPU_DLPF_ADDR
+  config_funct[2] = working_gyro_reg;                   // MPU_GYRO_CONF_ADDR
+  config_funct[3] = working_accel_reg;                  // MPU_ACCELEROMETER_CONF_ADDR
+  if (!writeMpuRegisters(MPU_FAST_CONFIG_ADDR, config_funct, 4)) return false;
+  setOffsets(offsets_funct);
+  configureInterrupt(working_int_enable_reg, working_int_pin_reg);
   if (mpu_state_global == MPU_I2C_ERROR) return false;
 
-  // -- Get values --
-  getOffsetCorrection();
+  // --- Temperature compensation ---
+  #ifdef MPU_TEMP_COMPENSATION
+    int16_t temperature_raw_funct;
+    if (readMpuData(MPU_TEMP_REG_BASE, &temperature_raw_funct)) updateTemperatureCompensation(temperature_raw_funct, true);
+  #endif
 
-  // -- Re-configure the system --
-   #ifdef FAST_CALIBRATION_CORRECTION
-    configureMpu();
-    // -- Reset the signal path --
-    resetSignalPath();
+  // --- Ready ---
+  mpu_data_ready = false;   // The first sample may have the old configuration
+  self_test_state = MPU_SELF_TEST_PENDING;
+  mpu_state_global = MPU_CORRECT;
+
+  // Debug
+  #ifdef DEBUG_MODE_MPU
+    Serial.println(F("Device Initialized (fast)"));
   #endif
 
-  // -- Check --
-  if (mpu_state_global != MPU_NOT_INITIALIZED) {
+  #ifdef MPU_DMP_MODE
+    return startDmp();
+  #else
+    return true;
+  #endif
+}
 
-    #ifdef DEBUG_MODE_MPU
-      Serial.println("The MPU couldn't be initialized correctly. ´:(");
-    #endif
+uint8_t MpuDev::selfTestStep() {
+  /* This function does the self-test (checkMpu()) without blocking, so it can be done in the background after initializeFast().
+   * It has to be called periodically (e.g. in loop()) while it returns MPU_SELF_TEST_RUNNING:
+   *      1) MPU_SELF_TEST_PENDING: the self-test full-scale ranges are set.
+   *      2) MPU_SELF_TEST_RUNNING: after MPU_SELF_TEST_WAIT_TIME the results are read and checked and the working ranges are restored.
+   * The samples taken while it is running aren't valid, so they are discarded (mpu_data_ready is cleared and updateEstimators()
+   * ignores them) and prev_time is updated at the end, so the estimators skip that time (they hold the angles for ~0.25 s).
+   * If an axis fails, mpu_state_global is set to its MPU_SELF_TEST_FAILED_BASE state.
+   *
+   * Parameters:
+   *      @return state       --> (uint8_t) self_test_state (MPU_SELF_TEST_PASSED or MPU_SELF_TEST_FAILED when it is done)
+   */
 
-    return false;
+  uint8_t values_raw[4];  // Register values with the self-test results
+
+  switch (self_test_state) {
+    // --- Start ---
+    case MPU_SELF_TEST_PENDING:
+      #ifdef MPU_DMP_MODE
+        if (dmp_started) break;  // The DMP needs its full-scale ranges
+      #endif
+      changeFullScale(MPU_SELF_TEST_ACCEL_REG_VALUE, MPU_SELF_TEST_GYRO_REG_VALUE);
+      self_test_start_time = millis();
+      self_test_state = MPU_SELF_TEST_RUNNING;
+      mpu_data_ready = false;
+      break;
+
+    // --- Wait and check ---
+    case MPU_SELF_TEST_RUNNING:
+      mpu_data_ready = false;
+      if ((millis() - self_test_start_time) < MPU_SELF_TEST_WAIT_TIME) break;
+
+      if (!readMpuRegisters(MPU_SELF_TEST_RESULT_ADDR_BASE, values_raw, 4)) {
+        self_test_state = MPU_SELF_TEST_FAILED;
+      }
+      else {
+        checkSelfTest(values_raw);  // Sets self_test_state
+      }
+
+      // -- Restore --
+      changeFullScale(working_accel_reg, working_gyro_reg);
+      noInterrupts();
+      mpu_data_ready = false;
+      prev_time = time_buffer;
+      #ifdef MPU_FIXED_POINT
+        prev_time_fixed = time_buffer;
+      #endif
+      interrupts();
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.print(F("Background self-test: "));
+        Serial.println(self_test_state == MPU_SELF_TEST_PASSED ? F("passed") : F("failed"));
+      #endif
+      break;
+
+    default:
+      break;
   }
-  
-  // MPU Initialized correctly :p 
-  mpu_state_global = MPU_CORRECT;
-  return true;
+
+  return self_test_state;
 }
 
 bool MpuDev::checkMpu() {
@@ -419,10 +941,7 @@ bool MpuDev::checkMpu() {
    */
 
   // Variables
-  uint8_t values_raw[3];  // Register values with the self-test results
-  uint8_t self_test;      // Self-test value (they are 5 bit unsigned integers)
-  float factory_trimmed;   // factory_trimmed value
-  float result;           // Result of the test
+  uint8_t values_raw[4];  // Register values with the self-test results (X, Y, Z and the accelerometer low bits)
 
   // Debug
     #ifdef DEBUG_MODE_MPU
@@ -438,13 +957,29 @@ bool MpuDev::checkMpu() {
   delay(MPU_SELF_TEST_WAIT_TIME);
 
   // --- Get the values ---
-  if (!readMpuRegisters(MPU_SELF_TEST_RESULT_ADDR_BASE, values_raw, 3)) return false;
+  if (!readMpuRegisters(MPU_SELF_TEST_RESULT_ADDR_BASE, values_raw, 4)) return false;
 
   // --- Restore the full-scale range ---
   // This is done now since the function will end if any error is detected
   // (No need to do this anymore, it will be done later :)
   // changeFullScale(MPU_DEFAULT_ACCEL_REG_VALUE, MPU_DEFAULT_GYRO_REG_VALUE);
 
+  return checkSelfTest(values_raw);
+}
+
+bool MpuDev::checkSelfTest(uint8_t *values_raw) {
+  /* This function compares the self-test results with the factory trimmed values (checkMpu() and selfTestStep()).
+   *
+   * Parameters:
+   *      @param *values_raw  --> (uint8_t) Self-test registers (X, Y, Z and the accelerometer low bits)
+   *      @return bool        --> (bool) true if all the axes are within MPU_SELF_TEST_THRESHOLD (sets self_test_state)
+   */
+
+  uint8_t self_test;      // Self-test value (they are 5 bit unsigned integers)
+  float factory_trimmed;   // factory_trimmed value
+
+  self_test_state = MPU_SELF_TEST_FAILED;
+
   // --- Check accelerometer ---
 
    for (uint8_t i = 0; i < 3; i++) {
@@ -545,6 +1080,7 @@ bool MpuDev::checkMpu() {
     } 
   }
 
+  self_test_state = MPU_SELF_TEST_PASSED;
   return true;
 }
 
@@ -566,21 +1102,22 @@ void MpuDev::configureMpu() {
   //--------------------------------------------------
 
   // --- Configure the full-scale ---
-  changeFullScale(MPU_ACCEL_CONFIG_VALUE, MPU_GYRO_CONFIG_VALUE);  // Sets the full-scale to the working one (It will be changed for calibration)
+  changeFullScale(working_accel_reg, working_gyro_reg);  // Sets the full-scale to the working one (It will be changed for calibration)
   
   // --- Set the low pass filter ---
   // The digital high-pass filter will limit the maximum sample frequency, check .h and the documentation of the MPU for more info. ----------------------------------------------------------- Needs adjustment
-  updateMpuRegister(MPU_DLPF_ADDR, MPU_DLPF_REG_VALUE_WORKING, MPU_DLPF_MASK); // Set the low pass filter. Check .h for more info
+  // (It is set with the sample rate)
 
   // --- Configure the interrupt ---  
-  // The interrupt will be set as DATA_RDY, so it will be set as high when all the measurement registers are updated (including temp, turn off?)
-  updateMpuRegister(MPU_INTERRUPT_CONF_ADDR, MPU_INTERRUPT_DEFAULT, MPU_INTERRUPT_CONF_MASK);  // Check .h for more info
+  // By default the interrupt will be set as DATA_RDY, so it will be set as high when all the measurement registers are updated (including temp, turn off?)
+  // The working configuration can be changed with configureInterrupt()
+  configureInterrupt(working_int_enable_reg, working_int_pin_reg);  // Check .h for more info
 
   // --- Set the sample rate ---
   // The maximum sample rate is 1kHz because of the accelerometer (it could go higher, but the accelerometer measurements will be repeated)
-  // The sample rate will be set by MPU_SAMPLE_RATE, so the sample rate will be:
-  //                          Sample rate = (Oscillation frequency)/(MPU_SAMPLE_RATE_DAFAULT + 1)
-  I2Cdev::writeByte(I2C_ADDRESS_MPU, MPU_SAMPLE_RATE_ADDR, MPU_SAMPLE_RATE_WORKING);   // Check .h for more info
+  // The sample rate will be set by working_sample_rate_reg, so the sample rate will be:
+  //                          Sample rate = (Oscillation frequency)/(working_sample_rate_reg + 1)
+  setSampleRate();   // Check .h for more info
 
   //(Moved)
   //resetSignalPath();
@@ -615,63 +1152,465 @@ void MpuDev::changeFullScale(uint8_t accel_reg, uint8_t gyro_reg) {
    */ 
 
   // --- Set the accelerometer ---
-  //I2Cdev::writeByte(I2C_ADDRESS_MPU, MPU_ACCELEROMETER_CONF_ADDR, accel_reg);
+  //I2Cdev::writeByte(i2c_address, MPU_ACCELEROMETER_CONF_ADDR, accel_reg);
   updateMpuRegister(MPU_ACCELEROMETER_CONF_ADDR, accel_reg, MPU_ACCEL_CONFIG_MASK_VALUE);
 
   // --- Set the gyroscope ---
-  //I2Cdev::writeByte(I2C_ADDRESS_MPU, MPU_GYRO_CONF_ADDR, gyro_reg);
+  //I2Cdev::writeByte(i2c_address, MPU_GYRO_CONF_ADDR, gyro_reg);
   updateMpuRegister(MPU_GYRO_CONF_ADDR, gyro_reg, MPU_GYRO_CONFIG_MASK_VALUE);
 
   // Done :)
 }
 
-void MpuDev::setLowPowerMode(bool sleep_enabled) {
-  /* This function sets the MPU in low power mode.
-   * It will only set the MPU into sleep mode. It can be configured to wake up at a certain rate to get accelerometer values or 
-   * to disable one of the accelerometers or gyroscopes to save energy.
+void MpuDev::setSampleRate() {
+  /* This function sets the working DLPF and sample rate divider registers. The sample rate will be:
+   *                          Sample rate = (Oscillation frequency)/(working_sample_rate_reg + 1)
+   * The oscillation frequency is 8kHz with the DLPF disabled (0 or 7) and 1kHz otherwise.
+   *
    * Parameters:
-   *      @param sleep_enabled      --> (boolean) This is value is used to enabled or disable the sleep mode (true = set sleep mode)
+   *      NA        --> This function doesn't require or return any parameter
    */
 
-  // --- Set the register ---
-  if (sleep_enabled)
-    updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_LOW_POWER_MODE_ENABLE, MPU_LOW_POWER_MODE_MASK);
-  else
-    updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_LOW_POWER_MODE_DISABLE, MPU_LOW_POWER_MODE_MASK);
-}
-
+  // --- Set the low pass filter ---
+  updateMpuRegister(MPU_DLPF_ADDR, working_dlpf_reg, MPU_DLPF_MASK);  // Check .h for more info
 
-//            **************************
-//            *      CALIBRATION       *
-//            **************************
+  // --- Set the sample rate ---
+  writeMpuRegister(MPU_SAMPLE_RATE_ADDR, working_sample_rate_reg);
+}
 
-void MpuDev::setOffsets(int16_t *offsets_funct2) {
-  /*
-   * This function sets the offset registers in the MPU. The goal of this function is to aid the "main" calibration function.
-   *      @param *offsets_funct2  --> Pointer to the offsets array which will be loaded to the MPU 
+bool MpuDev::setSampleRate(uint8_t sample_rate_reg, uint8_t dlpf_reg) {
+  /* This function changes the working sample rate divider and DLPF configuration, so it can be switched while running 
+   * (e.g. low rate for idle and high rate for normal operation). The measurement ready flag is cleared so the next
+   * measurement is taken with the new configuration.
+   *
+   * Parameters:
+   *      @param sample_rate_reg    --> (uint8_t) Value of the sample rate divider register
+   *      @param dlpf_reg           --> (uint8_t) Value of the DLPF register (EXT_SYNC_SET and DLPF_CFG bits)
+   *      @return bool              --> (bool) true = configured correctly
    */
 
-  uint8_t buffer_funct[2];                                // This array will hold the two bytes that form the int16_t 
-  uint8_t address_funct = MPU_ACCEL_OFFSETS_BASE_ADDR;    // Set the address to the accelerometer first
-  
-  for (uint8_t i = 0; i < 6; i++) {
-    // --- Split the data into bytes ---
-    *(int16_t *) buffer_funct = *(offsets_funct2 + i);
+  // --- Check the values ---
+  if (dlpf_reg & ~MPU_DLPF_MASK) return false;
+
+  // --- Set the registers ---
+  if (!updateMpuRegister(MPU_DLPF_ADDR, dlpf_reg, MPU_DLPF_MASK)) return false;
+  if (!writeMpuRegister(MPU_SAMPLE_RATE_ADDR, sample_rate_reg)) return false;
+  working_dlpf_reg = dlpf_reg;
+  working_sample_rate_reg = sample_rate_reg;
+  working_sample_period = 1.0 / getSampleRate();
+  #ifdef MPU_FIXED_POINT
+    working_sample_period_fixed = (mpu_fixed_t)(working_sample_period * 16777216.0 + 0.5);
+  #endif
 
-    // --- Change address ---
-    // This is because there is set the base address for the gyro
-    if (i == 3) address_funct = MPU_GYRO_OFFSETS_BASE_ADDDR;
+  // --- Discard the old measurements ---
+  mpu_data_ready = false;
+  if (fifo_frame_length != 0) resetFifo();
 
-    // --- Write the register ---
-    writeMpuRegister(address_funct, buffer_funct[1]);
-    address_funct++;
-    writeMpuRegister(address_funct, buffer_funct[0]);
-    address_funct++;
-  }
+  return true;
 }
 
-void MpuDev::calculateAverages(int16_t *averages_funct, uint16_t number_of_iterations, int16_t *targets_funct) {
-  /*
+bool MpuDev::setFullScale(uint8_t accel_reg, uint8_t gyro_reg) {
+  /* This function changes the working full-scale ranges (same values as changeFullScale(), without self-test bits) and updates the scale
+   * factors used by refineValues() and the offset correction values (they are in LSB) at the same time, so the measurements stay consistent.
+   * The points of the temperature table (MPU_TEMP_COMPENSATION) are also in LSB of the gyroscope range, so they are rescaled in the same
+   * way and the point being learned is restarted (otherwise the record would store the old values with the new gyro_reg).
+   * The measurement ready flag is cleared so the old measurements aren't refined with the new scale.
+   *
+   * Parameters:
+   *      @param accel_reg          --> (uint8_t) Value of the accelerometer configuration register (0x00, 0x08, 0x10 or 0x18)
+   *      @param gyro_reg           --> (uint8_t) Value of the gyroscope configuration register (0x00, 0x08, 0x10 or 0x18)
+   *      @return bool              --> (bool) true = configured correctly
+   */
+
+  // --- Definitions ---
+  uint8_t accel_range = accel_reg >> MPU_FULL_SCALE_SHIFT;
+  uint8_t gyro_range = gyro_reg >> MPU_FULL_SCALE_SHIFT;
+  int8_t accel_shift = (int8_t)(working_accel_reg >> MPU_FULL_SCALE_SHIFT) - accel_range;  // Sensitivity change as a power of 2
+  int8_t gyro_shift = (int8_t)(working_gyro_reg >> MPU_FULL_SCALE_SHIFT) - gyro_range;
+  mpu_real_t accel_scale_funct;
+  mpu_real_t gyro_scale_funct;
+
+  // --- Check the values ---
+  if ((accel_reg & ~MPU_FULL_SCALE_MASK) || (gyro_reg & ~MPU_FULL_SCALE_MASK)) return false;
+
+  // --- Set the registers ---
+  if (!updateMpuRegister(MPU_ACCELEROMETER_CONF_ADDR, accel_reg, MPU_ACCEL_CONFIG_MASK_VALUE)) return false;
+  if (!updateMpuRegister(MPU_GYRO_CONF_ADDR, gyro_reg, MPU_GYRO_CONFIG_MASK_VALUE)) return false;
+
+  // --- Update the scales ---
+  accel_scale_funct = 1.0 / MPU_SENSITIVITY(accel_1g_values, accel_range);
+  gyro_scale_funct = M_PI / (180.0 * MPU_SENSITIVITY(gyro_1dps_values, gyro_range));
+
+  noInterrupts();
+  working_accel_reg = accel_reg;
+  working_gyro_reg = gyro_reg;
+  working_accel_scale = accel_scale_funct;
+  working_gyro_scale = gyro_scale_funct;
+  #ifdef MPU_FIXED_POINT
+    working_accel_scale_fixed = (mpu_fixed_t)(16777216.0 * accel_scale_funct + 0.5);
+    working_gyro_scale_fixed = (mpu_fixed_t)(16777216.0 * gyro_scale_funct + 0.5);
+  #endif
+
+  // -- Offset correction --
+  // A positive shift is a more sensitive range (more LSB per unit), so the correction is multiplied, otherwise it is divided (rounded)
+  for (uint8_t i = 0; i < 6; i++) {
+    *(offset_correction + i) = rescaleCorrection(*(offset_correction + i), (i < 3) ? accel_shift : gyro_shift);
+  }
+
+  // -- Temperature table --
+  #ifdef MPU_TEMP_COMPENSATION
+    for (uint8_t n = 0; n < MPU_TEMP_TABLE_POINTS; n++) {
+      for (uint8_t i = 0; i < 3; i++) temp_table[n].gyro_correction[i] = rescaleCorrection(temp_table[n].gyro_correction[i], gyro_shift);
+    }
+    temp_learn_count = 0;   // The sums are in the old LSB
+  #endif
+
+  // -- Discard the old measurements --
+  mpu_data_ready = false;
+  interrupts();
+
+  // -- Restart the stillness detector and the pre-filter --
+  // Their states are in LSB
+  #ifdef MPU_BIAS_TRACKING
+    still_samples = 0;
+  #endif
+  #ifdef MPU_PREFILTER
+    setPrefilter(prefilter_decimation);
+  #endif
+
+  if (fifo_frame_length != 0) resetFifo();
+
+  return true;
+}
+
+int16_t MpuDev::rescaleCorrection(int16_t correction_funct, int8_t shift_funct) {
+  /* This function converts a correction in LSB to a new full-scale range. Each range step halves the sensitivity, so a positive shift
+   * (a more sensitive range, more LSB per unit) multiplies the correction, otherwise it is divided (rounded). The result is saturated.
+   *
+   * Parameters:
+   *      @param correction_funct   --> (int16_t) Correction in LSB of the old range
+   *      @param shift_funct        --> (int8_t) Sensitivity change as a power of 2 (old range - new range)
+   *      @return correction        --> (int16_t) Correction in LSB of the new range
+   */
+
+  int32_t value_funct = correction_funct;
+
+  if (shift_funct > 0) value_funct *= ((int32_t)1 << shift_funct);
+  else if (shift_funct < 0) value_funct = (value_funct + ((int32_t)1 << (-shift_funct - 1))) >> -shift_funct;
+  if (value_funct > INT16_MAX) value_funct = INT16_MAX;
+  if (value_funct < INT16_MIN) value_funct = INT16_MIN;
+
+  return value_funct;
+}
+
+bool MpuDev::setWorkingConfig(uint8_t accel_reg, uint8_t gyro_reg, uint8_t sample_rate_reg, uint8_t dlpf_reg) {
+  /* This function changes the whole working configuration of the MPU, so it can be switched between modes without reflashing
+   * (e.g. low-rate idle mode and a high-rate and high-range mode).
+   *
+   * Parameters:
+   *      @param accel_reg          --> (uint8_t) Value of the accelerometer configuration register (0x00, 0x08, 0x10 or 0x18)
+   *      @param gyro_reg           --> (uint8_t) Value of the gyroscope configuration register (0x00, 0x08, 0x10 or 0x18)
+   *      @param sample_rate_reg    --> (uint8_t) Value of the sample rate divider register
+   *      @param dlpf_reg           --> (uint8_t) Value of the DLPF register
+   *      @return bool              --> (bool) true = configured correctly
+   */
+
+  if (!setFullScale(accel_reg, gyro_reg)) return false;
+  return setSampleRate(sample_rate_reg, dlpf_reg);
+}
+
+float MpuDev::getSampleRate() {
+  /* This function calculates the working sample rate from the DLPF and sample rate divider registers.
+   *
+   * Parameters:
+   *      @return float             --> (float) Sample rate in Hz
+   */
+
+  uint8_t dlpf_cfg = working_dlpf_reg & 0x07;
+
+  if ((dlpf_cfg == 0) || (dlpf_cfg == 7)) return (float)MPU_GYRO_RATE_DLPF_OFF / (working_sample_rate_reg + 1);
+  return (float)MPU_GYRO_RATE_DLPF_ON / (working_sample_rate_reg + 1);
+}
+
+void MpuDev::setLowPowerMode(bool sleep_enabled) {
+  /* This function sets the MPU in low power mode.
+   * It will only set the MPU into sleep mode. The accelerometer only modes (cycle and wake-on-motion) are set by setPowerState().
+   * Parameters:
+   *      @param sleep_enabled      --> (boolean) This is value is used to enabled or disable the sleep mode (true = set sleep mode)
+   */
+
+  // --- Set the register ---
+  if (sleep_enabled)
+    updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_LOW_POWER_MODE_ENABLE, MPU_LOW_POWER_MODE_MASK);
+  else
+    updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_LOW_POWER_MODE_DISABLE, MPU_LOW_POWER_MODE_MASK);
+}
+
+bool MpuDev::setPowerState(uint8_t power_state_funct, uint8_t wake_rate) {
+  /* This function changes the power state of the MPU:
+   *      -) MPU_POWER_ACTIVE: restores the working configuration. The state is MPU_POWER_WAKING until the gyroscopes have started up,
+   *         then updatePowerState() sets it to MPU_POWER_ACTIVE and measures the wake-up latency (wake_latency).
+   *      -) MPU_POWER_CYCLE: the gyroscopes are set in standby and the MPU wakes up at "wake_rate" to take one accelerometer sample,
+   *         the data ready interrupt is kept (only the accelerometer measurements are valid).
+   *      -) MPU_POWER_MOTION: as MPU_POWER_CYCLE, but only the motion interrupt is enabled (motion_threshold and motion_duration),
+   *         so the MCU can sleep until the MPU is moved. updatePowerState() wakes it up when the interrupt is received.
+   *      -) MPU_POWER_SLEEP: sleep mode (setLowPowerMode()).
+   * The DMP has to be stopped before (it needs the gyroscopes).
+   *
+   * Parameters:
+   *      @param power_state_funct  --> (uint8_t) New power state (MPU_POWER_ACTIVE, MPU_POWER_CYCLE, MPU_POWER_MOTION or MPU_POWER_SLEEP)
+   *      @param wake_rate          --> (uint8_t) Wake-up rate of the accelerometer only modes (MPU_LP_WAKE_1_25HZ to MPU_LP_WAKE_40HZ)
+   *      @return status            --> (bool) false if the state isn't valid or the MPU couldn't be configured
+   */
+
+  bool correct_funct = true;
+
+  #ifdef MPU_DMP_MODE
+    if (dmp_started) return false;  // The DMP needs the gyroscopes
+  #endif
+
+  switch (power_state_funct) {
+    // --- Full rate ---
+    case MPU_POWER_ACTIVE:
+      correct_funct &= writeMpuRegister(MPU_PWR_MGMT_2_ADDR, 0x00);
+      correct_funct &= updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_PWR_MGMT_1_ACTIVE, MPU_PWR_MGMT_1_MASK);
+      correct_funct &= updateMpuRegister(MPU_ACCELEROMETER_CONF_ADDR, MPU_ACCEL_HPF_OFF, MPU_ACCEL_HPF_MASK);
+      correct_funct &= updateMpuRegister(MPU_INTERRUPT_CONF_ADDR, working_int_enable_reg, MPU_INTERRUPT_POWER_MASK);
+      if (fifo_frame_length != 0) resetFifo();  // The FIFO has accelerometer only frames
+
+      // -- Wait for the gyroscopes (updatePowerState()) --
+      noInterrupts();
+      mpu_data_ready = false;
+      interrupts();
+      wake_start_time = micros();
+      power_state = MPU_POWER_WAKING;
+      break;
+
+    // --- Accelerometer only ---
+    case MPU_POWER_CYCLE:
+    case MPU_POWER_MOTION:
+      // -- Motion detection --
+      // The high-pass filter removes the gravity, so the threshold is applied to the changes of acceleration
+      if (power_state_funct == MPU_POWER_MOTION) {
+        correct_funct &= writeMpuRegister(MPU_MOT_THR_ADDR, motion_threshold);
+        correct_funct &= writeMpuRegister(MPU_MOT_DUR_ADDR, motion_duration);
+        correct_funct &= updateMpuRegister(MPU_ACCELEROMETER_CONF_ADDR, MPU_ACCEL_HPF_5HZ, MPU_ACCEL_HPF_MASK);
+        correct_funct &= updateMpuRegister(MPU_INTERRUPT_CONF_ADDR, MPU_INTERRUPT_MOTION, MPU_INTERRUPT_POWER_MASK);
+      }
+      else {
+        correct_funct &= updateMpuRegister(MPU_ACCELEROMETER_CONF_ADDR, MPU_ACCEL_HPF_OFF, MPU_ACCEL_HPF_MASK);
+        correct_funct &= updateMpuRegister(MPU_INTERRUPT_CONF_ADDR, MPU_INTERRUPT_DEFAULT, MPU_INTERRUPT_POWER_MASK);
+      }
+
+      // -- Cycle mode --
+      // The gyroscopes are set in standby first, so the clock can be changed to the internal oscillator
+      correct_funct &= writeMpuRegister(MPU_PWR_MGMT_2_ADDR, (wake_rate & MPU_LP_WAKE_MASK) | MPU_PWR_MGMT_2_STBY_GYRO);
+      correct_funct &= updateMpuRegister(MPU_LOW_POWER_MODE_ADDR, MPU_PWR_MGMT_1_CYCLE, MPU_PWR_MGMT_1_MASK);
+      checkMotion();  // Clears the old interrupts
+      power_state = power_state_funct;
+      power_wake_rate = wake_rate;
+      break;
+
+    // --- Sleep ---
+    case MPU_POWER_SLEEP:
+      setLowPowerMode(true);
+      power_state = MPU_POWER_SLEEP;
+      break;
+
+    default:
+      return false;
+  }
+
+  // Debug
+  #ifdef DEBUG_MODE_MPU
+    Serial.print(F("Power state: "));
+    Serial.println(power_state);
+  #endif
+
+  return correct_funct;
+}
+
+bool MpuDev::checkMotion() {
+  /* This function reads the interrupt status register, which also clears the interrupts, and checks the motion detection bit.
+   * The status read with the measurements is also checked (the reading clears the register), and the motion bit is cleared from
+   * interrupt_status.
+   *
+   * Parameters:
+   *      @return motion            --> (bool) true if the threshold has been exceeded since the last reading
+   */
+
+  uint8_t status_funct;
+
+  if (!readMpuRegister(MPU_INT_STATUS_ADDR, &status_funct)) return false;
+
+  status_funct |= interrupt_status;
+  interrupt_status = status_funct & ~MPU_INT_STATUS_MOTION;
+
+  return (status_funct & MPU_INT_STATUS_MOTION) != 0;
+}
+
+bool MpuDev::configureInterrupt(uint8_t int_enable_reg, uint8_t int_pin_reg) {
+  /* This function sets the working interrupt configuration: the interrupts routed to the INT pin (INT_ENABLE) and the pin itself
+   * (INT_PIN_CFG). Both registers are consecutive, so they are written in one burst (the I2C bypass and FSYNC bits are kept).
+   * The interrupts which were set can be told apart with the status bits read with the measurements (getInterruptStatus()), e.g.
+   * MPU_INTERRUPT_DATA_READY | MPU_INTERRUPT_FIFO_OVERFLOW to detect the FIFO overflows from the data ready interrupt routine.
+   * In the accelerometer only power states (setPowerState()) INT_ENABLE isn't changed, it is set when going back to MPU_POWER_ACTIVE.
+   * The configuration is kept by configureMpu() and initializeFast().
+   *
+   * Parameters:
+   *      @param int_enable_reg     --> (uint8_t) Enabled interrupts: MPU_INTERRUPT_DATA_READY, MPU_INTERRUPT_FIFO_OVERFLOW and MPU_INTERRUPT_MOTION
+   *      @param int_pin_reg        --) (uint8_t) Pin configuration: MPU_INT_PIN_ACTIVE_LOW, MPU_INT_PIN_OPEN_DRAIN, MPU_INT_PIN_LATCH and
+   *                                    MPU_INT_PIN_CLEAR_ON_READ (MPU_INT_PIN_DEFAULT by default)
+   *      @return status            --> (bool) State of the register writing process (true = success)
+   */
+
+  uint8_t registers_funct[2];       // INT_PIN_CFG and INT_ENABLE
+
+  // --- Working configuration ---
+  working_int_enable_reg = int_enable_reg & MPU_INTERRUPT_POWER_MASK;
+  working_int_pin_reg = int_pin_reg & MPU_INT_PIN_CFG_MASK;
+
+  // --- Update the registers ---
+  if (!readMpuRegisters(MPU_INT_PIN_CFG_ADDR, registers_funct, 2)) return false;
+  registers_funct[0] = working_int_pin_reg | (registers_funct[0] & ~MPU_INT_PIN_CFG_MASK);
+  if ((power_state != MPU_POWER_CYCLE) && (power_state != MPU_POWER_MOTION)) {
+    registers_funct[1] = working_int_enable_reg | (registers_funct[1] & ~MPU_INTERRUPT_POWER_MASK);
+  }
+
+  return writeMpuRegisters(MPU_INT_PIN_CFG_ADDR, registers_funct, 2);
+}
+
+uint8_t MpuDev::getInterruptStatus() {
+  /* This function gets the interrupt status bits read with the measurements (readMpuMeasurements(), pollReadMpuMeasurements() and
+   * MpuScheduler::readAll()) since the last call, and clears them. No register is read.
+   *
+   * Parameters:
+   *      @return status            --> (uint8_t) INT_STATUS bits: MPU_INT_STATUS_DATA_READY, MPU_INT_STATUS_FIFO_OVERFLOW and MPU_INT_STATUS_MOTION
+   */
+
+  uint8_t status_funct = interrupt_status;
+
+  interrupt_status = 0;
+
+  return status_funct;
+}
+
+uint8_t MpuDev::updatePowerState() {
+  /* This function manages the transitions that depend on the interrupts, it doesn't block so it has to be called periodically
+   * (e.g. in loop() before the measurements):
+   *      -) MPU_POWER_MOTION: when the interrupt is received (mpu_data_ready) and it is a motion one, the MPU is set back to full rate.
+   *      -) MPU_POWER_WAKING: the samples are discarded until the gyroscopes have started up (MPU_GYRO_STARTUP_TIME). The first valid
+   *         sample is kept (mpu_data_ready), the time from the wake-up is stored in wake_latency, and prev_time is updated so the
+   *         estimators don't integrate the time spent in low power mode.
+   *
+   * Parameters:
+   *      @return power_state       --> (uint8_t) Current power state
+   */
+
+  unsigned long elapsed_funct;
+
+  switch (power_state) {
+    // --- Wake-on-motion ---
+    case MPU_POWER_MOTION:
+      if (!mpu_data_ready) break;
+      mpu_data_ready = false;
+      if (checkMotion()) setPowerState(MPU_POWER_ACTIVE);
+      break;
+
+    // --- Gyroscopes start-up ---
+    case MPU_POWER_WAKING:
+      if (!mpu_data_ready) break;
+      elapsed_funct = micros() - wake_start_time;
+      if (elapsed_funct < MPU_GYRO_STARTUP_TIME) {
+        mpu_data_ready = false;
+        break;
+      }
+
+      wake_latency = elapsed_funct;
+      wake_count++;
+      prev_time = time_buffer;
+      #ifdef MPU_FIXED_POINT
+        prev_time_fixed = time_buffer;
+      #endif
+      power_state = MPU_POWER_ACTIVE;
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.print(F("Wake-up latency (us): "));
+        Serial.println(wake_latency);
+      #endif
+      break;
+
+    default:
+      break;
+  }
+
+  return power_state;
+}
+
+
+//            **************************
+//            *      CALIBRATION       *
+//            **************************
+
+void MpuDev::setOffsets(int16_t *offsets_funct2, uint8_t axes_mask) {
+  /*
+   * This function sets the offset registers in the MPU. The goal of this function is to aid the "main" calibration function.
+   * The accelerometer (0x06 to 0x0B) and gyroscope (0x13 to 0x18) offsets are contiguous, so each block is written in one burst.
+   * Only the registers from the first to the last axis of the mask are written, so the calibrated axes are skipped (a block without
+   * any axis in the mask isn't written).
+   *      @param *offsets_funct2  --> Pointer to the offsets array which will be loaded to the MPU 
+   *      @param axes_mask        --> Axes to be written (bit 0 = A_X ... bit 5 = G_Z), all of them by default
+   */
+
+  uint8_t buffer_funct[6];                                // This array will hold the bytes (big endian) of one block of offsets
+  uint8_t block_mask;                                     // Axes of the current block in the mask
+  uint8_t first_axis, last_axis;                          // First and last axes of the block to be written
+  
+  for (uint8_t block = 0; block < 2; block++) {
+    block_mask = (axes_mask >> (block * 3)) & 0x07;
+    if (block_mask == 0) continue;  // Nothing to write
+
+    // --- Split the data into bytes ---
+    for (uint8_t i = 0; i < 3; i++) {
+      buffer_funct[i * 2]     = (uint8_t)(*(offsets_funct2 + block * 3 + i) >> 8);
+      buffer_funct[i * 2 + 1] = (uint8_t)(*(offsets_funct2 + block * 3 + i));
+    }
+
+    // --- Get the range ---
+    first_axis = (block_mask & 0x01) ? 0 : ((block_mask & 0x02) ? 1 : 2);
+    last_axis = (block_mask & 0x04) ? 2 : ((block_mask & 0x02) ? 1 : 0);
+
+    // --- Write the registers ---
+    writeMpuRegisters(((block == 0) ? MPU_ACCEL_OFFSETS_BASE_ADDR : MPU_GYRO_OFFSETS_BASE_ADDDR) + first_axis * 2, 
+                      buffer_funct + first_axis * 2, (last_axis - first_axis + 1) * 2);
+  }
+}
+
+bool MpuDev::getOffsets(int16_t *offsets_funct) {
+  /*
+   * This function reads the offset registers of the MPU (both blocks in one burst each), the opposite of setOffsets().
+   *      @param *offsets_funct   --> Pointer to the offsets array where the values will be loaded (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+   *      @return status          --> (bool) State of the reading process (true = success)
+   */
+
+  uint8_t buffer_funct[6];                                // This array will hold the bytes (big endian) of one block of offsets
+
+  for (uint8_t block = 0; block < 2; block++) {
+    // --- Read the registers ---
+    if (!readMpuRegisters((block == 0) ? MPU_ACCEL_OFFSETS_BASE_ADDR : MPU_GYRO_OFFSETS_BASE_ADDDR, buffer_funct, 6)) return false;
+
+    // --- Convert data ---
+    for (uint8_t i = 0; i < 3; i++) {
+      *(offsets_funct + block * 3 + i) = (buffer_funct[i * 2] << 8) | (buffer_funct[i * 2 + 1]);
+    }
+  }
+
+  return true;
+}
+
+void MpuDev::calculateAverages(int16_t *averages_funct, uint16_t number_of_iterations, int16_t *targets_funct) {
+  /*
    * This function calculates the average values obtained with the current offset values of the MPU.
    * The average values will be updated in the averages array, so it will overwrite the previous ones
    *      @param *averages_funct            --> Pointer to the averages array
@@ -727,209 +1666,368 @@ void MpuDev::calculateAverages(int16_t *averages_funct, uint16_t number_of_itera
   */
 }
 
-bool MpuDev::calibrate(int16_t *offsets_funct) {
+void MpuDev::startMeans(uint16_t max_iterations, int16_t *targets_funct, uint8_t axes_mask, bool early_stop) {
   /*
-   *  This is the main function to calibrate the MPU. The calibration process goes as follows: 
-   *    1)  The fist step is to find an offset value that produces a negative average (low offset) and other value 
-   *        that produces a positive one (high offset). This values will be the initial range for the approximation
-   *        process.
-   *    2)  The next step is to follow a successive approximation process to decrease the offset range found during (1). 
-   *        This is done by calculating the average offset between the low and high offsets and evaluating the average
-   *        value. If the value is positive --> that offset will be the new high offset, or if negative, the value 
-   *        will be the low offset. This will be repeated until the maximum number of iterations is done or the range
-   *        is closed. 
-   *    3)  The offsets register values (values which will be written to the registers) and the external offset values
-   *        (error even after the offset register has been adjusted) are returned.
-   *
-   *         @param *offsets_funct          --> Pointer to the offsets array (this is done so the values can be
-                                                loaded and stored in the EEPROM)
-   *         @return bool                   --> Status of the calibration (true = success)
+   * This function starts a new incremental mean calculation (see updateMeans()). Only the axes in the mask are sampled and their
+   * means are zeroed (the other ones keep their last values).
+   *      @param max_iterations             --> Maximum number of samples to be taken
+   *      @param *targets_funct             --> Pointer to the target array (it is copied)
+   *      @param axes_mask                  --> Axes to be sampled (bit 0 = A_X ... bit 5 = G_Z)
+   *      @param early_stop                 --> If false all the samples are taken (true by default)
    */
 
-  // Variables
-  int16_t low_offsets[6], high_offsets[6];       // These arrays store the low and high offset values respectively
-  int16_t low_values[6], high_values[6];
-  int16_t averages[6];                           // Average array
-  int16_t targets[] = {X_ACCEL_TARGET, Y_ACCEL_TARGET, Z_ACCEL_TARGET,
-                       X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};   // Target array, stores the expected values
-  uint16_t count = 0;                            // This is to count the number of iterations 
-  bool use_max_iterations = false;               // This is to set the maximum number of iterations for the average
-  int16_t max_difference = 0;
+  calibration.means_early_stop = early_stop;
+  calibration.means_axes = axes_mask & MPU_ALL_AXES;
+  calibration.pending_means = calibration.means_axes;
+  calibration.means_count = 0;
+  calibration.means_max_samples = max_iterations;
+  calibration.means_start_time = millis();
 
-  // Debug
-  #ifdef DEBUG_MODE_MPU
-    Serial.println(F("MPU Calibration initialized :)"));
-  #endif
+  for (uint8_t index = 0; index < 6; index++) {
+    calibration.targets[index] = *(targets_funct + index);
+    calibration.samples[index] = 0;
+    if (calibration.pending_means & (1 << index)) {
+      calibration.means[index] = 0;
+      calibration.m2[index] = 0;
+    }
+  }
+}
 
-  //--------------------------------------------------
-  // Initialize
-  //--------------------------------------------------
+bool MpuDev::updateMeans(int16_t *values_raw) {
+  /*
+   * This function adds one sample to the means started by startMeans(). The running mean and variance of each axis are updated with 
+   * every sample (Welford's method) and an axis stops being sampled once the confidence interval of its mean is within +-CALIBRATION_MIN_ERROR:
+   *                          CALIBRATION_CONFIDENCE_Z2 * variance / n <= CALIBRATION_MIN_ERROR^2
+   * When the means are done, the samples and the time spent on each axis are added to calibration_stats.
+   *      @param *values_raw                --> Pointer to the raw measurements (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+   *      @return bool                      --> true = the means are done
+   */
+
+  calibration.means_count++;
+
+  // --- Update the pending axes ---
   for (uint8_t index = 0; index < 6; index++) {
-    low_offsets[index]  = *(offsets_funct + index);
-    high_offsets[index] = *(offsets_funct + index);
+    if (!(calibration.pending_means & (1 << index))) continue;  // This axis is already accurate enough
+
+    float value_funct = (float)(*(values_raw + index) - calibration.targets[index]);
+    float delta_funct = value_funct - calibration.means[index];
+    calibration.samples[index]++;
+    calibration.means[index] += delta_funct / calibration.samples[index];
+    calibration.m2[index] += delta_funct * (value_funct - calibration.means[index]);
+
+    // -- Check the confidence interval --
+    if (calibration.means_early_stop && (calibration.samples[index] >= CALIBRATION_MIN_SAMPLES) && 
+        (CALIBRATION_CONFIDENCE_Z2 * calibration.m2[index] <= 
+         (float)CALIBRATION_MIN_ERROR * CALIBRATION_MIN_ERROR * calibration.samples[index] * calibration.samples[index])) {
+      calibration.pending_means &= ~(1 << index);
+      calibration_stats.time_ms[index] += millis() - calibration.means_start_time;
+    }
   }
 
-  bool done = false;  // This is to know is the process has been completed
+  if ((calibration.pending_means != 0) && (calibration.means_count < calibration.means_max_samples)) return false;
 
-  //--------------------------------------------------
-  // Locate initial range
-  //--------------------------------------------------
-  
-  // Debug
-  #ifdef DEBUG_MODE_MPU
-    Serial.println(F("Locating the initial range..."));
-  #endif
+  // --- Statistics ---
+  for (uint8_t index = 0; index < 6; index++) {
+    if (!(calibration.means_axes & (1 << index))) continue;
+    calibration_stats.iterations[index]++;
+    calibration_stats.samples[index] += calibration.samples[index];
+    if (calibration.pending_means & (1 << index)) calibration_stats.time_ms[index] += millis() - calibration.means_start_time;  // It didn't stop early
+  }
 
-  // Loop
-  while (!done) {
-    done = true;  // Set the process as done, then set it as not done if not
+  return true;
+}
 
-    // -- Locate the low offset value --
-    setOffsets(low_offsets);                                            // Set the offsets
-    calculateAverages(averages, CALIBRATION_INITIAL_AVERAGES, targets); // Calculate averages
-    for (uint8_t index = 0; index < 6; index++) {
-      low_values[index] = averages[index];
-      if (averages[index] >= 0) {
-        done = false;
-        low_offsets[index] -= CALIBRATION_OFFSET_ADJUSTMENT;
-      }
-    }
+uint16_t MpuDev::calculateMeans(float *means_funct, uint16_t max_iterations, int16_t *targets_funct, uint8_t axes_mask) {
+  /*
+   * This function calculates the mean values obtained with the current offset values of the MPU, but it stops as soon as they are accurate 
+   * enough (see updateMeans()). Only the axes in the mask are sampled.
+   * The mean values will be updated in the means array, so it will overwrite the previous ones (only the ones in the mask)
+   *      @param *means_funct               --> Pointer to the means array (mean - target)
+   *      @param max_iterations             --> Maximum number of samples to be taken
+   *      @param *targets_funct             --> Pointer to the target array
+   *      @param axes_mask                  --> Axes to be sampled (bit 0 = A_X ... bit 5 = G_Z), all of them by default
+   *      @return uint16_t                  --> Number of samples taken
+   */
 
-    // -- Locate the high offset value --
-    setOffsets(high_offsets);                                           // Set the offsets
-    calculateAverages(averages, CALIBRATION_INITIAL_AVERAGES, targets); // Calculate averages
-    for (uint8_t index = 0; index < 6; index++) {
-      high_values[index] = averages[index];
-      if (averages[index] <= 0) {
-        done = false;
-        high_offsets[index] += CALIBRATION_OFFSET_ADJUSTMENT;
-      }
+  int16_t values_raw[6];  // Values read from the device
+
+  // --- Start ---
+  startMeans(max_iterations, targets_funct, axes_mask);
+
+  // -------------------------------
+  // --- Obtain the measurements ---
+  // -------------------------------
+  do {
+    while (!mpu_data_ready) {
+      // Wait for the data to be ready
     }
+    
+    // -- Measure --
+    getParameter6(values_raw);
+    if (mpu_state_global == MPU_I2C_ERROR) return calibration.means_count;
 
-    // Check if it is done or not 
-    if (count++ > CALIBRATION_MAX_ITERATIONS) done = true;  // stop for over iterations
-    // Check that there aren't are I2C issues
-    if (mpu_state_global == MPU_I2C_ERROR) return false;
+    // -- Reset --
+    mpu_data_ready = false;
+  } while (!updateMeans(values_raw));
 
-    // Debug
-    #ifdef DEBUG_MODE_MPU
-      Serial.print(F("Iterations: "));
-      Serial.println(count);
-      Serial.println("[" + String(low_offsets[0]) + ", " + String(high_offsets[0]) + "] --> " + "[" + String(low_values[0]) + ", " + String(high_values[0]) + "]");
-      Serial.println("[" + String(low_offsets[1]) + ", " + String(high_offsets[1]) + "] --> " + "[" + String(low_values[1]) + ", " + String(high_values[1]) + "]");
-      Serial.println("[" + String(low_offsets[2]) + ", " + String(high_offsets[2]) + "] --> " + "[" + String(low_values[2]) + ", " + String(high_values[2]) + "]");
-      Serial.println("[" + String(low_offsets[3]) + ", " + String(high_offsets[3]) + "] --> " + "[" + String(low_values[3]) + ", " + String(high_values[3]) + "]");
-      Serial.println("[" + String(low_offsets[4]) + ", " + String(high_offsets[4]) + "] --> " + "[" + String(low_values[4]) + ", " + String(high_values[4]) + "]");
-      Serial.println("[" + String(low_offsets[5]) + ", " + String(high_offsets[5]) + "] --> " + "[" + String(low_values[5]) + ", " + String(high_values[5]) + "]");
-    #endif
-  }  // Range found
+  // --- Copy the means ---
+  for (uint8_t index = 0; index < 6; index++) {
+    if (calibration.means_axes & (1 << index)) *(means_funct + index) = calibration.means[index];
+  }
+
+  return calibration.means_count;
+}
+
+void MpuDev::startOffsetSearch(int16_t *offsets_funct) {
+  /*
+   * This function starts the offset search of calibrate(): it sets the initial offsets and starts the first mean of the sensitivity 
+   * measurement. The search is then advanced by advanceOffsetSearch() every time the means are done.
+   *         @param *offsets_funct          --> Pointer to the initial offsets array
+   */
+
+  int16_t targets[] = {X_ACCEL_TARGET, Y_ACCEL_TARGET, Z_ACCEL_TARGET,
+                       X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};   // Target array, stores the expected values
 
   // Debug
   #ifdef DEBUG_MODE_MPU
-    Serial.println(F("Done locating the initial range :p"));
-    Serial.println(count);
-    Serial.println(F("Reduce the range...."));
+    Serial.println(F("MPU Calibration initialized :)"));
+    Serial.println(F("Measuring the sensitivity..."));
   #endif
 
-  if (count < CALIBRATION_MAX_ITERATIONS) done = false;
+  // -- Reset the statistics --
+  memset(&calibration_stats, 0, sizeof(calibration_stats));
+  calibration.start_time = millis();
+
+  // -- Initialize --
+  for (uint8_t index = 0; index < 6; index++) calibration.offsets[index] = *(offsets_funct + index);
+  calibration.found_low = 0;
+  calibration.found_high = 0;
+  calibration.pending_axes = MPU_ALL_AXES;
+  calibration.iterations = 0;
+
+  // --- First mean of the sensitivity ---
+  setOffsets(calibration.offsets);
+  startMeans(CALIBRATION_INITIAL_AVERAGES, targets, MPU_ALL_AXES);
+  calibration_state = MPU_CALIB_SENSITIVITY;
+}
 
-  // -- calculate new offsets -- (it could be move outside the while loop and calculate the offsets is the other for loop)
-  for(uint8_t index = 0; index < 6; index++) {
-    *(offsets_funct + index) = (low_offsets[index] + high_offsets[index])/2;  // Set the new offset to the middle point 
-  }
+void MpuDev::advanceOffsetSearch() {
+  /*
+   * This function advances the offset search of calibrate() once the current means are done. The process goes as follows: 
+   *    1)  The means are measured with the initial offsets and with the offsets increased by CALIBRATION_SENSITIVITY_STEP, so the
+   *        sensitivity (LSB per offset step) of each axis is known.
+   *    2)  The next offsets are calculated with the secant method (offset - mean / sensitivity), so they jump near the answer instead
+   *        of bisecting the range. The sensitivity is updated with the last two measurements and the low (negative mean) and high 
+   *        (positive mean) offsets found are used to bracket the next offsets. An axis is done (frozen) when the step is 0 or the range
+   *        is closed, so its offsets aren't written again and it isn't sampled anymore.
+   *    3)  When all the axes are done, the offsets and the offset correction values of the best measurement of each axis are selected
+   *        and calibration_state is set to MPU_CALIB_SEARCH_DONE (or MPU_CALIB_ERROR for over iterations).
+   */
 
-  //--------------------------------------------------
-  // Decrease the initial range
-  //--------------------------------------------------
-  while (!done) {
-    
-    max_difference = 0;   // This is to store the maximum difference between the high and low offsets of all the components
-    done = true;
-    
-    // -- Average with the new offset values --
-    setOffsets(offsets_funct);
-    if (use_max_iterations) {
-      calculateAverages(averages, CALIBRATION_AVERAGES, targets);
-    } else {
-      calculateAverages(averages, CALIBRATION_INITIAL_AVERAGES, targets);
+  int16_t max_step = 0;                          // Maximum offset change of this iteration
+
+  // --------------------------------------------------
+  // Measure the sensitivity
+  // --------------------------------------------------
+  if (calibration_state == MPU_CALIB_SENSITIVITY) {
+    // -- Second mean with the increased offsets --
+    for (uint8_t index = 0; index < 6; index++) {
+      calibration.prev_offsets[index] = calibration.offsets[index];
+      calibration.prev_means[index] = calibration.means[index];
+      calibration.offsets[index] += CALIBRATION_SENSITIVITY_STEP;
     }
+    setOffsets(calibration.offsets);
+    startMeans(CALIBRATION_INITIAL_AVERAGES, calibration.targets, MPU_ALL_AXES);
+    calibration_state = MPU_CALIB_SENSITIVITY_STEP;
+    return;
+  }
 
-    // Loop all the components
+  if (calibration_state == MPU_CALIB_SENSITIVITY_STEP) {
     for (uint8_t index = 0; index < 6; index++) {
-      
-      int16_t difference;  // This is to hold the current difference between the high and low offset for each components
-      
-      // -- Check if the new offsets are low or high --
-      if (averages[index] <= 0) {  // Low offset
-        low_offsets[index] = *(offsets_funct + index);
-        low_values[index] = averages[index];
-      } else {                      // High offset
-        high_offsets[index] = *(offsets_funct + index);
-        high_values[index] = averages[index];
+      calibration.sensitivity[index] = (calibration.means[index] - calibration.prev_means[index]) / CALIBRATION_SENSITIVITY_STEP;
+      if (calibration.sensitivity[index] < CALIBRATION_MIN_SENSITIVITY) calibration.sensitivity[index] = CALIBRATION_MIN_SENSITIVITY;  // Saturated or too noisy
+
+      // -- Best measurement --
+      if (fabs(calibration.prev_means[index]) <= fabs(calibration.means[index])) {
+        calibration.best_offsets[index] = calibration.prev_offsets[index];
+        calibration.best_means[index] = calibration.prev_means[index];
+      } else {
+        calibration.best_offsets[index] = calibration.offsets[index];
+        calibration.best_means[index] = calibration.means[index];
       }
-
-      // -- Evaluate --
-      difference = high_offsets[index] - low_offsets[index];
-      if (max_difference < difference) max_difference = difference;
-
-      // -- Set the new offsets --
-      *(offsets_funct + index) = (low_offsets[index] + high_offsets[index])/2;  // Set the new offset to the middle point for the next iteration
     }
 
-    // Check the progress
-    if (max_difference > CALIBRATION_MIN_ERROR) done = false;                     // Check if the calibration is done
-    if (max_difference <= CALIBRATION_INITIAL_ERROR) use_max_iterations = true;   // Change the iterations value
-    if (count++ > CALIBRATION_MAX_ITERATIONS) done = true;                        // stop for over iterations
-    // Check that there aren't are I2C issues
-    if (mpu_state_global == MPU_I2C_ERROR) return false;
+    // Debug
+    #ifdef DEBUG_MODE_MPU
+      Serial.println(F("Searching the offsets..."));
+    #endif
+  } else {
+    // -- Best measurement --
+    for (uint8_t index = 0; index < 6; index++) {
+      if ((calibration.pending_axes & (1 << index)) && (fabs(calibration.means[index]) < fabs(calibration.best_means[index]))) {
+        calibration.best_offsets[index] = calibration.offsets[index];
+        calibration.best_means[index] = calibration.means[index];
+      }
+    }
 
     // Debug
     #ifdef DEBUG_MODE_MPU
       Serial.print(F("Iterations: "));
-      Serial.println(count);
-      Serial.print(F("max_difference: "));
-      Serial.println(max_difference);
-      Serial.println("[" + String(low_offsets[0]) + ", " + String(high_offsets[0]) + "] --> " + "[" + String(low_values[0]) + ", " + String(high_values[0]) + "]");
-      Serial.println("[" + String(low_offsets[1]) + ", " + String(high_offsets[1]) + "] --> " + "[" + String(low_values[1]) + ", " + String(high_values[1]) + "]");
-      Serial.println("[" + String(low_offsets[2]) + ", " + String(high_offsets[2]) + "] --> " + "[" + String(low_values[2]) + ", " + String(high_values[2]) + "]");
-      Serial.println("[" + String(low_offsets[3]) + ", " + String(high_offsets[3]) + "] --> " + "[" + String(low_values[3]) + ", " + String(high_values[3]) + "]");
-      Serial.println("[" + String(low_offsets[4]) + ", " + String(high_offsets[4]) + "] --> " + "[" + String(low_values[4]) + ", " + String(high_values[4]) + "]");
-      Serial.println("[" + String(low_offsets[5]) + ", " + String(high_offsets[5]) + "] --> " + "[" + String(low_values[5]) + ", " + String(high_values[5]) + "]");
+      Serial.println(calibration.iterations);
+      Serial.print(F("Samples: "));
+      Serial.println(calibration.means_count);
+      for (uint8_t index = 0; index < 6; index++) {
+        Serial.println(String(calibration.offsets[index]) + " --> " + String(calibration.means[index]) + " (" + String(calibration.sensitivity[index]) + " LSB/step)");
+      }
     #endif
   }
 
-  //--------------------------------------------------
-  // Done
-  //--------------------------------------------------
+  // --------------------------------------------------
+  // Secant search
+  // --------------------------------------------------
 
-  // -- Select the best results --
-  // The best will be the ones with the lowest absolute value average
+  // Loop all the components
   for (uint8_t index = 0; index < 6; index++) {
-    if ((-1 * low_values[index]) <= high_values[index]) {
-      *(offsets_funct + index) = low_offsets[index];
-      *(offset_correction + index) = low_values[index];
-    } else {
-      *(offsets_funct + index) = high_offsets[index];
-      *(offset_correction + index) = high_values[index];
+    
+    int32_t new_offset;  // Next offset of this component
+    int16_t offset_funct = calibration.offsets[index];
+
+    if (!(calibration.pending_axes & (1 << index))) continue;  // This component is already done
+    
+    // -- Bracket the solution --
+    if (calibration.means[index] <= 0) {  // Low offset
+      if (!(calibration.found_low & (1 << index)) || (offset_funct > calibration.low_offsets[index])) calibration.low_offsets[index] = offset_funct;
+      calibration.found_low |= (1 << index);
+    } else {                              // High offset
+      if (!(calibration.found_high & (1 << index)) || (offset_funct < calibration.high_offsets[index])) calibration.high_offsets[index] = offset_funct;
+      calibration.found_high |= (1 << index);
     }
-  }
+
+    // -- Update the sensitivity --
+    if (offset_funct != calibration.prev_offsets[index]) {
+      float sensitivity_funct = (calibration.means[index] - calibration.prev_means[index]) / (offset_funct - calibration.prev_offsets[index]);
+      if (sensitivity_funct >= CALIBRATION_MIN_SENSITIVITY) calibration.sensitivity[index] = sensitivity_funct;  // Ignore the noisy estimations
+    }
+
+    // -- Secant step --
+    new_offset = offset_funct - lround(calibration.means[index] / calibration.sensitivity[index]);
+    if ((calibration.found_low & calibration.found_high) & (1 << index)) {
+      // Keep the new offset inside the range (bisect if the step goes out of it)
+      if ((calibration.high_offsets[index] - calibration.low_offsets[index]) <= CALIBRATION_MIN_ERROR) new_offset = offset_funct;
+      else if ((new_offset <= calibration.low_offsets[index]) || (new_offset >= calibration.high_offsets[index])) {
+        new_offset = (calibration.low_offsets[index] + calibration.high_offsets[index]) / 2;
+      }
+    }
+    if (new_offset > INT16_MAX) new_offset = INT16_MAX;
+    if (new_offset < INT16_MIN) new_offset = INT16_MIN;
+
+    // -- Evaluate --
+    calibration.prev_offsets[index] = offset_funct;
+    calibration.prev_means[index] = calibration.means[index];
+    if (new_offset == offset_funct) {   // It can't be improved
+      calibration.pending_axes &= ~(1 << index);
+      continue;
+    }
+    if (abs(new_offset - offset_funct) > max_step) max_step = abs(new_offset - offset_funct);
+    calibration.offsets[index] = new_offset;
+  }
+
+  // --------------------------------------------------
+  // Next measurement
+  // --------------------------------------------------
+  if ((calibration.pending_axes != 0) && (calibration.iterations++ <= CALIBRATION_MAX_ITERATIONS)) {
+    // The calibrated axes are frozen: their offsets aren't written and they aren't sampled
+    setOffsets(calibration.offsets, calibration.pending_axes);
+    if (max_step <= CALIBRATION_INITIAL_ERROR) {
+      startMeans(CALIBRATION_AVERAGES, calibration.targets, calibration.pending_axes);
+    } else {
+      startMeans(CALIBRATION_INITIAL_AVERAGES, calibration.targets, calibration.pending_axes);
+    }
+    calibration_state = MPU_CALIB_SEARCH;
+    return;
+  }
+
+  // --------------------------------------------------
+  // Done
+  // --------------------------------------------------
+
+  // -- Select the best results --
+  // The best will be the ones with the lowest absolute value mean
+  for (uint8_t index = 0; index < 6; index++) {
+    calibration.offsets[index] = calibration.best_offsets[index];
+    *(offset_correction + index) = lround(calibration.best_means[index]);
+  }
+  calibration_stats.total_time_ms = millis() - calibration.start_time;
 
   // Debug
   #ifdef DEBUG_MODE_MPU
     Serial.print(F("Done locating the offsets XD\nNumber of iterations: "));
-    Serial.println(count);
-    Serial.println(String(*(offsets_funct))     + ", " + String(*(offsets_funct + 1)) + ", " + String(*(offsets_funct + 2)) + ", ");
-    Serial.println(String(*(offsets_funct + 3)) + ", " + String(*(offsets_funct + 4)) + ", " + String(*(offsets_funct + 5)));
+    Serial.println(calibration.iterations);
+    Serial.println(String(calibration.offsets[0]) + ", " + String(calibration.offsets[1]) + ", " + String(calibration.offsets[2]) + ", ");
+    Serial.println(String(calibration.offsets[3]) + ", " + String(calibration.offsets[4]) + ", " + String(calibration.offsets[5]));
     Serial.println(String(*(offset_correction))     + ", " + String(*(offset_correction + 1)) + ", " + String(*(offset_correction + 2)) + ", ");
     Serial.println(String(*(offset_correction + 3)) + ", " + String(*(offset_correction + 4)) + ", " + String(*(offset_correction + 5)));
+    Serial.println(F("Iterations, samples and time (ms) of each axis:"));
+    for (uint8_t index = 0; index < 6; index++) {
+      Serial.println(String(calibration_stats.iterations[index]) + ", " + String(calibration_stats.samples[index]) + ", " + String(calibration_stats.time_ms[index]));
+    }
+    Serial.println("Total time (ms): " + String(calibration_stats.total_time_ms));
   #endif
 
-  // The calibration is done, return true if correct and false is it stopped for over iterations
-  if (count > CALIBRATION_MAX_ITERATIONS) {
+  // The search is done, it is an error if it stopped for over iterations with axes still pending (the counter is also over the limit
+  // when the last axes converge in the measurement after the last one allowed)
+  if (calibration.pending_axes != 0) {
     mpu_state_global = MPU_CALIBRATION_ERROR;
-    return false;
-  } 
-  return true;
+    calibration_state = MPU_CALIB_ERROR;
+  } else {
+    calibration_state = MPU_CALIB_SEARCH_DONE;
+  }
+}
+
+bool MpuDev::calibrate(int16_t *offsets_funct) {
+  /*
+   *  This is the main function to calibrate the MPU. All the axes are calibrated in parallel with a secant search (see advanceOffsetSearch()).
+   *  The offsets register values (values which will be written to the registers) and the external offset values
+   *  (error even after the offset register has been adjusted) of the best measurement of each axis are returned.
+   *  The means stop sampling once they are accurate enough (updateMeans()), so most of the measurements are much shorter 
+   *  than CALIBRATION_AVERAGES. This function blocks until the calibration is done, calibrationStep() does the same without blocking.
+   *
+   *         @param *offsets_funct          --> Pointer to the offsets array (this is done so the values can be
+                                                loaded and stored in the EEPROM)
+   *         @return bool                   --> Status of the calibration (true = success)
+   */
+
+  int16_t values_raw[6];  // Values read from the device
+
+  // --- Start ---
+  startOffsetSearch(offsets_funct);
+
+  // --- Search ---
+  while ((calibration_state >= MPU_CALIB_SENSITIVITY) && (calibration_state <= MPU_CALIB_SEARCH)) {
+    while (!mpu_data_ready) {
+      // Wait for the data to be ready
+    }
+
+    // -- Measure --
+    getParameter6(values_raw);
+    if (mpu_state_global == MPU_I2C_ERROR) {
+      calibration_state = MPU_CALIB_ERROR;
+      return false;
+    }
+    mpu_data_ready = false;
+
+    // -- Advance --
+    if (updateMeans(values_raw)) advanceOffsetSearch();
+    // Check that there aren't are I2C issues
+    if (mpu_state_global == MPU_I2C_ERROR) {
+      calibration_state = MPU_CALIB_ERROR;
+      return false;
+    }
+  }
+
+  // --- Done ---
+  for (uint8_t index = 0; index < 6; index++) *(offsets_funct + index) = calibration.offsets[index];
+  return calibration_state == MPU_CALIB_SEARCH_DONE;
 }
 
 void MpuDev::getOffsetCorrection() {
@@ -943,6 +2041,7 @@ void MpuDev::getOffsetCorrection() {
 
   int16_t targets_funct[] = {X_ACCEL_TARGET, Y_ACCEL_TARGET, Z_ACCEL_TARGET,
                              X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};   // Target array, stores the expected values
+  int16_t correction_funct[6];      // Measured offset correction
 
   // Debug Mode
   #ifdef DEBUG_MODE_MPU
@@ -950,7 +2049,32 @@ void MpuDev::getOffsetCorrection() {
   #endif
 
   // --- Calculate the averages ---
-  calculateAverages(CALIBRATION_CORRECTION_AVERAGES, offset_correction, targets_funct);
+  calculateAverages(correction_funct, CALIBRATION_CORRECTION_AVERAGES, targets_funct);
+
+  // --- Set the values ---
+  setOffsetCorrection(correction_funct);
+}
+
+void MpuDev::setOffsetCorrection(int16_t *correction_funct) {
+  /*
+   * This function sets the offset correction measured with the MPU still. It is used by getOffsetCorrection() and calibrationStep(), so
+   * both initialization paths do the same: the values are stored in offset_correction and, with MPU_TEMP_COMPENSATION, the gyroscope
+   * correction is added to the temperature table as the point of the current temperature.
+   * Parameters:
+   *      @param *correction_funct  --> (int16_t) Offset correction in LSB of the working full-scale ranges (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+   */
+
+  // --- Store the values ---
+  noInterrupts();
+  for (uint8_t i = 0; i < 6; i++) *(offset_correction + i) = *(correction_funct + i);
+  interrupts();
+
+  // --- Temperature table ---
+  // The MPU is still, so the gyroscope correction is a point of the table
+  #ifdef MPU_TEMP_COMPENSATION
+    int16_t temperature_funct;
+    if (readMpuData(MPU_TEMP_REG_BASE, &temperature_funct)) addTemperaturePoint(temperature_funct, offset_correction + 3);
+  #endif
 
   // Debug Mode
   #ifdef DEBUG_MODE_MPU
@@ -958,8 +2082,25 @@ void MpuDev::getOffsetCorrection() {
     Serial.println(String(*(offset_correction))     + ", " + String(*(offset_correction + 1)) + ", " + String(*(offset_correction + 2)) + ", ");
     Serial.println(String(*(offset_correction + 3)) + ", " + String(*(offset_correction + 4)) + ", " + String(*(offset_correction + 5)));
   #endif
-  // Done, the values are already stored in offset_correction
+}
+
+bool MpuDev::needsOffsetCorrection() {
+  /*
+   * This function checks if the offset correction has to be measured, it is used by initialize_2() and startCalibration().
+   * With the temperature table it isn't needed if the accelerometer correction was loaded from the EEPROM and the table covers the
+   * current temperature: the gyroscope correction is interpolated and set by updateTemperatureCompensation().
+   *
+   *      @return bool      --> true = the offset correction has to be measured
+   */
+
+  #ifdef MPU_TEMP_COMPENSATION
+    int16_t temperature_funct;
+    if (!eeprom_save_pending && offset_correction_loaded && readMpuData(MPU_TEMP_REG_BASE, &temperature_funct)) {
+      return !updateTemperatureCompensation(temperature_funct, true);
+    }
+  #endif
 
+  return true;
 }
 
 bool MpuDev::checkCalibration() {
@@ -985,6 +2126,9 @@ bool MpuDev::checkCalibration() {
   
   if (calibrated) {  // Calibration data exists
     float temp_difference = mpu_current_temperature - mpu_previous_temperature;  // Now this stores the temperature difference to avoid having an additional variable-----------------------------------------------------------Optimization could be done
+    #ifdef MPU_TEMP_COMPENSATION
+      temp_difference = 0;  // The drift is corrected by the temperature table, so the calibration is kept at any temperature
+    #endif
     if (abs(temp_difference) < CALIBRATION_MAX_TEMP_DIFF) {  // The temperature is in range
       // No calibration needed, set the offsets and quit
       setOffsets(mpu_offsets); 
@@ -1023,38 +2167,277 @@ bool MpuDev::performCalibration() {
 
   // Variables
   int16_t mpu_offsets[6] = {0, 0, 0, 0, 0, 0};   // Initial offset values
-  float mpu_current_temperature;                // Temperature of the MPU
   bool correct;                                 // Flag to know if the calibration is correct or not
 
   // --- Start calibration ---
   correct = calibrate(mpu_offsets);  // Calibrate
   if (!correct) return false;  // calibration error
 
+  // --- Store the calibration ---
+  return storeCalibration(mpu_offsets);
+}
+
+bool MpuDev::storeCalibration(int16_t *offsets_funct) {
+  /*
+   * This function sets the offsets found by the calibration and records the calibration temperature. They are stored in the EEPROM
+   * by finishOffsetCorrection(), so the record also has the offset correction and there is only one EEPROM write per calibration.
+   *
+   *      @param *offsets_funct   --> Pointer to the offsets array
+   *      @return bool            --> true = set correctly
+   */
+
   mpu_state_global = MPU_NOT_INITIALIZED;
 
   // -- Get the calibration temperature --
-  mpu_current_temperature = getTemperature();
+  calibration_temperature = getTemperature();
 
   // -- Set the offset values --
-  setOffsets(mpu_offsets);
+  setOffsets(offsets_funct);
   // Check
   if (mpu_state_global == MPU_I2C_ERROR) return false;
 
   // Debug
   #ifdef DEBUG_MODE_MPU
-    Serial.println(F("Calibration done. Loading data to the EEPROM"));
+    Serial.println(F("Calibration done. The data will be stored in the EEPROM with the offset correction"));
   #endif
 
-  // --- save to the EEPROM ---
-  saveOnEEPROM(&mpu_current_temperature, mpu_offsets);
+  // --- save to the EEPROM (finishOffsetCorrection()) ---
+  eeprom_save_pending = true;
 
-  // Debug
-  #ifdef DEBUG_MODE_MPU
-    Serial.println(F("MPU calibrated and data loaded in the EEPROM"));
+  // Completed :)
+    return true;
+}
+
+bool MpuDev::configureCalibration() {
+  /*
+   * This function configures the MPU for the calibration (most sensitive full-scale and 1kHz sample rate).
+   *
+   *      @return bool      --> true = configured correctly
+   */
+
+  changeFullScale(MPU_DEFAULT_ACCEL_REG_VALUE, MPU_DEFAULT_GYRO_REG_VALUE);            // Sets the full-scale to the most sensitive one
+  updateMpuRegister(MPU_DLPF_ADDR, MPU_DLPF_REG_VALUE_DEFAULT, MPU_DLPF_MASK);         // Set the low pass filter. Check .h for more info
+  I2Cdev::writeByte(i2c_address, MPU_SAMPLE_RATE_ADDR, MPU_SAMPLE_RATE_DEFAULT);   // Sets the sample rate. Check .h for more info
+  resetSignalPath();                                                                   // Resets the signal path of the MPU
+  return mpu_state_global != MPU_I2C_ERROR;
+}
+
+bool MpuDev::configureOffsetCorrection() {
+  /*
+   * This function configures the MPU to get the offset correction values (1kHz sample rate if FAST_CALIBRATION_CORRECTION is defined).
+   *
+   *      @return bool      --> true = configured correctly
+   */
+
+  // -- Set the sampling rate --
+  #ifdef FAST_CALIBRATION_CORRECTION
+    updateMpuRegister(MPU_DLPF_ADDR, MPU_DLPF_REG_VALUE_DEFAULT, MPU_DLPF_MASK);         // Set the low pass filter. Check .h for more info 
+                                                                                         // (needs to be changed also to avoid issues)
+    I2Cdev::writeByte(i2c_address, MPU_SAMPLE_RATE_ADDR, MPU_SAMPLE_RATE_DEFAULT);   // Sets the sample rate. Check .h for more info
+  #endif
+  
+  // -- Reset the signal path --
+  resetSignalPath();
+  return mpu_state_global != MPU_I2C_ERROR;
+}
+
+bool MpuDev::finishOffsetCorrection() {
+  /*
+   * This function restores the working configuration once the offset correction values are obtained and sets the MPU as ready.
+   * If the MPU has just been calibrated, the calibration is stored in the EEPROM with the offset correction.
+   *
+   *      @return bool      --> true = the MPU is initialized correctly
+   */
+
+  // -- Re-configure the system --
+   #ifdef FAST_CALIBRATION_CORRECTION
+    configureMpu();
+    // -- Reset the signal path --
+    resetSignalPath();
   #endif
 
-  // Completed :)
+  // -- Check --
+  if (mpu_state_global != MPU_NOT_INITIALIZED) {
+
+    #ifdef DEBUG_MODE_MPU
+      Serial.println("The MPU couldn't be initialized correctly. ´:(");
+    #endif
+
+    return false;
+  }
+
+  // -- Store the calibration --
+  if (eeprom_save_pending) {
+    int16_t offsets_funct[6];                           // Offsets set by the calibration
+
+    eeprom_save_pending = false;
+    if (!getOffsets(offsets_funct)) return false;
+    if (!saveOnEEPROM(&calibration_temperature, offsets_funct)) {
+      mpu_state_global = MPU_EEPROM_ERROR;
+      return false;
+    }
+
+    // Debug
+    #ifdef DEBUG_MODE_MPU
+      Serial.println(F("MPU calibrated and data loaded in the EEPROM"));
+    #endif
+  }
+  
+  // MPU Initialized correctly :p 
+  mpu_state_global = MPU_CORRECT;
+  return true;
+}
+
+bool MpuDev::finishInitialization() {
+  /*
+   * This function is the common end of initialize_2() and calibrationStep(): it restores the working configuration once the offset
+   * correction is known (finishOffsetCorrection()) and, with MPU_DMP_MODE, starts the DMP.
+   *
+   *      @return bool      --> true = the MPU is initialized correctly
+   */
+
+  if (!finishOffsetCorrection()) return false;
+
+  // --- Start the DMP ---
+  #ifdef MPU_DMP_MODE
+    return startDmp();
+  #else
     return true;
+  #endif
+}
+
+bool MpuDev::startCalibration() {
+  /*
+   * This function starts the non-blocking version of initialize_2(): the calibration (if needed), storing it in the EEPROM and the 
+   * offset correction (and the DMP start with MPU_DMP_MODE). Then calibrationStep() has to be called periodically (e.g. in loop()) 
+   * until calibration_state is MPU_CALIB_DONE or MPU_CALIB_ERROR, so the application can keep running while the MPU is being calibrated.
+   *
+   *      @return bool      --> true = started correctly
+   */
+
+  int16_t targets[] = {X_ACCEL_TARGET, Y_ACCEL_TARGET, Z_ACCEL_TARGET,
+                       X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};   // Target array, stores the expected values
+
+  // --- Calibrate the MPU ---
+  if (mpu_state_global == MPU_NOT_CALIBRATED) {   // Check is calibration is required
+    int16_t mpu_offsets[6] = {0, 0, 0, 0, 0, 0};   // Initial offset values
+
+    if (!configureCalibration()) {
+      calibration_state = MPU_CALIB_ERROR;
+      return false;
+    }
+    startOffsetSearch(mpu_offsets);
+  } else if (!needsOffsetCorrection()) {
+    // --- Offset correction from the temperature table ---
+    calibration_state = finishInitialization() ? MPU_CALIB_DONE : MPU_CALIB_ERROR;
+    return calibration_state == MPU_CALIB_DONE;
+  } else {
+    // --- Get offset correction ---
+    if (!configureOffsetCorrection()) {
+      calibration_state = MPU_CALIB_ERROR;
+      return false;
+    }
+    startMeans(CALIBRATION_CORRECTION_AVERAGES, targets, MPU_ALL_AXES, false);
+    calibration_state = MPU_CALIB_CORRECTION;
+  }
+
+  mpu_data_ready = false;  // Discard the samples taken with the previous configuration
+  return mpu_state_global != MPU_I2C_ERROR;
+}
+
+uint8_t MpuDev::calibrationStep() {
+  /*
+   * This function advances the non-blocking calibration started by startCalibration(). If there is a sample ready (mpu_data_ready) it is 
+   * added to the current means and, when they are done, the calibration goes to the next step (see advanceOffsetSearch()). It never waits 
+   * for the data, so it should be called as often as possible. Only the writes of the registers and the EEPROM (and the signal path 
+   * reset) take a few ms.
+   *
+   *      @return uint8_t   --> Progress of the calibration in % (100 = done), calibration_state gives the details
+   */
+
+  int16_t values_raw[6];  // Values read from the device
+  int16_t targets[] = {X_ACCEL_TARGET, Y_ACCEL_TARGET, Z_ACCEL_TARGET,
+                       X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};   // Target array, stores the expected values
+
+  // --- Consume the ready sample ---
+  if ((calibration_state >= MPU_CALIB_SENSITIVITY) && (calibration_state != MPU_CALIB_SEARCH_DONE) && 
+      (calibration_state <= MPU_CALIB_CORRECTION) && mpu_data_ready) {
+
+    // -- Measure --
+    getParameter6(values_raw);
+    mpu_data_ready = false;
+    if (mpu_state_global == MPU_I2C_ERROR) {
+      calibration_state = MPU_CALIB_ERROR;
+      return getCalibrationProgress();
+    }
+
+    // -- Advance --
+    if (updateMeans(values_raw)) {
+      if (calibration_state == MPU_CALIB_CORRECTION) {
+        // -- Offset correction done --
+        int16_t correction_funct[6];
+        for (uint8_t index = 0; index < 6; index++) correction_funct[index] = lround(calibration.means[index]);
+        setOffsetCorrection(correction_funct);
+        calibration_state = finishInitialization() ? MPU_CALIB_DONE : MPU_CALIB_ERROR;
+      } else {
+        advanceOffsetSearch();
+      }
+    }
+    if (mpu_state_global == MPU_I2C_ERROR) calibration_state = MPU_CALIB_ERROR;
+  }
+
+  // --- Store the calibration ---
+  if (calibration_state == MPU_CALIB_SEARCH_DONE) {
+    if (!storeCalibration(calibration.offsets)) {
+      calibration_state = MPU_CALIB_ERROR;
+      return getCalibrationProgress();
+    }
+
+    // -- Configure MPU --
+    configureMpu();
+
+    // -- Start the offset correction --
+    if (!configureOffsetCorrection()) {
+      calibration_state = MPU_CALIB_ERROR;
+      return getCalibrationProgress();
+    }
+    startMeans(CALIBRATION_CORRECTION_AVERAGES, targets, MPU_ALL_AXES, false);
+    calibration_state = MPU_CALIB_CORRECTION;
+    mpu_data_ready = false;  // Discard the samples taken with the previous configuration
+  }
+
+  return getCalibrationProgress();
+}
+
+uint8_t MpuDev::getCalibrationProgress() {
+  /*
+   * This function estimates the progress of the calibration: 10% for the sensitivity, 60% for the search (by calibrated axes) and 
+   * 30% for the offset correction (by samples).
+   *
+   *      @return uint8_t   --> Progress of the calibration in % (100 = done)
+   */
+
+  uint8_t calibrated_axes = 0;
+
+  switch (calibration_state) {
+    case MPU_CALIB_SENSITIVITY:
+      return 0;
+    case MPU_CALIB_SENSITIVITY_STEP:
+      return 5;
+    case MPU_CALIB_SEARCH:
+      for (uint8_t index = 0; index < 6; index++) {
+        if (!(calibration.pending_axes & (1 << index))) calibrated_axes++;
+      }
+      return 10 + calibrated_axes * 10;
+    case MPU_CALIB_SEARCH_DONE:
+      return 70;
+    case MPU_CALIB_CORRECTION:
+      return 70 + (uint8_t)((30UL * calibration.means_count) / CALIBRATION_CORRECTION_AVERAGES);
+    case MPU_CALIB_DONE:
+      return 100;
+    default:
+      return 0;
+  }
 }
 
 
@@ -1063,165 +2446,182 @@ bool MpuDev::performCalibration() {
 //            **************************
 
 
+int8_t MpuDev::findEepromRecord(MpuCalibrationRecord *record_funct) {
+  /*
+   * This function reads the MPU_EEPROM_RECORDS records of the EEPROM slot of the MPU (eeprom_address) in one pass and finds the newest
+   * valid one. A record is valid if it has the current version (MPU_EEPROM_RECORD_VERSION) and its CRC is correct, so a record that
+   * was being written when the device was turned off is ignored (the previous one is still used). The newest record is the one with
+   * the highest sequence number (the comparison handles the wrap around).
+   *
+   * Parameters of the function:
+   *      @param *record_funct     -->  (MpuCalibrationRecord) Output with the newest valid record (only valid if it returns >= 0)
+   *      @return index            -->  (int8_t) Index of the newest valid record, -1 if there are no valid records
+   */
+
+  MpuCalibrationRecord buffer_funct;                      // Record being checked
+  int8_t newest_funct = -1;                               // Index of the newest valid record
+
+  for (uint8_t i = 0; i < MPU_EEPROM_RECORDS; i++) {
+    EEPROM.get(eeprom_address + i * sizeof(MpuCalibrationRecord), buffer_funct);
+
+    // -- Check --
+    if (buffer_funct.version != MPU_EEPROM_RECORD_VERSION) continue;
+    if (MpuTelemetry::crc16((const uint8_t *)&buffer_funct, offsetof(MpuCalibrationRecord, crc)) != buffer_funct.crc) continue;
+
+    // -- Newest --
+    if ((newest_funct < 0) || ((int8_t)(buffer_funct.sequence - record_funct->sequence) > 0)) {
+      *record_funct = buffer_funct;
+      newest_funct = i;
+    }
+  }
+
+  return newest_funct;
+}
+
 bool MpuDev::loadFromEEPROM(float *temperature_mpu, int16_t *offsets_funct) {
   /*
    * This function checks if there is any calibration data stored in the EEPROM and loads it.
-   * The values are stored sequentially and the initial address is defined by MPU_EEPROM_OFFSET_ADDRESS.
-   * The data is stored in the EEPROM as follows:
-   *      -) MPU_CALIBRATION_CONTROL_BYTE:      Byte to confirm that there is data stored in the EEPROM.
-   *      -) x_Accelerometer_offset_high:       Most significant byte of the X accelerometer offset value.
-   *      -) x_accelerometer_offset_low:        Least significant byte of the X accelerometer offset value.
-   *      -) y_Accelerometer_offset_high:       Most significant byte of the Y accelerometer offset value.
-   *      -) y_accelerometer_offset_low:        Least significant byte of the Y accelerometer offset value.
-   *      -) z_Accelerometer_offset_high:       Most significant byte of the Z accelerometer offset value.
-   *      -) z_accelerometer_offset_low:        Least significant byte of the Z accelerometer offset value.
-   *      -) x_gyroscope_offset_high:           Most significant byte of the X gyroscope offset value.
-   *      -) x_gyroscope_offset_low:            Least significant byte of the X gyroscope offset value.
-   *      -) y_gyroscope_offset_high:           Most significant byte of the Y gyroscope offset value.
-   *      -) y_gyroscope_offset_low:            Least significant byte of the Y gyroscope offset value.
-   *      -) z_gyroscope_offset_high:           Most significant byte of the Z gyroscope offset value.
-   *      -) z_gyroscope_offset_low:            Least significant byte of the Z gyroscope offset value.
-   *      -) temperature_high_high:         Most significant byte of the temperature at which the sensor was calibrated.
-   *      -) temperature_high:              Second most significant byte of the temperature at which the sensor was calibrated.
-   *      -) temperature_low:               Second least significant byte of the temperature at which the sensor was calibrated
-   *      -) temperature_low_low:           Least significant byte of the temperature at which the sensor was calibrated.
-   * 
-   * The control byte is defined as follows: X7 X6 X5 X4 X3 X2 X1 X0
-   *      -) X7, X6, X5, X4 --> 0xD if the data has been attempted to be stored
-   *      -) X3, X2, X1, X0 --> 0xD if the data has been stored correctly
-   * 
+   * Each MPU has MPU_EEPROM_RECORDS records (MpuCalibrationRecord) starting at its EEPROM slot (eeprom_address), which are written in
+   * turns to spread the wear. The newest valid record is loaded (findEepromRecord()):
+   *      -) The offsets and the calibration temperature are returned.
+   *      -) The offset correction is loaded into offset_correction if it was obtained with the working full-scale ranges.
+   *      -) The temperature table (MPU_TEMP_COMPENSATION) is loaded if it was obtained with the working gyroscope full-scale.
+   *
    * Parameters of the function:
    *      @param *temperature_mpu  -->  pointer to a float value to load the temperature form the EEPROM.
    *      @param *offsets_funct    -->  pointer to the offsets array where the values from the EEPROM will be loaded.
    *      @return bool             -->  boolean value set to "true" if the reading is correct, or "false" if not.
    */
 
-  byte buffer_array[4];
-  int address = MPU_EEPROM_OFFSET_ADDRESS;
+  MpuCalibrationRecord record_funct;
 
-  // --- Check if there is data stored in the EEPROM ---
-  if (EEPROM.read(address) != 0xDD) {
+  // --- Find the record ---
+  if (findEepromRecord(&record_funct) < 0) {
     // Debug
     #ifdef DEBUG_MODE_MPU
-      Serial.print(F("EEPROM not loaded. "));
-      Serial.println(EEPROM.read(address));
+      Serial.println(F("EEPROM not loaded. No valid record"));
     #endif
     return false; // No data, return false
   }
 
-  // --- Read data from EEPROM ---
-  address++;
-    // Reset the temperature
+  // --- Load the data ---
+  for (uint8_t i = 0; i < 6; i++) *(offsets_funct + i) = record_funct.offsets[i];
+  *temperature_mpu = record_funct.temperature;
 
-  // -- Offsets --
-  for (uint8_t i = 0; i < 6; i++) {
-    
-    // -- Get data --
-    buffer_array[0] = EEPROM.read(address);
-    address++;
-    buffer_array[1] = EEPROM.read(address);
-    address++;
+  calibration_temperature = record_funct.temperature;
 
-    // convert
-    *(offsets_funct + i) = *(int16_t *) buffer_array;
+  // -- Offset correction --
+  if ((record_funct.accel_reg == working_accel_reg) && (record_funct.gyro_reg == working_gyro_reg)) {
+    for (uint8_t i = 0; i < 6; i++) offset_correction[i] = record_funct.offset_correction[i];
+    offset_correction_loaded = true;
   }
 
-  // -- Temperature --
-  for (uint8_t i = 0; i < 4; i++) {
-    buffer_array[i] = EEPROM.read(address);;
-    address++;
-  }
-  *temperature_mpu = *(float *) buffer_array;
-  
+  // -- Temperature table --
+  #ifdef MPU_TEMP_COMPENSATION
+    if (record_funct.gyro_reg == working_gyro_reg) {
+      for (uint8_t i = 0; i < MPU_TEMP_TABLE_POINTS; i++) temp_table[i] = record_funct.temp_table[i];
+      temp_table_valid = record_funct.temp_table_valid;
+    }
+  #endif
+
   // --- END ---
   return true;
 }
 
-void MpuDev::saveOnEEPROM(float *temperature_mpu, int16_t *offsets_funct) {
+bool MpuDev::saveOnEEPROM(float *temperature_mpu, int16_t *offsets_funct) {
   /*
-   * This function stores the calibration data in the EEPROM. 
-   * The data structure is specified in the loadFromEEPROM function.
-   * To ensure that the data isn't corrupted due to voltage spikes in the writing process, the data will be loaded first and
-   * then read and compared. So it will be a relatively high time consuming process, but it only needs to be done once.
+   * This function stores the calibration data in the EEPROM with the current offset correction, full-scale ranges and temperature table.
+   * The record is written (EEPROM.put(), which only writes the bytes that have changed) after the newest valid one, with the next
+   * sequence number, so the records are written in turns and the previous one is kept until the new one is complete. Then it is read
+   * back and checked. mpu_state_global isn't changed, so the caller decides if a failed write is an error (MPU_EEPROM_ERROR during the
+   * initialization).
    *
    * * Parameters of the function:
-   *      @param *temperature_mpu  -->  pointer to a float value to load the temperature form the EEPROM.
-   *      @param *offsets_funct    -->  pointer to the offsets array where the values from the EEPROM will be loaded.
+   *      @param *temperature_mpu  -->  pointer to a float value with the calibration temperature.
+   *      @param *offsets_funct    -->  pointer to the offsets array that will be stored.
+   *      @return bool             -->  true if the record has been stored and verified.
    */
 
-  byte buffer_array[4];
-  int address = MPU_EEPROM_OFFSET_ADDRESS;
+  MpuCalibrationRecord record_funct;
+  int8_t index_funct;
+  int address;
 
-  // --- Save the signature ---
-  // At this point the least significant bits will be set to '0' and written to the expected value at the end of the process.
-  // This is done to know if the data has been stored correctly even if the device turns off during the writing process. It 
-  // must be also considered that the live of the EEPROM will be affected by this, since more writing cycles will be made, but
-  // The calibration data should just be written one time in the live of the robot.
+  // --- Next record ---
+  index_funct = findEepromRecord(&record_funct);
+  if (index_funct < 0) {
+    index_funct = 0;
+    record_funct.sequence = 0;
+  }
+  else {
+    index_funct = (index_funct + 1) % MPU_EEPROM_RECORDS;
+    record_funct.sequence++;
+  }
+  address = eeprom_address + index_funct * sizeof(MpuCalibrationRecord);
 
   // Debug
   #ifdef DEBUG_MODE_MPU
     Serial.println(F("Saving on the EEPROM..."));
-    Serial.println("temperature: " + String(*temperature_mpu));
+    Serial.println("temperature: " + String(*temperature_mpu) + ", record: " + String(index_funct));
   #endif
 
-  while (true) {
-    EEPROM.update(address, 0xD0);
-    // - Check -
-    if (EEPROM.read(address) == 0xD0) break;
+  // --- Fill the record ---
+  uint8_t sequence_funct = record_funct.sequence;
+  memset(&record_funct, 0, sizeof(MpuCalibrationRecord));  // The reserved bytes are also covered by the CRC
+  record_funct.temperature = *temperature_mpu;
+  for (uint8_t i = 0; i < 6; i++) {
+    record_funct.offsets[i] = *(offsets_funct + i);
+    record_funct.offset_correction[i] = offset_correction[i];
   }
-
-  // Debug
-  #ifdef DEBUG_MODE_MPU
-    Serial.println(EEPROM.read(address));
+  record_funct.version = MPU_EEPROM_RECORD_VERSION;
+  record_funct.sequence = sequence_funct;
+  record_funct.accel_reg = working_accel_reg;
+  record_funct.gyro_reg = working_gyro_reg;
+  #ifdef MPU_TEMP_COMPENSATION
+    for (uint8_t i = 0; i < MPU_TEMP_TABLE_POINTS; i++) record_funct.temp_table[i] = temp_table[i];
+    record_funct.temp_table_valid = temp_table_valid;
   #endif
+  record_funct.crc = MpuTelemetry::crc16((const uint8_t *)&record_funct, offsetof(MpuCalibrationRecord, crc));
 
-  // --- Save the rest of the data ---
-  address++;
-
-  for (uint8_t i = 0; i < 7; i++) {
-    
-    // -- Split data into bytes --
-    uint8_t data_length;
-    if (i < 6) {  // Offsets
-      *(int16_t *) buffer_array = *(offsets_funct + i);
-      data_length = 2;
-      //buffer_1 = (byte)(*(offsets_funct + i) >> 8);
-    } else {       // Temperature
-      *(float *) buffer_array = *temperature_mpu;
-      //buffer_0 = *(temperature);
-      //buffer_1 = (byte)(*(temperature) >> 8);
-      data_length = 4;
-    }
-
-    // -- write data --
-    for (uint8_t j = 0; j < data_length; j++) {
-      while (true) {
-        // Set data
-        EEPROM.update(address, buffer_array[j]);
-        // - Check -
-        if (EEPROM.read(address) == buffer_array[j]) break;
-      }
-      address++;
-    }
+  // --- Write and check ---
+  EEPROM.put(address, record_funct);
 
+  MpuCalibrationRecord check_funct;
+  EEPROM.get(address, check_funct);
+  if (memcmp(&check_funct, &record_funct, sizeof(MpuCalibrationRecord)) != 0) {
     // Debug
     #ifdef DEBUG_MODE_MPU
-      Serial.print(F("."));
-    #endif 
+      Serial.println(F("EEPROM error (*.*) the record couldn't be verified"));
+    #endif
+    return false;
   }
 
-  // --- Sign out ---
-  // --- Save the signature ---
-  while (true) {
-    EEPROM.update(MPU_EEPROM_OFFSET_ADDRESS, 0xDD);
-    // - Check -
-    if (EEPROM.read(MPU_EEPROM_OFFSET_ADDRESS) == 0xDD) break;
-  }
+  return true;
+}
 
-  // Debug
-  #ifdef DEBUG_MODE_MPU
-    Serial.println(EEPROM.read(MPU_EEPROM_OFFSET_ADDRESS));
-  #endif 
+bool MpuDev::flushEEPROM() {
+  /*
+   * This function stores the calibration record if it has changed during the operation (the points of the temperature table learned by
+   * learnTemperaturePoint()). A record takes a few hundred ms to be written on AVR (3.3 ms per byte), so it isn't done in the sample
+   * path: the application has to call this function when it is idle. The records are stored at least MPU_EEPROM_SAVE_INTERVAL apart
+   * (since the start or the last one) to limit the wear, the changes in between are kept in RAM and stored in the next record.
+   * A failed write doesn't change mpu_state_global (the MPU keeps working with the table in RAM) and it is retried after the interval.
+   *
+   *      @return bool             -->  true if a record has been stored and verified.
+   */
+
+  int16_t offsets_funct[6];                             // Offsets of the calibration
+
+  // --- Check ---
+  if (!eeprom_save_pending || (mpu_state_global != MPU_CORRECT)) return false;
+  if ((millis() - eeprom_save_time) < MPU_EEPROM_SAVE_INTERVAL) return false;
+  eeprom_save_time = millis();
+
+  // --- Store ---
+  if (!getOffsets(offsets_funct)) return false;
+  if (!saveOnEEPROM(&calibration_temperature, offsets_funct)) return false;
+  eeprom_save_pending = false;
+
+  return true;
 }
 
 
@@ -1249,7 +2649,7 @@ float MpuDev::getTemperature() {
   return foo_temp;
 }
 
-/*  Saved just in case
+#if 0  // Saved just in case
 
 int16_t MpuDev::getTemperature() {
   /*
@@ -1258,11 +2658,11 @@ int16_t MpuDev::getTemperature() {
    * To reduce the truncation errors it will give the temperature in degrees Celsius * 1000
    * 
    *      @return int16_t       --> (int16_t) Temperature
-   */ /*
+   */
   int16_t foo_temp = (((_mpuDevice.getTemperature())/340) * 1000) + 3653;
   return foo_temp;
 }
-*/
+#endif
 
 void MpuDev::getParameter6(int16_t *values_funct) {
   /* This function gets the raw accelerometer and gyroscope measurements.
@@ -1297,11 +2697,13 @@ void MpuDev::getParameter6(int16_t *values_funct) {
 
 }
 
-void MpuDev::getRefinedValues(double *measurements_funct) {
+void MpuDev::getRefinedValues(mpu_real_t *measurements_funct) {
   /* This function gets the refined accelerometer and gyroscope measurements.
+   * With MPU_TEMP_COMPENSATION the gyroscope offset correction follows the temperature of the reading.
+   * With MPU_BIAS_TRACKING the sample also updates the stillness detector (trackGyroBias()).
    * 
    * Parameters:
-   *      @param *measurements_funct      --> (double) pointer to an array for the measurements with the following order:
+   *      @param *measurements_funct      --> (mpu_real_t) pointer to an array for the measurements with the following order:
    *                                                   A_X, A_Y, A_Z, G_X, G_Y, G_Z.
    */
 
@@ -1310,19 +2712,24 @@ void MpuDev::getRefinedValues(double *measurements_funct) {
   // --- Get the raw values ---
   getParameter6(raw_values);
 
-  // --- Refine values ---
-  for(uint8_t i = 0; i < 6; i++){
+  // --- Temperature compensation ---
+  // Only interpolated when the temperature has changed (MPU_TEMP_COMP_HYSTERESIS)
+  #ifdef MPU_TEMP_COMPENSATION
+    updateTemperatureCompensation(temperature_raw);
+  #endif
 
-    // -- Offset correction --
-    *(measurements_funct + i) = ((double) *(raw_values + i) - *(offset_correction + i));
+  // --- Health monitor ---
+  #ifdef MPU_HEALTH_MONITOR
+    monitorSample(raw_values);
+  #endif
 
-    // -- Obtain magnitudes --
-    if ( i < 3){  // Accelerations 
-      *(measurements_funct + i) /=  accel_1g_value;
-    }else{  // Gyroscopes
-      *(measurements_funct + i) *= (M_PI / (180 * gyro_1dps_value));
-    }
-  }
+  // --- Bias tracking ---
+  #ifdef MPU_BIAS_TRACKING
+    trackGyroBias(raw_values);
+  #endif
+
+  // --- Refine values ---
+  refineValues(raw_values, measurements_funct);
   /*
   // Debug
   #ifdef DEBUG_MODE_MPU
@@ -1337,265 +2744,2286 @@ void MpuDev::getRefinedValues(double *measurements_funct) {
   */
 }
 
+void MpuDev::refineValues(int16_t *raw_values, mpu_real_t *measurements_funct) {
+  /* This function refines the given raw accelerometer and gyroscope measurements (offset correction and conversion to g and rad/s).
+   * It is used with the values from getParameter6(), the FIFO or an asynchronous reading.
+   * 
+   * Parameters:
+   *      @param *raw_values              --> (int16_t) pointer to the raw measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @param *measurements_funct      --> (mpu_real_t) pointer to an array for the measurements with the same order.
+   */
 
-//            **************************
-//            *     KALMAN FILTER      *
-//            **************************
+  MPU_PROFILE_START(profile_start);
 
-void MpuDev::integrate(double d_time, double *angular_speed_1, double *angular_speed_2, double *integration_result) {
-  /*
-   * This function performs the trapezoidal numeric integration of the angular speed.
-   *
+  // --- Refine values ---
+  for(uint8_t i = 0; i < 6; i++){
+
+    // -- Offset correction --
+    *(measurements_funct + i) = ((mpu_real_t) *(raw_values + i) - *(offset_correction + i));
+
+    // -- Obtain magnitudes --
+    if ( i < 3){  // Accelerations 
+      *(measurements_funct + i) *= working_accel_scale;
+    }else{  // Gyroscopes
+      *(measurements_funct + i) *= working_gyro_scale;
+    }
+  }
+
+  MPU_PROFILE_END(MPU_STAGE_REFINE, profile_start);
+}
+
+void MpuDev::refineBatch(int16_t *raw_axes, float *refined_axes, uint16_t count) {
+  /* This function refines a block of raw samples (e.g. drained from the FIFO or replayed from a log) with the same offset correction
+   * and scales as refineValues(). The samples are a structure of arrays: the count values of A_X, then the count values of A_Y... so
+   * raw_axes[axis * count + n] is the axis of the sample n (deinterleaveFrames() converts the frames of readFifoFrames()).
+   * Each axis is a loop without branches or calls (value * scale - offset * scale) in float, so the compiler can unroll it and use the
+   * FPU/SIMD instructions of the ARM Cortex-M4 and the ESP32 (double is emulated on them), and on AVR the per element branch is avoided.
+   * The offset correction isn't updated by the block (temperature compensation and bias tracking are done per sample).
+   * 
    * Parameters:
-   *      @param d_time               --> (double) increment of time between the current and the previous measurement.
-   *      @param *angular_speed_1     --> (double) Pointer to the current rotated angular speed array {omega_x, omega_y}
-   *      @param *angular_speed_2     --> (double) Pointer to the previous rotated angular speed array {omega_x, omega_y}
-   *      @param *integration_result  --> (double) Pointer to the array with the integration result
+   *      @param *raw_axes                --> (int16_t) pointer to the raw samples: 6 arrays of count values (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+   *      @param *refined_axes            --> (float) pointer to the refined samples (g and rad/s) with the same layout
+   *      @param count                    --> (uint16_t) number of samples of the block
    */
 
-  // --- Definition ---
-  double temp_funct;
+  // --- Refine values ---
+  for (uint8_t axis = 0; axis < 6; axis++) {
+    int16_t *__restrict__ input_funct = raw_axes + (uint32_t)axis * count;
+    float *__restrict__ output_funct = refined_axes + (uint32_t)axis * count;
+    const float scale_funct = (axis < 3) ? working_accel_scale : working_gyro_scale;
+    const float offset_funct = offset_correction[axis] * scale_funct;  // Offset correction in g or rad/s
 
-  // --- Integrate ---
-  temp_funct = (d_time)/2.0;
-  integration_result[0] = temp_funct * (angular_speed_1[0] + angular_speed_2[0]);
-  integration_result[1] = temp_funct * (angular_speed_1[1] + angular_speed_2[1]);
+    for (uint16_t n = 0; n < count; n++) output_funct[n] = input_funct[n] * scale_funct - offset_funct;
+  }
+}
 
-  // --- Done ---
-  return integration_result;
+void MpuDev::deinterleaveFrames(int16_t *frames_funct, int16_t *raw_axes, uint16_t count) {
+  /* This function converts the frames of readFifoFrames() (or getParameter6() arrays) to the structure of arrays of refineBatch().
+   * 
+   * Parameters:
+   *      @param *frames_funct            --> (int16_t) pointer to the frames: count x (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+   *      @param *raw_axes                --> (int16_t) pointer to the samples: 6 arrays of count values
+   *      @param count                    --> (uint16_t) number of frames
+   */
+
+  for (uint16_t n = 0; n < count; n++) {
+    for (uint8_t axis = 0; axis < 6; axis++) raw_axes[(uint32_t)axis * count + n] = frames_funct[(uint32_t)n * 6 + axis];
+  }
 }
 
-void MpuDev::rotate(double *measurements_ref, double *rotated_values) {
-  /*
-   * This function rotates the current angular speed measurement from the IMU reference to the global one.
-   * The rotation is done according to the current state estimation
+//            ****************************
+//            * TEMPERATURE COMPENSATION *
+//            ****************************
+
+#ifdef MPU_TEMP_COMPENSATION
+
+int8_t MpuDev::getTemperatureBand(int16_t temperature_funct) {
+  /* This function gets the band of the temperature table of a raw temperature. Each band is MPU_TEMP_TABLE_STEP degC wide starting
+   * at MPU_TEMP_TABLE_MIN, the temperatures out of the table are in the first or last band.
    *
    * Parameters:
-   *      @param measurements_ref    --> (double) Pointer to the refined measurements array
-   *      @param *rotated_values     --> (double) Pointer to the rotated angular speed array
+   *      @param temperature_funct  --> (int16_t) Raw temperature
+   *      @return band              --> (int8_t) Band (0 to MPU_TEMP_TABLE_POINTS - 1)
    */
 
-  // --- Rotation ---
-  // -- Rotate w_x --
-  rotated_values[0] = measurements_ref[3]*cos(state[0]) + measurements_ref[5]*sin(state[1]);
-  // -- Rotate w_y --
-  rotated_values[1] = measurements_ref[3] * (sin(state[0]) * sin(state[1])) + 
-                      measurements_ref[4] * (cos(state[0])) -
-                      measurements_ref[5] * (sin(state[0]) * cos(state[1]));
+  float degrees_funct = (float)temperature_funct / MPU_TEMP_LSB_PER_DEGREE + MPU_TEMP_OFFSET_DEGREES;
+  int16_t band_funct = (int16_t)floor((degrees_funct - MPU_TEMP_TABLE_MIN) / MPU_TEMP_TABLE_STEP);
 
-  // --- Done ---
+  if (band_funct < 0) return 0;
+  if (band_funct >= MPU_TEMP_TABLE_POINTS) return MPU_TEMP_TABLE_POINTS - 1;
+  return band_funct;
 }
 
-double MpuDev::square(double x) {
-  /*
-   * This function just calculates the square of a number: X^2 = X*X
+bool MpuDev::updateTemperatureCompensation(int16_t temperature_funct, bool force) {
+  /* This function sets the gyroscope offset correction (offset_correction) at the given temperature. It is interpolated linearly
+   * between the closest points of the table below and above the temperature. Out of the table the closest point is used (it isn't
+   * extrapolated). If the table is empty the correction isn't changed.
+   * To keep it cheap it is only done when the temperature has changed more than MPU_TEMP_COMP_HYSTERESIS since the last time.
    *
    * Parameters:
-   *      @param x                  --> Number to square
-   *      @return x**2              --> Squared number
+   *      @param temperature_funct  --> (int16_t) Raw temperature (temperature_raw)
+   *      @param force              --> (bool) Interpolate even if the temperature hasn't changed
+   *      @return covered           --> (bool) true if there are points on both sides of the temperature or in its band
    */
 
-  return x * x;
+  int8_t lower_funct = -1;                                // Closest point below or at the temperature
+  int8_t upper_funct = -1;                                // Closest point above the temperature
+
+  // --- Check the change ---
+  if (!force && (abs((int32_t)temperature_funct - temp_comp_temperature) < MPU_TEMP_COMP_HYSTERESIS)) return temp_comp_valid;
+  temp_comp_temperature = temperature_funct;
+
+  // --- Find the points ---
+  for (int8_t i = 0; i < MPU_TEMP_TABLE_POINTS; i++) {
+    if (!(temp_table_valid & (1 << i))) continue;
+    if (temp_table[i].temperature <= temperature_funct) {
+      if ((lower_funct < 0) || (temp_table[i].temperature > temp_table[lower_funct].temperature)) lower_funct = i;
+    }
+    else {
+      if ((upper_funct < 0) || (temp_table[i].temperature < temp_table[upper_funct].temperature)) upper_funct = i;
+    }
+  }
+
+  if ((lower_funct < 0) && (upper_funct < 0)) {
+    temp_comp_valid = false;
+    return false;
+  }
+
+  // --- Interpolate ---
+  if ((lower_funct >= 0) && (upper_funct >= 0)) {
+    int32_t span_funct = (int32_t)temp_table[upper_funct].temperature - temp_table[lower_funct].temperature;
+    int32_t position_funct = (int32_t)temperature_funct - temp_table[lower_funct].temperature;
+    for (uint8_t i = 0; i < 3; i++) {
+      int32_t low_funct = temp_table[lower_funct].gyro_correction[i];
+      int32_t high_funct = temp_table[upper_funct].gyro_correction[i];
+      offset_correction[3 + i] = low_funct + ((high_funct - low_funct) * position_funct) / span_funct;
+    }
+    temp_comp_valid = true;
+  }
+  else {
+    // -- Closest point --
+    int8_t point_funct = (lower_funct >= 0) ? lower_funct : upper_funct;
+    for (uint8_t i = 0; i < 3; i++) offset_correction[3 + i] = temp_table[point_funct].gyro_correction[i];
+    temp_comp_valid = (getTemperatureBand(temperature_funct) == point_funct);
+  }
 
+  return temp_comp_valid;
 }
 
-void MpuDev::accelState(double *measurements_ref, double *state_pred, double *accel_cov_funct) {
-  /*
-   * This function calculates the state based on the measurements from the accelerometer.
-   * The prediction is done as follows:
-   *      1) Normalize the measurements (we expect to measure 1g in total)
-   *      [1-1] Low Pass filter the accelerometer measurements (it will be done on the MPU)
-   *      2) Calculate the angles based on the position of the gravity vector
-   *      [3)] Calculate the covariance based on 1) (deleted)
-   * 
+bool MpuDev::learnTemperaturePoint(int16_t *values_raw) {
+  /* This function learns a point of the temperature table while the MPU is still. It has to be called with the raw measurements
+   * (e.g. getParameter6()) when the MPU is known to be still, the samples are averaged with the temperature of the readings
+   * (temperature_raw) and after MPU_TEMP_LEARN_SAMPLES the point of the band is updated (addTemperaturePoint()).
+   * If the gyroscopes deviate more than MPU_TEMP_LEARN_MAX_RATE from the current correction the MPU is moving, so the point is restarted.
+   *
    * Parameters:
-   *      @param *measurements_ref   --> (double) Pointer to the refined measurements array
-   *      @param *state_pred         --> (double) Pointer to the accelerometer state prediction array (it will be overwritten)
-   *      @param *accel_cov_funct    --> (double) Pointer to the accelerometer state prediction covariance value (it will be overwritten)
+   *      @param *values_raw        --> (int16_t) Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
+   *      @return done              --> (bool) true when a point has been learned
    */
 
-  // --- Definitions ---
-  double normalized_values[3];  // temp array for the normalized accel measurements
-  
-  // --- Normalization ---
-  normalized_values[2] = sqrt(square(measurements_ref[0]) + square(measurements_ref[1]) + square(measurements_ref[2]));  // temp calculation :)
-  // -- check for error --
-  if (normalized_values[2] == 0) {
-    for (uint8_t i = 0; i < 3; i++){  // If there is an error just return 0 and high covariance
-      normalized_values[i] = 0;
+  int16_t targets_funct[3] = {X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};  // Expected gyroscope values
+  int16_t correction_funct[3];                            // Learned correction
+
+  // --- Check the movement ---
+  for (uint8_t i = 0; i < 3; i++) {
+    if (abs((int32_t)values_raw[3 + i] - targets_funct[i] - offset_correction[3 + i]) > MPU_TEMP_LEARN_MAX_RATE) {
+      temp_learn_count = 0;
+      return false;
     }
-    *accel_cov_funct = 1000;
-    return;
   }
 
-  // -- Covariance calculation --
-  if (normalized_values[2] < 1.0) 
-    *accel_cov_funct = 1 - normalized_values[2];
-  else 
-    *accel_cov_funct = normalized_values[2] - 1;
+  // --- Accumulate ---
+  if (temp_learn_count == 0) {
+    for (uint8_t i = 0; i < 3; i++) temp_learn_sums[i] = 0;
+    temp_learn_temperature = 0;
+  }
+  for (uint8_t i = 0; i < 3; i++) temp_learn_sums[i] += values_raw[3 + i] - targets_funct[i];
+  temp_learn_temperature += temperature_raw;
+  temp_learn_count++;
 
-  *accel_cov_funct = normalized_values[2] + (1 + (10 * *accel_cov_funct * *accel_cov_funct));
+  if (temp_learn_count < MPU_TEMP_LEARN_SAMPLES) return false;
 
+  // --- Add the point ---
+  for (uint8_t i = 0; i < 3; i++) correction_funct[i] = lround((float)temp_learn_sums[i] / temp_learn_count);
+  addTemperaturePoint(lround((float)temp_learn_temperature / temp_learn_count), correction_funct);
+  temp_learn_count = 0;
 
-  /*
-  // -- continue --
-  // covariance calculation
-  if (normalized_values[2] < 1.0) {
-    *accel_cov_funct = accel_covariance / normalized_values[2];
-  } else {
-    *accel_cov_funct = accel_covariance * normalized_values[2];
-  }
-  */
+  return true;
+}
 
-  // -- Normalize values --
+void MpuDev::addTemperaturePoint(int16_t temperature_funct, int16_t *gyro_correction) {
+  /* This function sets the point of the band of the temperature and updates the correction. If the point is new or it has changed
+   * more than MPU_TEMP_SAVE_THRESHOLD, the table is marked to be stored in the EEPROM. It is called from the sample path, so the record
+   * is only written by finishOffsetCorrection() during the initialization or by flushEEPROM() during the operation.
+   *
+   * Parameters:
+   *      @param temperature_funct  --> (int16_t) Raw temperature of the point
+   *      @param *gyro_correction   --> (int16_t) Gyroscope offset correction (G_X, G_Y, G_Z) in LSB
+   */
+
+  int8_t band_funct = getTemperatureBand(temperature_funct);
+  bool changed_funct = !(temp_table_valid & (1 << band_funct));  // The point has to be stored
+
+  // --- Set the point ---
   for (uint8_t i = 0; i < 3; i++) {
-    normalized_values[i] = measurements_ref[i] / normalized_values[2];
+    if (abs((int32_t)gyro_correction[i] - temp_table[band_funct].gyro_correction[i]) > MPU_TEMP_SAVE_THRESHOLD) changed_funct = true;
+    temp_table[band_funct].gyro_correction[i] = gyro_correction[i];
   }
+  temp_table[band_funct].temperature = temperature_funct;
+  temp_table_valid |= 1 << band_funct;
 
-  // --- State calculation ---
-  state_pred[0] = atan2(normalized_values[1], sqrt(square(normalized_values[0]) + square(normalized_values[2])));
-  state_pred[1] = -atan2(normalized_values[0], sqrt(square(normalized_values[1]) + square(normalized_values[2])));
+  updateTemperatureCompensation(temperature_funct, true);
+
+  // Debug
+  #ifdef DEBUG_MODE_MPU
+    Serial.print(F("Temperature point "));
+    Serial.print(band_funct);
+    Serial.print(F(": "));
+    Serial.println((float)temperature_funct / MPU_TEMP_LSB_PER_DEGREE + MPU_TEMP_OFFSET_DEGREES);
+  #endif
+
+  // --- Store ---
+  if (changed_funct) eeprom_save_pending = true;   // Stored by finishOffsetCorrection() or flushEEPROM()
 }
+#endif
 
-double* MpuDev::simplifiedKF(unsigned long current_time) {
-  /*
-   * This function estimates the X and Y angles (State of the system) applying a simplified version of the Kalman filter
-   * To the measurements of the gyro and accel and the previous measurements. The simplification is done first assuming that the z angle is static,
-   * when calculating the covariance it is assumed that the state covariance doesn't contribute significantly to the covariance when a rotation is
-   * applied and that the main acceleration will be produced by gravity. All these approximations are only to reduce the amount of computation needed.
+//            **************************
+//            *     BIAS TRACKING      *
+//            **************************
+
+#ifdef MPU_BIAS_TRACKING
+
+void MpuDev::trackGyroBias(int16_t *raw_values) {
+  /* This function updates the stillness detector with a raw sample and, while the MPU is still, the gyroscope offset correction.
+   * It is called by getRefinedValues() and updateEstimators() with the samples that are already being read.
+   * The detector has the exponential mean and variance (window of MPU_STILL_WINDOW samples) of each gyroscope after the offset
+   * correction and of the norm of the accelerations. The MPU is still when:
+   *      -) The standard deviation of the gyroscopes is lower than MPU_STILL_GYRO_STD.
+   *      -) The mean of the gyroscopes is lower than MPU_STILL_GYRO_RATE (a slow rotation has a low variance).
+   *      -) The standard deviation of the norm of the accelerations is lower than MPU_STILL_ACCEL_STD.
+   * While it is still, the bias is updated with an exponential window of MPU_BIAS_TRACKING_WINDOW samples (the correction moves slowly,
+   * so the angles don't jump) and, with MPU_TEMP_COMPENSATION, the sample is added to the point of the table being learned. When the
+   * temperature compensation changes the correction, the tracking is re-seeded with the new value (it refines the interpolated one).
+   * The detector is restarted when the full-scale ranges change (setFullScale()).
    *
-   * The Kalman filter goes as follows:
-   *      1) Use the gyro measurements and the previous state estimation to predict the current state and calculate the variance of this prediction.
-   *      2) Use the accelerometer to calculate the state by the position of the gravity vector and the covariance of this calculation.
-   *      3) Calculate the Kalman gain.
-   *      4) Update the prediction in 1 with the new information and update the covariance matrix of the state
-   * 
    * Parameters:
-   *      @param *current_time      --> (unsigned long) millis() time when the measurements were taken (it should be obtained with the interrupt)
-   *      @return *state_kalman     --> (double) Pointer to the state array (state = X_angle, Y_angle)
+   *      @param *raw_values        --> (int16_t) Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
    */
 
-  // --- Initialization ---
-  // -- Definitions --
-  double measurements_funct[6];     // Array for the refined measurements
-  double angular_speed_1[2];        // Array for the current rotated speed
-  double delta_time;                // Time interval since the filter was called
-  double state_accel[2];            // State calculation from the accelerometer values
-  double integration_result[2];     // This is just to hold the integration results
-  double temp_funct[2];             // Just to hold temporal calculations
-  // -- Get Measurements --
-  getRefinedValues(measurements_funct);
+  int16_t targets_funct[3] = {X_GYRO_TARGET, Y_GYRO_TARGET, Z_GYRO_TARGET};  // Expected gyroscope values
+  const float alpha_funct = 1.0 / MPU_STILL_WINDOW;       // Weight of the new sample
+  float sample_funct;                                     // Value of the sample
+  float diff_funct;                                       // Difference with the mean
+  bool still_funct;                                       // Result of the detector
+
+  // --- Norm of the accelerations ---
+  float accel_norm_funct = sqrt(square((float)raw_values[0]) + square((float)raw_values[1]) + square((float)raw_values[2])) * working_accel_scale;
+
+  // --- Restart ---
+  // The means start with the current sample and the MPU isn't considered still until the window is full
+  if (still_samples == 0) {
+    for (uint8_t i = 0; i < 3; i++) {
+      still_gyro_mean[i] = raw_values[3 + i] - offset_correction[3 + i];
+      still_gyro_var[i] = 0;
+    }
+    still_accel_mean = accel_norm_funct;
+    still_accel_var = 0;
+    still_gyro_var_limit = square(MPU_STILL_GYRO_STD / working_gyro_scale);
+    still_gyro_rate_limit = MPU_STILL_GYRO_RATE / working_gyro_scale;
+    mpu_still = false;
+  }
 
-  if (mpu_state_global != MPU_CORRECT) return state;
+  // --- Update the statistics ---
+  // Exponential mean and variance: var = (1 - alpha) * (var + alpha * diff^2)
+  still_funct = true;
+  for (uint8_t i = 0; i < 3; i++) {
+    sample_funct = raw_values[3 + i] - offset_correction[3 + i];
+    diff_funct = sample_funct - still_gyro_mean[i];
+    still_gyro_mean[i] += alpha_funct * diff_funct;
+    still_gyro_var[i] = (1 - alpha_funct) * (still_gyro_var[i] + alpha_funct * square(diff_funct));
+    if ((still_gyro_var[i] > still_gyro_var_limit) || (fabs(still_gyro_mean[i]) > still_gyro_rate_limit)) still_funct = false;
+  }
+  diff_funct = accel_norm_funct - still_accel_mean;
+  still_accel_mean += alpha_funct * diff_funct;
+  still_accel_var = (1 - alpha_funct) * (still_accel_var + alpha_funct * square(diff_funct));
+  if (still_accel_var > square(MPU_STILL_ACCEL_STD)) still_funct = false;
+
+  // -- Window --
+  if (still_samples < MPU_STILL_WINDOW) {
+    still_samples++;
+    return;
+  }
 
-  // --- Prediction ---
-  // -- Rotate the angular speeds --
-  rotate(measurements_funct, angular_speed_1);
-  // -- Integrate --
-  delta_time = ((double)(current_time - prev_time)/1000.0);
-  integrate(delta_time, angular_speed_1, rotated_ang_speed_prev, temp_funct);
-  state[0] += temp_funct[0];
-  state[1] += temp_funct[1];
-  // -- Covariance --
-  state_covariance[0] += square(delta_time) * gyro_covariance;
-  state_covariance[1] = state_covariance[0];
+  // --- Update the bias ---
+  if (!still_funct) {
+    mpu_still = false;
+    return;
+  }
+  if (!mpu_still) {
+    // The correction may have been changed (calibration, setFullScale()...)
+    for (uint8_t i = 0; i < 3; i++) bias_estimate[i] = offset_correction[3 + i];
+    mpu_still = true;
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    // -- Re-seed --
+    // updateTemperatureCompensation() owns the correction when the temperature changes, so the tracking starts again from its value
+    // instead of writing back the old estimate (the tracked bias is kept in the table by learnTemperaturePoint())
+    if (offset_correction[3 + i] != lround(bias_estimate[i])) bias_estimate[i] = offset_correction[3 + i];
+    bias_estimate[i] += (raw_values[3 + i] - targets_funct[i] - bias_estimate[i]) * (float)(1.0 / MPU_BIAS_TRACKING_WINDOW);
+    offset_correction[3 + i] = lround(bias_estimate[i]);
+  }
+  bias_updates++;
 
-  // --- Innovation ---
-  // -- State calculation with the accelerometer --
-  accelState(measurements_funct, state_accel, temp_funct);
-  // -- obtain innovation --
-  state_accel[0] -= state[0];
-  state_accel[1] -= state[1];
+  // -- Temperature table --
+  #ifdef MPU_TEMP_COMPENSATION
+    learnTemperaturePoint(raw_values);
+  #endif
+}
+#endif
 
-  // --- Update ---
-  // -- x-axis --
-  temp_funct[0] = state_covariance[0]/(state_covariance[0] + temp_funct[0]);  // Kalman gain
-  state[0] += (temp_funct[0] * state_accel[0]);
-  state_covariance[0] = (1 - temp_funct[0]) * state_covariance[0];
-  // -- y-axis --
-  temp_funct[0] = state_covariance[0]/(state_covariance[0] + accel_covariance);  // Kalman gain
-  state[1] += (temp_funct[0] * state_accel[1]);
-  state_covariance[1] = (1 - temp_funct[0]) * state_covariance[1];
+//            **************************
+//            *       PRE-FILTER       *
+//            **************************
 
-  // --- Done ---
-  rotated_ang_speed_prev[0] = angular_speed_1[0];
-  rotated_ang_speed_prev[1] = angular_speed_1[1];
-  prev_time = current_time;
-  return state;
-}
+#ifdef MPU_PREFILTER
 
-double* MpuDev::testGyroEst(unsigned long current_time) {
-  /*
-   * This function is just to test the gyro estimation.
+bool MpuDev::setPrefilter(uint8_t decimation_funct) {
+  /* This function sets the decimation factor of the pre-filter and restarts it (the state is cleared). It is also restarted by
+   * setFullScale(), since the state is in LSB.
+   * With the CIC decimator the first zero of the response is at the output rate, so the decimation sets the bandwidth. With the biquad
+   * the cutoff is set by the coefficients (setPrefilterBiquad()), it should be lower than the output rate / 2.
+   *
+   * Parameters:
+   *      @param decimation_funct   --> (uint8_t) Input samples per output sample (1 to MPU_PREFILTER_MAX_DECIMATION)
+   *      @return bool              --> (bool) false if the decimation is out of range
    */
 
-  // --- Initialization ---
-  // -- Definitions --
-  double measurements_funct[6];     // Array for the refined measurements
-  double angular_speed_1[2];        // Array for the current rotated speed
-  double delta_time;                // Time interval since the filter was called
-  double integration_result[2];     // This is just to hold the integration results
-
-  // -- Get Measurements --
-  getRefinedValues(measurements_funct);
+  if ((decimation_funct < 1) || (decimation_funct > MPU_PREFILTER_MAX_DECIMATION)) return false;
 
-  if (mpu_state_global != MPU_CORRECT) return state;
+  prefilter_decimation = decimation_funct;
+  prefilter_count = 0;
 
-  // --- Prediction ---
-  // -- Rotate the angular speeds --
-  angular_speed_1[0] = measurements_funct[3]*cos(state_gyro[0]) + measurements_funct[5]*sin(state_gyro[1]);
-  // -- Rotate w_y --
-  angular_speed_1[1] = measurements_funct[3] * (sin(state_gyro[0]) * sin(state_gyro[1])) + 
-                       measurements_funct[4] * (cos(state_gyro[0])) -
-                       measurements_funct[5] * (sin(state_gyro[0]) * cos(state_gyro[1]));
-  // -- Integrate --
-  delta_time = ((double)(current_time - prev_time)/1000.0);
-  integrate(delta_time, angular_speed_1, rotated_ang_speed_prev_2, integration_result);
-  state_gyro[0] += integration_result[0];
-  state_gyro[1] += integration_result[1];
-  // -- Covariance --
-  state_gyro_cov[0] += square(delta_time) * gyro_covariance;
-  state_gyro_cov[1] = state_gyro_cov[0];
+  // --- Clear the state ---
+  #if MPU_PREFILTER_TYPE == MPU_PREFILTER_CIC
+    memset(prefilter_integrators, 0, sizeof(prefilter_integrators));
+    memset(prefilter_combs, 0, sizeof(prefilter_combs));
+  #endif
+  prefilter_warm_up = MPU_PREFILTER_WARM_UP;
 
-  // --- Done ---
-  rotated_ang_speed_prev_2[0] = angular_speed_1[0];
-  rotated_ang_speed_prev_2[1] = angular_speed_1[1];
-  return state_gyro;
+  return true;
 }
 
-double* MpuDev::testAccelEst(unsigned long current_time) {
-  /*
-   * This is just to test the accelerometer estimation.
+#if MPU_PREFILTER_TYPE == MPU_PREFILTER_BIQUAD
+void MpuDev::setPrefilterBiquad(int16_t *coefficients_funct) {
+  /* This function sets the coefficients of the biquad of the pre-filter (y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2, with a0 = 1) and
+   * restarts it. The coefficients are in Q14 (16384 = 1), so |a1| has to be lower than 2 (any stable low pass filter). The DC gain
+   * should be 1 (b0 + b1 + b2 = 16384 + a1 + a2) or the offset correction won't match.
+   *
+   * Parameters:
+   *      @param *coefficients_funct  --> (int16_t) b0, b1, b2, a1, a2 in Q14
    */
-  double temp_funct;            // covariance temp value
-  // -- Get Measurements --
 
-   // -- Definitions --
-  double measurements_funct[6];     // Array for the refined measurements
-  getRefinedValues(measurements_funct);
+  for (uint8_t i = 0; i < 5; i++) prefilter_coefficients[i] = coefficients_funct[i];
+  setPrefilter(prefilter_decimation);
+}
+#endif
+
+bool MpuDev::prefilterSample(int16_t *raw_values) {
+  /* This function adds a raw sample to the pre-filter. Every prefilter_decimation samples the filtered sample is written in raw_values
+   * and it returns true, so the rest of the path (updateEstimators()) runs at the decimated rate with the time stamp of that sample.
+   *      -) CIC: MPU_PREFILTER_CIC_ORDER integrators at the input rate and combs at the output rate, with a gain of
+   *         decimation^order that is removed with one division per output (the integrators wrap around, but the result is exact).
+   *      -) Biquad: direct form I with Q14 coefficients and int32_t sums at the input rate, and one of each decimation outputs is used.
+   *         The outputs are kept in Q14, so there is no dead band around the DC value (with integer LSB outputs the rounding of the
+   *         feedback holds the output up to 0.5 * 16384 / (16384 + a1 + a2) LSB away from the input), only raw_values is rounded.
+   * The outputs of the transient after a restart are discarded.
+   *
+   * Parameters:
+   *      @param *raw_values        --> (int16_t) Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z (replaced by the filtered ones)
+   *      @return ready             --> (bool) true if raw_values has a decimated sample
+   */
 
-  if (mpu_state_global != MPU_CORRECT) return state;
+  int32_t value_funct;                                    // Value being filtered
 
-  // -- State calculation with the accelerometer --
-  accelState(measurements_funct, state_accel_est, &temp_funct);
-  return state_accel_est;
+  #if MPU_PREFILTER_TYPE == MPU_PREFILTER_CIC
+    // --- Integrators ---
+    for (uint8_t i = 0; i < 6; i++) {
+      value_funct = raw_values[i];
+      for (uint8_t stage = 0; stage < MPU_PREFILTER_CIC_ORDER; stage++) {
+        value_funct = (int32_t)((uint32_t)prefilter_integrators[stage][i] + (uint32_t)value_funct);  // Modulo 2^32
+        prefilter_integrators[stage][i] = value_funct;
+      }
+    }
+
+    // --- Decimation ---
+    if (++prefilter_count < prefilter_decimation) return false;
+    prefilter_count = 0;
+
+    // --- Combs ---
+    int32_t gain_funct = prefilter_decimation;            // decimation^order
+    for (uint8_t stage = 1; stage < MPU_PREFILTER_CIC_ORDER; stage++) gain_funct *= prefilter_decimation;
+
+    for (uint8_t i = 0; i < 6; i++) {
+      value_funct = prefilter_integrators[MPU_PREFILTER_CIC_ORDER - 1][i];
+      for (uint8_t stage = 0; stage < MPU_PREFILTER_CIC_ORDER; stage++) {
+        int32_t input_funct = value_funct;
+        value_funct = (int32_t)((uint32_t)value_funct - (uint32_t)prefilter_combs[stage][i]);
+        prefilter_combs[stage][i] = input_funct;
+      }
+      // -- Remove the gain (rounded) --
+      value_funct = (value_funct >= 0) ? (value_funct + gain_funct / 2) / gain_funct : (value_funct - gain_funct / 2) / gain_funct;
+      raw_values[i] = (int16_t)value_funct;
+    }
+  #else
+    // --- Restart ---
+    // The state is set as if the sample was constant, so there is no transient
+    if (prefilter_warm_up) {
+      for (uint8_t i = 0; i < 6; i++) {
+        prefilter_inputs[0][i] = prefilter_inputs[1][i] = raw_values[i];
+        prefilter_outputs[0][i] = prefilter_outputs[1][i] = (int32_t)raw_values[i] * (1L << MPU_PREFILTER_Q);
+      }
+      prefilter_warm_up = 0;
+    }
+
+    // --- Biquad ---
+    // The result is in Q14. The outputs are split in the integer part (floor) and the fraction, so the products fit in an int32_t:
+    //      -) (|b0| + |b1| + |b2| + |a1| + |a2|) * 2^15 < 2^31 for the low pass filters (|a1| < 2, |a2| < 1)
+    //      -) (|a1| + |a2|) * 2^14 < 2^30 for the fractions
+    for (uint8_t i = 0; i < 6; i++) {
+      int32_t fraction_funct = (int32_t)prefilter_coefficients[3] * (prefilter_outputs[0][i] & ((1L << MPU_PREFILTER_Q) - 1))
+                             + (int32_t)prefilter_coefficients[4] * (prefilter_outputs[1][i] & ((1L << MPU_PREFILTER_Q) - 1));
+      value_funct = (int32_t)prefilter_coefficients[0] * raw_values[i]
+                  + (int32_t)prefilter_coefficients[1] * prefilter_inputs[0][i]
+                  + (int32_t)prefilter_coefficients[2] * prefilter_inputs[1][i]
+                  - (int32_t)prefilter_coefficients[3] * (prefilter_outputs[0][i] >> MPU_PREFILTER_Q)
+                  - (int32_t)prefilter_coefficients[4] * (prefilter_outputs[1][i] >> MPU_PREFILTER_Q)
+                  - ((fraction_funct + (1L << (MPU_PREFILTER_Q - 1))) >> MPU_PREFILTER_Q);
+      if (value_funct > (INT16_MAX * (1L << MPU_PREFILTER_Q))) value_funct = INT16_MAX * (1L << MPU_PREFILTER_Q);
+      if (value_funct < (INT16_MIN * (1L << MPU_PREFILTER_Q))) value_funct = INT16_MIN * (1L << MPU_PREFILTER_Q);
+
+      prefilter_inputs[1][i] = prefilter_inputs[0][i];
+      prefilter_inputs[0][i] = raw_values[i];
+      prefilter_outputs[1][i] = prefilter_outputs[0][i];
+      prefilter_outputs[0][i] = value_funct;
+    }
+
+    // --- Decimation ---
+    // Only the output is rounded
+    if (++prefilter_count < prefilter_decimation) return false;
+    prefilter_count = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+      value_funct = (prefilter_outputs[0][i] + (1L << (MPU_PREFILTER_Q - 1))) >> MPU_PREFILTER_Q;
+      raw_values[i] = (value_funct > INT16_MAX) ? INT16_MAX : (int16_t)value_funct;
+    }
+  #endif
+
+  // --- Transient ---
+  if (prefilter_warm_up) {
+    prefilter_warm_up--;
+    return false;
+  }
+
+  return true;
 }
+#endif
 
-void MpuDev::initializeMeasurements() {
-  /*
-   * This function resets the data to start with the estimations from the origin.
+//            **************************
+//            *          FIFO          *
+//            **************************
+
+bool MpuDev::enableFifo(uint8_t sensors_funct) {
+  /* This function enables the FIFO of the MPU so the measurements can be read in bursts.
+   * The sensors loaded into the FIFO are selected by sensors_funct (check the MPU_FIFO_* values in the .h). A new frame is loaded
+   * every sample period and it contains the selected measurements in the register order: A_X, A_Y, A_Z, TEMP, G_X, G_Y, G_Z.
+   * With the default value the frame has the same order as getParameter6().
+   * The FIFO can hold MPU_FIFO_SIZE bytes, so it has to be read before it is full (85 frames at 1kHz with the default sensors).
    *
    * Parameters:
-   *      @param initial_time     --> (unsigned long) millis() time when the measurements were taken (it should be obtained with the interrupt)
+   *      @param sensors_funct      --> (uint8_t) Sensors that will be loaded into the FIFO (MPU_FIFO_SENSORS_DEFAULT by default)
+   *      @return status            --> (bool) State of the configuration process (true = success)
    */
 
-  mpu_data_ready = false;
+  // --- Check the DMP ---
+  #ifdef MPU_DMP_MODE
+    if (dmp_started) return false;  // The FIFO is used by the DMP packets
+  #endif
 
-  while (!mpu_data_ready) {
-    // Just wait
+  // --- Calculate the frame length ---
+  fifo_frame_length = 0;
+  if (sensors_funct & MPU_FIFO_ACCEL) fifo_frame_length += 6;
+  if (sensors_funct & MPU_FIFO_TEMP)  fifo_frame_length += 2;
+  if (sensors_funct & MPU_FIFO_XG)    fifo_frame_length += 2;
+  if (sensors_funct & MPU_FIFO_YG)    fifo_frame_length += 2;
+  if (sensors_funct & MPU_FIFO_ZG)    fifo_frame_length += 2;
+  if (fifo_frame_length == 0) return false;  // Nothing to load
+
+  // --- Select the sensors ---
+  if (!writeMpuRegister(MPU_FIFO_EN_ADDR, sensors_funct)) {
+    fifo_frame_length = 0;
+    return false;
   }
+  fifo_sensors = sensors_funct;
 
-  resetSignalPath();
+  // --- Time stamps of the frames ---
+  // The frames continue the sequence of the data ready interrupts (drainFifoToBuffer())
+  #if defined(MPU_SAMPLE_BUFFER) && (MPU_TIMING_MODE == MPU_TIMING_FIXED)
+    fifo_sequence = sample_sequence;
+  #endif
+
+  // --- Clear and start the FIFO ---
+  return resetFifo();
+}
+
+bool MpuDev::disableFifo() {
+  /* This function stops the FIFO and removes all the sensors from it.
+   *
+   * Parameters:
+   *      @return status            --> (bool) State of the configuration process (true = success)
+   */
+
+  fifo_frame_length = 0;
+  fifo_sensors = 0;
+
+  // --- Stop the FIFO ---
+  if (!updateMpuRegister(MPU_USER_CTRL_ADDR, 0x00, MPU_USER_CTRL_FIFO_MASK)) return false;
+
+  // --- Remove the sensors ---
+  return writeMpuRegister(MPU_FIFO_EN_ADDR, 0x00);
+}
+
+bool MpuDev::resetFifo() {
+  /* This function clears the FIFO and starts it again.
+   * The FIFO has to be stopped while it is being reset, so both bits are written at the same time. The reset bit is cleared by the
+   * MPU once it is done, so that write can't be verified.
+   * If the MPU was in the MPU_FIFO_OVERFLOW state it will go back to MPU_CORRECT, since the FIFO is aligned again.
+   *
+   * Parameters:
+   *      @return status            --> (bool) State of the reset process (true = success)
+   */
+
+  // --- Stop and reset ---
+  if (!updateMpuRegister(MPU_USER_CTRL_ADDR, MPU_USER_CTRL_FIFO_RESET, MPU_USER_CTRL_FIFO_MASK, false)) return false;
+
+  // --- Start ---
+  if (!updateMpuRegister(MPU_USER_CTRL_ADDR, MPU_USER_CTRL_FIFO_ENABLE, MPU_USER_CTRL_FIFO_MASK)) return false;
+
+  // --- Clear the overflow ---
+  if (mpu_state_global == MPU_FIFO_OVERFLOW) mpu_state_global = MPU_CORRECT;
+
+  return true;
+}
+
+uint16_t MpuDev::getFifoCount() {
+  /* This function reads the number of bytes stored in the FIFO.
+   *
+   * Parameters:
+   *      @return fifo_count        --> (uint16_t) Number of bytes in the FIFO (0 if the communication fails)
+   */
+
+  uint8_t buffer_funct[2];         // This variable is to holds the raw data from the registers
+
+  // --- Read data form the device ---
+  readMpuRegisters(MPU_FIFO_COUNT_ADDR, buffer_funct, 2);  // The buffer is set to 0 if it fails
+
+  // --- Convert data ---
+  return ((uint16_t)buffer_funct[0] << 8) | (buffer_funct[1]);
+}
+
+uint16_t MpuDev::readFifoFrames(int16_t *frames_funct, uint16_t max_frames) {
+  /* This function reads the complete frames stored in the FIFO.
+   * The FIFO count is read once and then the frames are read in bursts of up to MPU_FIFO_BURST_LENGTH bytes, so the I2C overhead is 
+   * paid once per burst instead of once per sample. The bytes are loaded directly into frames_funct and then converted in place.
+   * 
+   * If the FIFO is full, the MPU has been overwriting the oldest data so samples have been lost and the frames may not be aligned 
+   * anymore. In that case nothing is read, the state is set to MPU_FIFO_OVERFLOW and resetFifo() must be called.
+   * The bursts are read with one attempt (a retry would be shifted). If one fails (MPU_I2C_ERROR), the frames of the previous bursts
+   * are returned, the FIFO is reset to align it again and the frames lost are added to dropped_samples.
+   * 
+   * Parameters:
+   *      @param *frames_funct      --> (int16_t) Pointer to an array for the frames. It must have space for max_frames frames 
+   *                                    (fifo_frame_length/2 values each, 6 with the default sensors: A_X, A_Y, A_Z, G_X, G_Y, G_Z).
+   *      @param max_frames         --> (uint16_t) Maximum number of frames that will be read.
+   *      @return frames            --> (uint16_t) Number of frames read (0 if there is an error before the first burst).
+   */
+
+  uint8_t *buffer_funct = (uint8_t *) frames_funct;  // The raw data is loaded in the output array
+  uint16_t fifo_count;                               // Number of bytes in the FIFO
+  uint16_t frames;                                   // Number of frames that will be read
+  uint8_t frames_per_burst;                          // Number of frames that fit in one burst
+
+  // --- Check the FIFO ---
+  if (fifo_frame_length == 0) return 0;              // FIFO not enabled
+  fifo_count = getFifoCount();
+  if (mpu_state_global == MPU_I2C_ERROR) return 0;
+
+  // -- Check overflow --
+  if (fifo_count >= MPU_FIFO_SIZE) {
+    mpu_state_global = MPU_FIFO_OVERFLOW;
+
+    // Debug
+    #ifdef DEBUG_MODE_MPU
+      Serial.println(F("FIFO overflow (O.O)"));
+    #endif
+
+    return 0;
+  }
+
+  // --- Read the frames ---
+  frames = fifo_count / fifo_frame_length;
+  if (frames > max_frames) frames = max_frames;
+  frames_per_burst = MPU_FIFO_BURST_LENGTH / fifo_frame_length;
+
+  for (uint16_t i = 0; i < frames; i += frames_per_burst) {
+    uint16_t burst_frames = frames - i;  // Frames read in this burst
+    if (burst_frames > frames_per_burst) burst_frames = frames_per_burst;
+
+    if (!readMpuRegisters(MPU_FIFO_R_W_ADDR, buffer_funct + (i * fifo_frame_length), burst_frames * fifo_frame_length, 1)) {
+      // -- Lost frames --
+      // The FIFO isn't aligned anymore, so the frames that weren't read are discarded
+      noInterrupts();
+      dropped_samples += (fifo_count / fifo_frame_length) - i;
+      interrupts();
+      resetFifo();
+      frames = i;
+      break;
+    }
+  }
+
+  // --- Convert data ---
+  // The MPU sends the most significant byte first
+  for (uint16_t i = 0; i < (frames * fifo_frame_length) / 2; i++) {
+    frames_funct[i] = (buffer_funct[2 * i] << 8) | (buffer_funct[(2 * i) + 1]);
+  }
+
+  // --- Temperature ---
+  // The frames don't have it (by default), so it is read once per call for the temperature compensation of updateEstimators()
+  #ifdef MPU_TEMP_COMPENSATION
+    if (frames != 0) readMpuData(MPU_TEMP_REG_BASE, &temperature_raw);
+  #endif
+
+  return frames;
+}
+
+
+//            **************************
+//            *          DMP           *
+//            **************************
+// The DMP runs the MotionApps20 firmware: every 5 ms it loads a packet with the quaternion, the gyroscope and the accelerometer into the
+// FIFO. The firmware is loaded by initialize_1() and the DMP is started by initialize_2() (after the calibration), so the offsets
+// (setOffsets() or the EEPROM) are applied and the fusion is done by the MPU instead of the estimators.
+
+#ifdef MPU_DMP_MODE
+
+bool MpuDev::loadDmpFirmware() {
+  /* This function loads the DMP firmware with the MPU6050 library. The MPU is reset, so the offsets stored in the registers are lost
+   * (they are loaded afterwards by checkCalibration() or the calibration).
+   *
+   * Parameters:
+   *      @return status            --> (bool) State of the loading process (true = success)
+   */
+
+  MPU6050 dmp_funct(i2c_address);   // Only used to load the firmware and the DMP configuration
+
+  // --- Load ---
+  if (dmp_funct.dmpInitialize() != 0) {  // 1 = memory load failed, 2 = configuration failed
+    // Debug
+    #ifdef DEBUG_MODE_MPU
+      Serial.println(F("DMP firmware couldn't be loaded x_x"));
+    #endif
+
+    mpu_state_global = MPU_DMP_ERROR;
+    return false;
+  }
+
+  dmp_started = false;
+  return true;
+}
+
+bool MpuDev::startDmp() {
+  /* This function sets the configuration expected by the DMP firmware (200 Hz, +-2g and +-2000 deg/s), then resets and starts the
+   * DMP and the FIFO. The offset_correction values are scaled to the new full-scale ranges by setFullScale().
+   *
+   * Parameters:
+   *      @return status            --> (bool) State of the configuration process (true = success)
+   */
+
+  // --- Configuration ---
+  if (!setSampleRate(MPU_DMP_SAMPLE_RATE_REG, MPU_DMP_DLPF_REG)) return false;
+  if (!setFullScale(MPU_DMP_ACCEL_CONFIG, MPU_DMP_GYRO_CONFIG)) return false;
+
+  // --- Start ---
+  // The reset bits are cleared by the MPU once it is done, so that write can't be verified
+  fifo_frame_length = 0;
+  fifo_sensors = 0;
+  if (!updateMpuRegister(MPU_USER_CTRL_ADDR, MPU_USER_CTRL_DMP_START, MPU_USER_CTRL_DMP_MASK, false)) return false;
+
+  dmp_started = true;
+  return true;
+}
+
+bool MpuDev::readDmp() {
+  /* This function reads the DMP packets stored in the FIFO and updates dmp_quaternion, dmp_gravity and dmp_ypr with the newest one
+   * (the older ones are discarded). If the FIFO has overflowed or a packet couldn't be read the packets aren't aligned anymore, so it
+   * is reset and the lost packets are added to dropped_samples.
+   *
+   * Parameters:
+   *      @return status            --> (bool) true if there was a new packet
+   */
+
+  uint8_t packet_funct[MPU_DMP_PACKET_LENGTH];  // Raw data of a packet
+  uint16_t count_funct;                         // Bytes stored in the FIFO
+  int32_t raw_funct;                            // Raw value of a quaternion component
+  float *q = dmp_quaternion;                    // Shorter name for the formulas
+
+  if (!dmp_started) return false;
+
+  // --- Check the FIFO ---
+  count_funct = getFifoCount();
+  if ((count_funct >= MPU_FIFO_SIZE) || (count_funct % MPU_DMP_PACKET_LENGTH)) {
+    noInterrupts();
+    dropped_samples += count_funct / MPU_DMP_PACKET_LENGTH;
+    interrupts();
+    resetFifo();
+
+    // Debug
+    #ifdef DEBUG_MODE_MPU
+      Serial.println(F("DMP FIFO overflow, reset"));
+    #endif
+
+    return false;
+  }
+  if (count_funct < MPU_DMP_PACKET_LENGTH) return false;
+
+  // --- Read the packets ---
+  // Only the last one is used. They are read with one attempt (a retry would be shifted), so after a failure the FIFO is reset
+  while (count_funct >= MPU_DMP_PACKET_LENGTH) {
+    if (!readMpuRegisters(MPU_FIFO_R_W_ADDR, packet_funct, MPU_DMP_PACKET_LENGTH, 1)) {
+      noInterrupts();
+      dropped_samples += count_funct / MPU_DMP_PACKET_LENGTH;
+      interrupts();
+      resetFifo();
+      return false;
+    }
+    count_funct -= MPU_DMP_PACKET_LENGTH;
+  }
+
+  // --- Quaternion ---
+  for (uint8_t i = 0; i < 4; i++) {
+    raw_funct = ((int32_t)packet_funct[i * 4] << 24) | ((int32_t)packet_funct[i * 4 + 1] << 16) |
+                ((int32_t)packet_funct[i * 4 + 2] << 8) | packet_funct[i * 4 + 3];
+    q[i] = raw_funct / MPU_DMP_QUATERNION_SCALE;
+  }
+
+  // --- Gravity ---
+  dmp_gravity[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+  dmp_gravity[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+  dmp_gravity[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+  // --- Yaw, pitch and roll ---
+  dmp_ypr[0] = MPU_ATAN2(2 * q[1] * q[2] - 2 * q[0] * q[3], 2 * q[0] * q[0] + 2 * q[1] * q[1] - 1);
+  dmp_ypr[1] = MPU_ATAN2(dmp_gravity[0], sqrt(dmp_gravity[1] * dmp_gravity[1] + dmp_gravity[2] * dmp_gravity[2]));
+  dmp_ypr[2] = MPU_ATAN2(dmp_gravity[1], dmp_gravity[2]);
+
+  return true;
+}
+
+#endif  // MPU_DMP_MODE
+
+
+//            **************************
+//            *     SAMPLE BUFFER      *
+//            **************************
+// Lock-free single producer and single consumer ring buffer. The producer only writes sample_head and the consumer only writes sample_tail.
+// They are uint8_t (atomic on AVR) and free running, so the number of stored samples is (sample_head - sample_tail) and the buffer can be full.
+
+#ifdef MPU_SAMPLE_BUFFER
+
+bool MpuDev::pushSample(int16_t *values_funct, unsigned long time_stamp) {
+  /* This function stores a sample in the buffer. It can be called from an interrupt routine (producer).
+   * If the buffer is full the sample is discarded and sample_buffer_drops is incremented.
+   *
+   * Parameters:
+   *      @param *values_funct      --> (int16_t) Pointer to the raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @param time_stamp         --> (unsigned long) Time stamp of the sample (see MPU_TIMING_MODE)
+   *      @return status            --> (bool) true if the sample has been stored
+   */
+
+  uint8_t head_funct = sample_head;
+  uint8_t count_funct = head_funct - sample_tail;
+
+  // --- Check the space ---
+  if (count_funct >= MPU_SAMPLE_BUFFER_SIZE) {
+    sample_buffer_drops++;
+    return false;
+  }
+
+  // --- Store ---
+  MpuSample *sample_funct = &sample_buffer[head_funct & MPU_SAMPLE_BUFFER_MASK];
+  for (uint8_t i = 0; i < 6; i++) sample_funct->values[i] = values_funct[i];
+  sample_funct->time_stamp = time_stamp;
+
+  // --- Publish ---
+  // The sample has to be written before the head is moved
+  __asm__ __volatile__("" ::: "memory");
+  sample_head = head_funct + 1;
+  if (count_funct + 1 > sample_buffer_high_water) sample_buffer_high_water = count_funct + 1;
+
+  return true;
+}
+
+bool MpuDev::popSample(MpuSample *sample_funct) {
+  /* This function gets the oldest sample of the buffer (consumer).
+   *
+   * Parameters:
+   *      @param *sample_funct      --> (MpuSample) Pointer to the sample where the oldest one will be copied
+   *      @return status            --> (bool) false if the buffer is empty
+   */
+
+  uint8_t tail_funct = sample_tail;
+
+  // --- Check the samples ---
+  if (tail_funct == sample_head) return false;
+
+  // --- Copy ---
+  *sample_funct = sample_buffer[tail_funct & MPU_SAMPLE_BUFFER_MASK];
+
+  // --- Release ---
+  // The sample has to be copied before the tail is moved
+  __asm__ __volatile__("" ::: "memory");
+  sample_tail = tail_funct + 1;
+
+  return true;
+}
+
+uint8_t MpuDev::getSampleCount() {
+  /* This function gets the number of samples stored in the buffer.
+   *
+   * Parameters:
+   *      @return count             --> (uint8_t) Number of samples
+   */
+
+  return sample_head - sample_tail;
+}
+
+bool MpuDev::acquireSample() {
+  /* This function reads the ready sample (mpu_data_ready) with the asynchronous reading and stores it in the buffer with its time stamp
+   * (time_buffer). It doesn't wait, so it has to be called until the reading is done (it returns true when the sample is stored).
+   * On AVR boards the asynchronous reading doesn't need interrupts, so it can be called from a timer interrupt routine.
+   *
+   * Parameters:
+   *      @return status            --> (bool) true if a sample has been stored
+   */
+
+  int16_t values_funct[6];  // Raw measurements
+
+  // --- Start a new reading ---
+  if (async_state == MPU_ASYNC_IDLE) {
+    if (!mpu_data_ready) return false;
+    sample_acquire_time = time_buffer;
+    mpu_data_ready = false;
+    if (!startReadMpuMeasurements()) return false;
+  }
+
+  // --- Advance the reading ---
+  if (pollReadMpuMeasurements(values_funct) != MPU_ASYNC_DONE) return false;
+
+  return pushSample(values_funct, sample_acquire_time);
+}
+
+uint16_t MpuDev::drainFifoToBuffer() {
+  /* This function reads the frames stored in the FIFO (only the default sensors, MPU_FIFO_SENSORS_DEFAULT) and stores them in the buffer.
+   * The FIFO doesn't have time stamps, so they are reconstructed from the current time and the sample period (the last frame is the newest).
+   * With MPU_TIMING_FIXED each frame increments its own counter (fifo_sequence, it starts from sample_sequence in enableFifo()), since
+   * sample_sequence is already incremented by dataReadyInterrupt() for every sample and the frames would be counted twice.
+   *
+   * Parameters:
+   *      @return frames            --> (uint16_t) Number of frames stored
+   */
+
+  int16_t frames_funct[MPU_SAMPLE_DRAIN_FRAMES * 6];  // Frames read from the FIFO
+  uint16_t stored_funct = 0;                          // Frames stored in the buffer
+  uint8_t space_funct;                                // Free samples in the buffer
+  uint16_t frames;                                    // Frames read
+  unsigned long time_funct;                           // Time stamp of the newest frame
+
+  // --- Check the FIFO ---
+  if (fifo_frame_length != 12) return 0;  // Only the accelerometer and gyroscope frames are supported
+
+  do {
+    // -- Read the frames that fit in the buffer --
+    space_funct = MPU_SAMPLE_BUFFER_SIZE - getSampleCount();
+    if (space_funct == 0) break;
+    frames = readFifoFrames(frames_funct, (space_funct < MPU_SAMPLE_DRAIN_FRAMES) ? space_funct : MPU_SAMPLE_DRAIN_FRAMES);
+
+    // -- Time stamps --
+    #if MPU_TIMING_MODE != MPU_TIMING_FIXED
+      time_funct = MPU_TIME_NOW();
+    #endif
+
+    // -- Store --
+    for (uint16_t i = 0; i < frames; i++) {
+      #if MPU_TIMING_MODE == MPU_TIMING_FIXED
+        time_funct = ++fifo_sequence;
+        pushSample(frames_funct + (i * 6), time_funct);
+      #else
+        pushSample(frames_funct + (i * 6), time_funct - (unsigned long)((frames - 1 - i) * working_sample_period * MPU_TIME_UNITS_PER_SECOND));
+      #endif
+    }
+    stored_funct += frames;
+  } while (frames == MPU_SAMPLE_DRAIN_FRAMES);
+
+  return stored_funct;
+}
+
+uint8_t MpuDev::processSamples(uint8_t max_samples) {
+  /* This function updates the enabled estimators with the samples stored in the buffer (oldest first), so the processing can be 
+   * slower than the acquisition for a while (e.g. while printing).
+   *
+   * Parameters:
+   *      @param max_samples        --> (uint8_t) Maximum number of samples to be processed (all of them by default)
+   *      @return samples           --> (uint8_t) Number of samples processed
+   */
+
+  MpuSample sample_funct;
+  uint8_t count_funct = 0;
+
+  while ((count_funct < max_samples) && popSample(&sample_funct)) {
+    updateEstimators(sample_funct.time_stamp, sample_funct.values);
+    count_funct++;
+  }
+
+  return count_funct;
+}
+
+#endif  // MPU_SAMPLE_BUFFER
+
+//            **************************
+//            *       FAST MATH        *
+//            **************************
+// The tables are generated by the compiler (constexpr series) so their size can be changed with MPU_TRIG_TABLE_BITS.
+// sin_table holds sin(x) * 65535 for a quarter of a turn and atan_table holds atan(z) in Q16.16 for z in [0, 1].
+
+#ifdef MPU_FAST_TRIG
+
+// --- Table generation ---
+constexpr mpu_real_t mpuSinSeries(mpu_real_t x_2, mpu_real_t term, uint8_t n) {
+  // sin(x) = x - x^3/3! + x^5/5! - ... (x in [0, pi/2])
+  return (n > 12) ? 0.0 : term + mpuSinSeries(x_2, -term * x_2 / ((2.0 * n) * (2.0 * n + 1.0)), n + 1);
+}
+
+constexpr mpu_real_t mpuAtanSeries(mpu_real_t r, mpu_real_t term, uint8_t n) {
+  // Euler series: atan(z) = sum(term_n) with term_0 = z/(1+z^2), term_n = term_n-1 * 2n*r/(2n+1) and r = z^2/(1+z^2) (z in [0, 1])
+  return (n > 40) ? 0.0 : term + mpuAtanSeries(r, term * (2.0 * n) * r / (2.0 * n + 1.0), n + 1);
+}
+
+constexpr mpu_real_t mpuSinEntry(mpu_real_t x) {
+  return mpuSinSeries(x * x, x, 1);
+}
+
+constexpr mpu_real_t mpuAtanEntry(mpu_real_t z) {
+  return mpuAtanSeries(z * z / (1.0 + z * z), z / (1.0 + z * z), 1);
+}
+
+#define MPU_SIN_ENTRY(i)        ((uint16_t)(mpuSinEntry((i) * M_PI / (2.0 * MPU_TRIG_TABLE_SIZE)) * 65535.0 + 0.5))
+#define MPU_ATAN_ENTRY(i)       ((uint16_t)(mpuAtanEntry((mpu_real_t)(i) / MPU_TRIG_TABLE_SIZE) * 65536.0 + 0.5))
+#define MPU_TABLE_2(f, i)       f(i), f((i) + 1)
+#define MPU_TABLE_4(f, i)       MPU_TABLE_2(f, i), MPU_TABLE_2(f, (i) + 2)
+#define MPU_TABLE_8(f, i)       MPU_TABLE_4(f, i), MPU_TABLE_4(f, (i) + 4)
+#define MPU_TABLE_16(f, i)      MPU_TABLE_8(f, i), MPU_TABLE_8(f, (i) + 8)
+#define MPU_TABLE_32(f, i)      MPU_TABLE_16(f, i), MPU_TABLE_16(f, (i) + 16)
+#define MPU_TABLE_64(f, i)      MPU_TABLE_32(f, i), MPU_TABLE_32(f, (i) + 32)
+#define MPU_TABLE_128(f, i)     MPU_TABLE_64(f, i), MPU_TABLE_64(f, (i) + 64)
+#define MPU_TABLE_256(f, i)     MPU_TABLE_128(f, i), MPU_TABLE_128(f, (i) + 128)
+
+#if MPU_TRIG_TABLE_BITS == 5
+  #define MPU_TABLE(f)          MPU_TABLE_32(f, 0), f(32)
+#elif MPU_TRIG_TABLE_BITS == 6
+  #define MPU_TABLE(f)          MPU_TABLE_64(f, 0), f(64)
+#elif MPU_TRIG_TABLE_BITS == 7
+  #define MPU_TABLE(f)          MPU_TABLE_128(f, 0), f(128)
+#elif MPU_TRIG_TABLE_BITS == 8
+  #define MPU_TABLE(f)          MPU_TABLE_256(f, 0), f(256)
+#else
+  #error "MPU_TRIG_TABLE_BITS must be between 5 and 8"
+#endif
+
+// --- Tables ---
+const uint16_t sin_table[MPU_TRIG_TABLE_SIZE + 1] PROGMEM = { MPU_TABLE(MPU_SIN_ENTRY) };
+const uint16_t atan_table[MPU_TRIG_TABLE_SIZE + 1] PROGMEM = { MPU_TABLE(MPU_ATAN_ENTRY) };
+
+int32_t MpuDev::tableSin(int32_t phase) {
+  /*
+   * This function calculates the sine using the table. A whole turn is 4 * 256 * MPU_TRIG_TABLE_SIZE phase units, so the 
+   * quadrant is given by the upper bits and the lower 8 bits are used to interpolate between two entries.
+   *
+   * Parameters:
+   *      @param phase              --> Angle in phase units (1/256 of a table step), any value is valid
+   *      @return sin(phase)        --> (Q16.16) Sine of the angle
+   */
+
+  uint32_t phase_funct = (uint32_t)phase;  // The negative values just wrap around
+  uint8_t quadrant = (phase_funct >> (MPU_TRIG_TABLE_BITS + 8)) & 3;
+  uint32_t quadrant_phase = phase_funct & (((uint32_t)MPU_TRIG_TABLE_SIZE << 8) - 1);
+  int32_t result;
+
+  // --- Mirror the odd quadrants ---
+  if (quadrant & 1) quadrant_phase = ((uint32_t)MPU_TRIG_TABLE_SIZE << 8) - quadrant_phase;
+
+  // --- Read the table ---
+  #ifdef MPU_TRIG_INTERPOLATION
+    uint16_t index = quadrant_phase >> 8;
+    uint8_t fraction = quadrant_phase & 0xFF;
+    result = pgm_read_word(&sin_table[index]);
+    if (fraction != 0) result += (((int32_t)pgm_read_word(&sin_table[index + 1]) - result) * fraction) >> 8;
+  #else
+    result = pgm_read_word(&sin_table[(quadrant_phase + 128) >> 8]);
+  #endif
+
+  // --- Scale to Q16.16 and get the sign ---
+  result += result >> 15;  // 65535 --> 65536
+  return (quadrant & 2) ? -result : result;
+}
+
+int32_t MpuDev::tableAtan(uint32_t ratio) {
+  /*
+   * This function calculates the arctangent in [0, 1] using the table.
+   *
+   * Parameters:
+   *      @param ratio              --> Value in [0, 1] with MPU_TRIG_TABLE_BITS + 8 fractional bits
+   *      @return atan(ratio)       --> (Q16.16) Angle in rad [0, pi/4]
+   */
+
+  #ifdef MPU_TRIG_INTERPOLATION
+    uint16_t index = ratio >> 8;
+    uint8_t fraction = ratio & 0xFF;
+    int32_t result = pgm_read_word(&atan_table[index]);
+    if (fraction != 0) result += (((int32_t)pgm_read_word(&atan_table[index + 1]) - result) * fraction) >> 8;
+    return result;
+  #else
+    return pgm_read_word(&atan_table[(ratio + 128) >> 8]);
+  #endif
+}
+
+int32_t MpuDev::tableAtan2(int32_t y, int32_t x) {
+  /*
+   * This function calculates atan2(y, x) using the table. The inputs are reduced to 15 bits so only 32 bit divisions are needed.
+   *
+   * Parameters:
+   *      @param y                  --> Y value
+   *      @param x                  --> X value (same scale as y)
+   *      @return atan2(y, x)       --> (Q16.16) Angle in rad [-pi, pi]
+   */
+
+  uint32_t abs_x = (x < 0) ? -x : x;
+  uint32_t abs_y = (y < 0) ? -y : y;
+  int32_t result;
+
+  if ((abs_x == 0) && (abs_y == 0)) return 0;
+
+  // --- Reduce the inputs ---
+  while ((abs_x | abs_y) >= 0x8000) {
+    abs_x >>= 1;
+    abs_y >>= 1;
+  }
+
+  // --- First octant ---
+  if (abs_x >= abs_y) result = tableAtan((abs_y << (MPU_TRIG_TABLE_BITS + 8)) / abs_x);
+  else result = MPU_TRIG_HALF_PI - tableAtan((abs_x << (MPU_TRIG_TABLE_BITS + 8)) / abs_y);
+
+  // --- Get the quadrant ---
+  if (x < 0) result = MPU_TRIG_PI - result;
+  return (y < 0) ? -result : result;
+}
+
+mpu_real_t MpuDev::fastSin(mpu_real_t x) {
+  /*
+   * This function calculates the sine of a double using the table.
+   *
+   * Parameters:
+   *      @param x                  --> Angle in rad (|x| < 10000)
+   *      @return sin(x)            --> Sine of the angle
+   */
+
+  return tableSin((int32_t)(x * MPU_TRIG_PHASE_SCALE + ((x < 0) ? -0.5 : 0.5))) / 65536.0;
+}
+
+mpu_real_t MpuDev::fastCos(mpu_real_t x) {
+  /*
+   * This function calculates the cosine of a double using the table: cos(x) = sin(x + pi/2).
+   *
+   * Parameters:
+   *      @param x                  --> Angle in rad (|x| < 10000)
+   *      @return cos(x)            --> Cosine of the angle
+   */
+
+  return tableSin((int32_t)(x * MPU_TRIG_PHASE_SCALE + ((x < 0) ? -0.5 : 0.5)) + ((int32_t)MPU_TRIG_TABLE_SIZE << 8)) / 65536.0;
+}
+
+mpu_real_t MpuDev::fastAtan2(mpu_real_t y, mpu_real_t x) {
+  /*
+   * This function calculates atan2(y, x) of doubles using the table.
+   *
+   * Parameters:
+   *      @param y                  --> Y value
+   *      @param x                  --> X value
+   *      @return atan2(y, x)       --> Angle in rad [-pi, pi]
+   */
+
+  mpu_real_t abs_x = fabs(x);
+  mpu_real_t abs_y = fabs(y);
+  mpu_real_t result;
+
+  if ((abs_x == 0) && (abs_y == 0)) return 0;
+
+  // --- First octant ---
+  if (abs_x >= abs_y) result = tableAtan((uint32_t)(abs_y / abs_x * ((uint32_t)MPU_TRIG_TABLE_SIZE << 8) + 0.5)) / 65536.0;
+  else result = M_PI_2 - tableAtan((uint32_t)(abs_x / abs_y * ((uint32_t)MPU_TRIG_TABLE_SIZE << 8) + 0.5)) / 65536.0;
+
+  // --- Get the quadrant ---
+  if (x < 0) result = M_PI - result;
+  return (y < 0) ? -result : result;
+}
+
+#endif  // MPU_FAST_TRIG
+
+
+//            **************************
+//            *     KALMAN FILTER      *
+//            **************************
+
+void MpuDev::integrate(mpu_real_t d_time, mpu_real_t *angular_speed_1, mpu_real_t *angular_speed_2, mpu_real_t *integration_result) {
+  /*
+   * This function performs the trapezoidal numeric integration of the angular speed.
+   *
+   * Parameters:
+   *      @param d_time               --> (mpu_real_t) increment of time between the current and the previous measurement.
+   *      @param *angular_speed_1     --> (mpu_real_t) Pointer to the current rotated angular speed array {omega_x, omega_y}
+   *      @param *angular_speed_2     --> (mpu_real_t) Pointer to the previous rotated angular speed array {omega_x, omega_y}
+   *      @param *integration_result  --> (mpu_real_t) Pointer to the array with the integration result
+   */
+
+  // --- Definition ---
+  mpu_real_t temp_funct;
+
+  // --- Integrate ---
+  temp_funct = (d_time)/2.0;
+  integration_result[0] = temp_funct * (angular_speed_1[0] + angular_speed_2[0]);
+  integration_result[1] = temp_funct * (angular_speed_1[1] + angular_speed_2[1]);
+
+  // --- Done ---
+}
+
+void MpuDev::rotate(mpu_real_t *measurements_ref, mpu_real_t *rotated_values, mpu_real_t *angles_funct) {
+  /*
+   * This function rotates the current angular speed measurement from the IMU reference to the global one.
+   * The rotation is done according to the current state estimation (or the given angles)
+   *
+   * Parameters:
+   *      @param measurements_ref    --> (mpu_real_t) Pointer to the refined measurements array
+   *      @param *rotated_values     --> (mpu_real_t) Pointer to the rotated angular speed array
+   *      @param *angles_funct       --> (mpu_real_t) Pointer to the angles used for the rotation (state by default)
+   */
+
+  MPU_PROFILE_START(profile_start);
+
+  // --- Definitions ---
+  if (angles_funct == NULL) angles_funct = state;
+  mpu_real_t sin_0 = MPU_SIN(angles_funct[0]); // The trigonometric functions of the state are only calculated once
+  mpu_real_t cos_0 = MPU_COS(angles_funct[0]);
+  mpu_real_t sin_1 = MPU_SIN(angles_funct[1]);
+  mpu_real_t cos_1 = MPU_COS(angles_funct[1]);
+
+  // --- Rotation ---
+  // -- Rotate w_x --
+  rotated_values[0] = measurements_ref[3]*cos_0 + measurements_ref[5]*sin_1;
+  // -- Rotate w_y --
+  rotated_values[1] = measurements_ref[3] * (sin_0 * sin_1) + 
+                      measurements_ref[4] * (cos_0) -
+                      measurements_ref[5] * (sin_0 * cos_1);
+
+  // --- Done ---
+  MPU_PROFILE_END(MPU_STAGE_ROTATE, profile_start);
+}
+
+mpu_real_t MpuDev::square(mpu_real_t x) {
+  /*
+   * This function just calculates the square of a number: X^2 = X*X
+   *
+   * Parameters:
+   *      @param x                  --> Number to square
+   *      @return x**2              --> Squared number
+   */
+
+  return x * x;
+
+}
+
+void MpuDev::accelState(mpu_real_t *measurements_ref, mpu_real_t *state_pred, mpu_real_t *accel_cov_funct) {
+  /*
+   * This function calculates the state based on the measurements from the accelerometer.
+   * The prediction is done as follows:
+   *      1) Normalize the measurements (we expect to measure 1g in total)
+   *      [1-1] Low Pass filter the accelerometer measurements (it will be done on the MPU)
+   *      2) Calculate the angles based on the position of the gravity vector
+   *      [3)] Calculate the covariance based on 1) (deleted)
+   * 
+   * Parameters:
+   *      @param *measurements_ref   --> (mpu_real_t) Pointer to the refined measurements array
+   *      @param *state_pred         --> (mpu_real_t) Pointer to the accelerometer state prediction array (it will be overwritten)
+   *      @param *accel_cov_funct    --> (mpu_real_t) Pointer to the accelerometer state prediction covariance value (it will be overwritten)
+   */
+
+  // --- Definitions ---
+  mpu_real_t normalized_values[3]; // temp array for the normalized accel measurements
+  MPU_PROFILE_START(profile_start);
+  
+  // --- Normalization ---
+  normalized_values[2] = sqrt(square(measurements_ref[0]) + square(measurements_ref[1]) + square(measurements_ref[2]));  // temp calculation :)
+  // -- check for error --
+  if (normalized_values[2] == 0) {
+    for (uint8_t i = 0; i < 3; i++){  // If there is an error just return 0 and high covariance
+      normalized_values[i] = 0;
+    }
+    *accel_cov_funct = 1000;
+    MPU_PROFILE_END(MPU_STAGE_ACCEL_STATE, profile_start);
+    return;
+  }
+
+  // -- Covariance calculation --
+  if (normalized_values[2] < 1.0) 
+    *accel_cov_funct = 1 - normalized_values[2];
+  else 
+    *accel_cov_funct = normalized_values[2] - 1;
+
+  *accel_cov_funct = normalized_values[2] + (1 + (10 * *accel_cov_funct * *accel_cov_funct));
+
+
+  /*
+  // -- continue --
+  // covariance calculation
+  if (normalized_values[2] < 1.0) {
+    *accel_cov_funct = accel_covariance / normalized_values[2];
+  } else {
+    *accel_cov_funct = accel_covariance * normalized_values[2];
+  }
+  */
+
+  // -- Normalize values --
+  for (uint8_t i = 0; i < 3; i++) {
+    normalized_values[i] = measurements_ref[i] / normalized_values[2];
+  }
+
+  // --- State calculation ---
+  state_pred[0] = MPU_ATAN2(normalized_values[1], sqrt(square(normalized_values[0]) + square(normalized_values[2])));
+  state_pred[1] = -MPU_ATAN2(normalized_values[0], sqrt(square(normalized_values[1]) + square(normalized_values[2])));
+
+  MPU_PROFILE_END(MPU_STAGE_ACCEL_STATE, profile_start);
+}
+
+mpu_real_t* MpuDev::simplifiedKF(unsigned long current_time) {
+  /*
+   * This function estimates the X and Y angles (State of the system) applying a simplified version of the Kalman filter
+   * To the measurements of the gyro and accel and the previous measurements. The simplification is done first assuming that the z angle is static,
+   * when calculating the covariance it is assumed that the state covariance doesn't contribute significantly to the covariance when a rotation is
+   * applied and that the main acceleration will be produced by gravity. All these approximations are only to reduce the amount of computation needed.
+   *
+   * The Kalman filter goes as follows:
+   *      1) Use the gyro measurements and the previous state estimation to predict the current state and calculate the variance of this prediction.
+   *      2) Use the accelerometer to calculate the state by the position of the gravity vector and the covariance of this calculation.
+   *      3) Calculate the Kalman gain.
+   *      4) Update the prediction in 1 with the new information and update the covariance matrix of the state
+   * 
+   * Parameters:
+   *      @param *current_time      --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @return *state_kalman     --> (mpu_real_t) Pointer to the state array (state = X_angle, Y_angle)
+   */
+
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Get Measurements --
+  getRefinedValues(measurements_funct);
+
+  if (mpu_state_global != MPU_CORRECT) return state;
+
+  return simplifiedKF(current_time, measurements_funct);
+}
+
+mpu_real_t* MpuDev::simplifiedKF(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This function applies the simplified Kalman filter to the given refined measurements (check simplifiedKF(current_time)).
+   * This way the measurements can be obtained once (getRefinedValues(), FIFO, asynchronous reading...) and shared with other estimators.
+   * With MPU_KF_ACCEL_PERIOD > 1 the update is only done every MPU_KF_ACCEL_PERIOD samples with the mean acceleration.
+   * 
+   * Parameters:
+   *      @param *current_time          --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *measurements_funct    --> (mpu_real_t) Pointer to the refined measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return *state_kalman         --> (mpu_real_t) Pointer to the state array (state = X_angle, Y_angle)
+   */
+
+  // --- Initialization ---
+  // -- Definitions --
+  mpu_real_t angular_speed_1[2];    // Array for the current rotated speed
+  mpu_real_t delta_time;            // Time interval since the filter was called
+  mpu_real_t state_accel[2];        // State calculation from the accelerometer values
+  mpu_real_t temp_funct[2];         // Just to hold temporal calculations
+  mpu_real_t accel_cov_funct;       // Covariance of the accelerometer state
+  MPU_PROFILE_START(profile_start);
+
+  // --- Prediction ---
+  // -- Rotate the angular speeds --
+  rotate(measurements_funct, angular_speed_1);
+  // -- Integrate --
+  delta_time = getDeltaTime(current_time, prev_time);
+  integrate(delta_time, angular_speed_1, rotated_ang_speed_prev, temp_funct);
+  state[0] += temp_funct[0];
+  state[1] += temp_funct[1];
+  // -- Covariance --
+  state_covariance[0] += square(delta_time) * gyro_covariance;
+  state_covariance[1] += square(delta_time) * gyro_covariance;
+
+  // --- Innovation ---
+  // -- State calculation with the accelerometer --
+  #if MPU_KF_ACCEL_PERIOD > 1
+    // - Mean acceleration -
+    for (uint8_t i = 0; i < 3; i++) kf_accel_sum[i] += measurements_funct[i];
+    kf_accel_count++;
+    if (kf_accel_count < MPU_KF_ACCEL_PERIOD) {
+      rotated_ang_speed_prev[0] = angular_speed_1[0];
+      rotated_ang_speed_prev[1] = angular_speed_1[1];
+      prev_time = current_time;
+      MPU_PROFILE_END(MPU_STAGE_KF_TOTAL, profile_start);
+      return state;
+    }
+    for (uint8_t i = 0; i < 3; i++) kf_accel_sum[i] /= kf_accel_count;
+
+    accelState(kf_accel_sum, state_accel, &accel_cov_funct);
+    accel_cov_funct /= kf_accel_count;
+
+    // - Restart the mean -
+    for (uint8_t i = 0; i < 3; i++) kf_accel_sum[i] = 0;
+    kf_accel_count = 0;
+  #else
+    accelState(measurements_funct, state_accel, &accel_cov_funct);
+  #endif
+  // -- obtain innovation --
+  state_accel[0] -= state[0];
+  state_accel[1] -= state[1];
+
+  // --- Update ---
+  MPU_PROFILE_START(profile_update);
+  // -- x-axis --
+  temp_funct[0] = state_covariance[0]/(state_covariance[0] + accel_cov_funct);  // Kalman gain
+  state[0] += (temp_funct[0] * state_accel[0]);
+  state_covariance[0] = (1 - temp_funct[0]) * state_covariance[0];
+  // -- y-axis --
+  temp_funct[1] = state_covariance[1]/(state_covariance[1] + accel_cov_funct);  // Kalman gain
+  state[1] += (temp_funct[1] * state_accel[1]);
+  state_covariance[1] = (1 - temp_funct[1]) * state_covariance[1];
+  MPU_PROFILE_END(MPU_STAGE_KF_UPDATE, profile_update);
+
+  // --- Done ---
+  rotated_ang_speed_prev[0] = angular_speed_1[0];
+  rotated_ang_speed_prev[1] = angular_speed_1[1];
+  prev_time = current_time;
+  MPU_PROFILE_END(MPU_STAGE_KF_TOTAL, profile_start);
+  return state;
+}
+
+mpu_real_t* MpuDev::biasKF(unsigned long current_time) {
+  /*
+   * This function estimates the X and Y angles and the bias of the X and Y gyroscopes with a Kalman filter (check biasKF(current_time, 
+   * measurements_funct)).
+   * 
+   * Parameters:
+   *      @param *current_time      --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @return *state_bias_kf    --> (mpu_real_t) Pointer to the state array (X_angle, Y_angle)
+   */
+
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Get Measurements --
+  getRefinedValues(measurements_funct);
+
+  if (mpu_state_global != MPU_CORRECT) return state_bias_kf;
+
+  return biasKF(current_time, measurements_funct);
+}
+
+mpu_real_t* MpuDev::biasKF(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This function estimates the X and Y angles and the bias of the X and Y gyroscopes with the given refined measurements.
+   * Each axis has its own Kalman filter with the states (angle, bias) and the full covariance matrix, so the slow drift of the gyroscopes
+   * (temperature, aging...) is absorbed online instead of needing a new offset correction. The Z gyroscope bias isn't observable with the
+   * accelerometer, so it isn't estimated. The biases are subtracted in the MPU frame and the state transition assumes small tilt angles:
+   *      angle(k) = angle(k-1) + dt * (omega - bias)       bias(k) = bias(k-1)
+   *
+   * The covariance and the gains are updated every MPU_BIAS_KF_GAIN_PERIOD samples with the accumulated time step.
+   * It uses prev_time, so it should be called before simplifiedKF() when both are used with the same sample.
+   * 
+   * Parameters:
+   *      @param *current_time          --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *measurements_funct    --> (mpu_real_t) Pointer to the refined measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return *state_bias_kf        --> (mpu_real_t) Pointer to the state array (X_angle, Y_angle)
+   */
+
+  // --- Initialization ---
+  // -- Definitions --
+  mpu_real_t corrected_funct[6];    // Measurements without the gyroscope bias
+  mpu_real_t angular_speed_1[2];    // Array for the current rotated speed
+  mpu_real_t delta_time;            // Time interval since the filter was called
+  mpu_real_t state_accel[2];        // State calculation from the accelerometer values
+  mpu_real_t integration_result[2]; // This is just to hold the integration results
+  mpu_real_t accel_cov_funct;       // Covariance of the accelerometer state
+  mpu_real_t *p;                    // Covariance of the current axis: P_angle, P_angle_bias, P_bias
+  mpu_real_t innovation_cov;        // Covariance of the innovation
+
+  // -- Remove the bias --
+  for (uint8_t i = 0; i < 6; i++) corrected_funct[i] = measurements_funct[i];
+  corrected_funct[3] -= gyro_bias[0];
+  corrected_funct[4] -= gyro_bias[1];
+
+  // --- Prediction ---
+  // -- Rotate the angular speeds --
+  rotate(corrected_funct, angular_speed_1, state_bias_kf);
+  // -- Integrate --
+  delta_time = getDeltaTime(current_time, prev_time);
+  integrate(delta_time, angular_speed_1, rotated_ang_speed_prev_bias, integration_result);
+  state_bias_kf[0] += integration_result[0];
+  state_bias_kf[1] += integration_result[1];
+
+  // --- Innovation ---
+  // -- State calculation with the accelerometer --
+  accelState(measurements_funct, state_accel, &accel_cov_funct);
+  // -- obtain innovation --
+  state_accel[0] -= state_bias_kf[0];
+  state_accel[1] -= state_bias_kf[1];
+
+  // --- Covariance and gains ---
+  bias_kf_time += delta_time;
+  bias_kf_time_sq += square(delta_time);
+  bias_kf_count++;
+  if (bias_kf_count >= MPU_BIAS_KF_GAIN_PERIOD) {
+    for (uint8_t i = 0; i < 2; i++) {
+      p = bias_kf_covariance[i];
+
+      // -- Prediction: P = F * P * F' + Q --
+      p[0] += bias_kf_time * (bias_kf_time * p[2] - 2 * p[1]) + bias_kf_time_sq * gyro_covariance;
+      p[1] -= bias_kf_time * p[2];
+      p[2] += bias_kf_time * gyro_bias_covariance;
+
+      // -- Kalman gain --
+      innovation_cov = p[0] + accel_cov_funct;
+      bias_kf_gain[i][0] = p[0] / innovation_cov;
+      bias_kf_gain[i][1] = p[1] / innovation_cov;
+
+      // -- Update: P = (I - K * H) * P --
+      p[2] -= bias_kf_gain[i][1] * p[1];
+      p[1] -= bias_kf_gain[i][0] * p[1];
+      p[0] -= bias_kf_gain[i][0] * p[0];
+    }
+    bias_kf_time = 0;
+    bias_kf_time_sq = 0;
+    bias_kf_count = 0;
+  }
+
+  // --- Update ---
+  // The bias is the opposite of the angle drift, so a positive innovation means a lower bias (K_bias is negative)
+  for (uint8_t i = 0; i < 2; i++) {
+    state_bias_kf[i] += bias_kf_gain[i][0] * state_accel[i];
+    gyro_bias[i] += bias_kf_gain[i][1] * state_accel[i];
+  }
+
+  // --- Done ---
+  rotated_ang_speed_prev_bias[0] = angular_speed_1[0];
+  rotated_ang_speed_prev_bias[1] = angular_speed_1[1];
+  return state_bias_kf;
+}
+
+#ifndef MPU_LEAN_PROFILE
+mpu_real_t* MpuDev::testGyroEst(unsigned long current_time) {
+  /*
+   * This function is just to test the gyro estimation.
+   */
+
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Get Measurements --
+  getRefinedValues(measurements_funct);
+
+  if (mpu_state_global != MPU_CORRECT) return state;
+
+  return testGyroEst(current_time, measurements_funct);
+}
+
+mpu_real_t* MpuDev::testGyroEst(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This function is just to test the gyro estimation with the given refined measurements.
+   * It uses prev_time, so it should be called before simplifiedKF() when both are used with the same sample.
+   */
+
+  // --- Initialization ---
+  // -- Definitions --
+  mpu_real_t angular_speed_1[2];    // Array for the current rotated speed
+  mpu_real_t delta_time;            // Time interval since the filter was called
+  mpu_real_t integration_result[2]; // This is just to hold the integration results
+
+  // --- Prediction ---
+  // -- Rotate the angular speeds --
+  angular_speed_1[0] = measurements_funct[3]*cos(state_gyro[0]) + measurements_funct[5]*sin(state_gyro[1]);
+  // -- Rotate w_y --
+  angular_speed_1[1] = measurements_funct[3] * (sin(state_gyro[0]) * sin(state_gyro[1])) + 
+                       measurements_funct[4] * (cos(state_gyro[0])) -
+                       measurements_funct[5] * (sin(state_gyro[0]) * cos(state_gyro[1]));
+  // -- Integrate --
+  delta_time = getDeltaTime(current_time, prev_time);
+  integrate(delta_time, angular_speed_1, rotated_ang_speed_prev_2, integration_result);
+  state_gyro[0] += integration_result[0];
+  state_gyro[1] += integration_result[1];
+  // -- Covariance --
+  state_gyro_cov[0] += square(delta_time) * gyro_covariance;
+  state_gyro_cov[1] = state_gyro_cov[0];
+
+  // --- Done ---
+  rotated_ang_speed_prev_2[0] = angular_speed_1[0];
+  rotated_ang_speed_prev_2[1] = angular_speed_1[1];
+  return state_gyro;
+}
+
+mpu_real_t* MpuDev::testAccelEst(unsigned long current_time) {
+  /*
+   * This is just to test the accelerometer estimation.
+   */
+
+   // -- Definitions --
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Get Measurements --
+  getRefinedValues(measurements_funct);
+
+  if (mpu_state_global != MPU_CORRECT) return state;
+
+  return testAccelEst(current_time, measurements_funct);
+}
+
+mpu_real_t* MpuDev::testAccelEst(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This is just to test the accelerometer estimation with the given refined measurements. The time isn't needed (the state only
+   * depends on the accelerometers), it is kept so it has the same parameters as testGyroEst().
+   */
+  mpu_real_t temp_funct;        // covariance temp value
+  (void)current_time;
+
+  // -- State calculation with the accelerometer --
+  accelState(measurements_funct, state_accel_est, &temp_funct);
+  return state_accel_est;
+}
+#endif  // MPU_LEAN_PROFILE
+
+
+//            **************************
+//            *     MAHONY FILTER      *
+//            **************************
+// Nonlinear complementary filter (Mahony) with a quaternion state. The gyroscope is integrated every sample with only products and sums
+// (the quaternion is renormalized with a first order approximation) and the accelerometer correction, which needs a square root, is done
+// every MPU_MAHONY_ACCEL_PERIOD samples with the mean of the measurements. The angles are only calculated when requested (getMahonyState()).
+
+void MpuDev::rotateQuaternion(mpu_real_t *quaternion_funct, mpu_real_t *angle_funct) {
+  /*
+   * This function rotates the quaternion by a small rotation (q = q + 0.5 * q x (0, angle)) and renormalizes it. The rotation has to be
+   * small (< 0.1 rad) so the first order approximations are valid: the normalization is done with 1/sqrt(x) ~= (3 - x) / 2.
+   *
+   * Parameters:
+   *      @param *quaternion_funct  --> (mpu_real_t) Pointer to the quaternion (W, X, Y, Z), it will be overwritten
+   *      @param *angle_funct       --> (mpu_real_t) Pointer to the rotation vector in the MPU frame (X, Y, Z) in rad
+   */
+
+  mpu_real_t *q = quaternion_funct; // Shorter names for the formulas
+  mpu_real_t half_x = 0.5 * angle_funct[0];
+  mpu_real_t half_y = 0.5 * angle_funct[1];
+  mpu_real_t half_z = 0.5 * angle_funct[2];
+  mpu_real_t q_funct[4];            // Previous quaternion
+  mpu_real_t norm_funct;            // Squared norm of the quaternion
+
+  // --- Rotate ---
+  for (uint8_t i = 0; i < 4; i++) q_funct[i] = q[i];
+  q[0] += -q_funct[1] * half_x - q_funct[2] * half_y - q_funct[3] * half_z;
+  q[1] +=  q_funct[0] * half_x + q_funct[2] * half_z - q_funct[3] * half_y;
+  q[2] +=  q_funct[0] * half_y - q_funct[1] * half_z + q_funct[3] * half_x;
+  q[3] +=  q_funct[0] * half_z + q_funct[1] * half_y - q_funct[2] * half_x;
+
+  // --- Normalize ---
+  norm_funct = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+  norm_funct = 0.5 * (3.0 - norm_funct);
+  for (uint8_t i = 0; i < 4; i++) q[i] *= norm_funct;
+}
+
+mpu_real_t* MpuDev::mahonyFilter(unsigned long current_time) {
+  /*
+   * This function updates the Mahony filter with new measurements (check mahonyFilter(current_time, measurements_funct)).
+   * 
+   * Parameters:
+   *      @param *current_time          --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @return *mahony_quaternion    --> (mpu_real_t) Pointer to the quaternion (W, X, Y, Z)
+   */
+
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Get Measurements --
+  getRefinedValues(measurements_funct);
+
+  if (mpu_state_global != MPU_CORRECT) return mahony_quaternion;
+
+  return mahonyFilter(current_time, measurements_funct);
+}
+
+mpu_real_t* MpuDev::mahonyFilter(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This function updates the Mahony filter with the given refined measurements. It is a cheaper alternative to simplifiedKF():
+   *      1) Integrate the angular speed (minus the estimated bias) into the quaternion.
+   *      2) Every MPU_MAHONY_ACCEL_PERIOD samples, compare the direction of the mean acceleration with the gravity predicted by the
+   *         quaternion. The cross product is the error, which is fed back as a rotation (MPU_MAHONY_KP) and integrated into the bias
+   *         estimation (MPU_MAHONY_KI). If the MPU is accelerating (|a| isn't close to 1g) the correction is skipped.
+   * It uses prev_time, so it should be called before simplifiedKF() when both are used with the same sample.
+   * 
+   * Parameters:
+   *      @param *current_time          --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *measurements_funct    --> (mpu_real_t) Pointer to the refined measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return *mahony_quaternion    --> (mpu_real_t) Pointer to the quaternion (W, X, Y, Z)
+   */
+
+  // --- Initialization ---
+  // -- Definitions --
+  mpu_real_t *q = mahony_quaternion; // Shorter name for the formulas
+  mpu_real_t delta_time;            // Time interval since the filter was called
+  mpu_real_t angle_funct[3];        // Rotation of this step
+  mpu_real_t gravity_funct[3];      // Gravity direction predicted by the quaternion (MPU frame)
+  mpu_real_t error_funct[3];        // Error between the measured and the predicted gravity direction
+  mpu_real_t norm_funct;            // Squared norm of the mean acceleration
+
+  // --- Gyroscope ---
+  delta_time = getDeltaTime(current_time, prev_time);
+  for (uint8_t i = 0; i < 3; i++) {
+    angle_funct[i] = (measurements_funct[i + 3] - mahony_integral[i]) * delta_time;
+    mahony_accel_sum[i] += measurements_funct[i];
+  }
+  rotateQuaternion(q, angle_funct);
+  mahony_time += delta_time;
+  mahony_count++;
+
+  if (mahony_count < MPU_MAHONY_ACCEL_PERIOD) return q;
+
+  // --- Accelerometer ---
+  // -- Check the acceleration --
+  norm_funct = square(mahony_accel_sum[0]) + square(mahony_accel_sum[1]) + square(mahony_accel_sum[2]);
+  if ((norm_funct != 0) && (fabs(norm_funct / square(mahony_count) - 1.0) < MPU_MAHONY_ACCEL_TOLERANCE)) {
+    norm_funct = 1.0 / sqrt(norm_funct);
+
+    // -- Predicted gravity --
+    gravity_funct[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    gravity_funct[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+    gravity_funct[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+    // -- Error (a x g) --
+    error_funct[0] = (mahony_accel_sum[1] * gravity_funct[2] - mahony_accel_sum[2] * gravity_funct[1]) * norm_funct;
+    error_funct[1] = (mahony_accel_sum[2] * gravity_funct[0] - mahony_accel_sum[0] * gravity_funct[2]) * norm_funct;
+    error_funct[2] = (mahony_accel_sum[0] * gravity_funct[1] - mahony_accel_sum[1] * gravity_funct[0]) * norm_funct;
+
+    // -- Feedback --
+    for (uint8_t i = 0; i < 3; i++) {
+      mahony_integral[i] -= MPU_MAHONY_KI * error_funct[i] * mahony_time;
+      angle_funct[i] = MPU_MAHONY_KP * error_funct[i] * mahony_time;
+    }
+    rotateQuaternion(q, angle_funct);
+  }
+
+  // -- Restart the mean --
+  for (uint8_t i = 0; i < 3; i++) mahony_accel_sum[i] = 0;
+  mahony_time = 0;
+  mahony_count = 0;
+
+  return q;
+}
+
+mpu_real_t* MpuDev::getMahonyState() {
+  /*
+   * This function calculates the X and Y angles of the Mahony filter with the same convention as state (check accelState()), using the
+   * gravity direction predicted by the quaternion. It is the only part of the filter with trigonometric functions.
+   * 
+   * Parameters:
+   *      @return *state_mahony     --> (mpu_real_t) Pointer to the state array (state = X_angle, Y_angle)
+   */
+
+  mpu_real_t *q = mahony_quaternion; // Shorter name for the formulas
+  mpu_real_t gravity_funct[3];      // Gravity direction predicted by the quaternion (MPU frame)
+
+  // --- Gravity ---
+  gravity_funct[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+  gravity_funct[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+  gravity_funct[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+  // --- State calculation ---
+  state_mahony[0] = MPU_ATAN2(gravity_funct[1], sqrt(square(gravity_funct[0]) + square(gravity_funct[2])));
+  state_mahony[1] = -MPU_ATAN2(gravity_funct[0], sqrt(square(gravity_funct[1]) + square(gravity_funct[2])));
+
+  return state_mahony;
+}
+
+
+//            ****************************
+//            * FIXED-POINT KALMAN FILTER *
+//            ****************************
+// This is the same filter as simplifiedKF() but using int32_t fixed-point values (Q16.16 unless it is specified otherwise), so it is
+// much faster in boards without FPU (Arduino Nano). The trigonometric functions are approximated with polynomials (error < 1e-4 rad).
+
+#ifdef MPU_FIXED_POINT
+
+mpu_fixed_t MpuDev::fixedMul(mpu_fixed_t a, mpu_fixed_t b) {
+  /*
+   * This function multiplies two Q16.16 values. It can also be used to multiply a Q16.16 value with another format (the result will 
+   * have that format). The result is rounded so the errors don't accumulate in the integrations.
+   *
+   * Parameters:
+   *      @param a                  --> Q16.16 value
+   *      @param b                  --> Q16.16 value (or any other format)
+   *      @return a * b             --> Result (same format as b)
+   */
+
+  return (mpu_fixed_t)((((int64_t)a * b) + (1L << (MPU_FIXED_SHIFT - 1))) >> MPU_FIXED_SHIFT);
+}
+
+uint32_t MpuDev::fixedSqrt(uint32_t x) {
+  /*
+   * This function calculates the integer square root (bit by bit), so sqrt(Qn) will have n/2 fractional bits.
+   *
+   * Parameters:
+   *      @param x                  --> Number
+   *      @return sqrt(x)           --> Square root (rounded down)
+   */
+
+  uint32_t result = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > x) bit >>= 2;
+
+  while (bit != 0) {
+    if (x >= result + bit) {
+      x -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return result;
+}
+
+mpu_fixed_t MpuDev::fixedSin(mpu_fixed_t angle) {
+  /*
+   * This function approximates the sine with a 7th order polynomial in [-pi/2, pi/2] (error < 1e-5). The angle is reduced to that range first.
+   *
+   * Parameters:
+   *      @param angle              --> (Q16.16) Angle in rad
+   *      @return sin(angle)        --> (Q16.16) Sine of the angle
+   */
+
+  // --- Lookup table ---
+  #ifdef MPU_FAST_TRIG
+    return tableSin(fixedMul(angle, MPU_TRIG_FIXED_PHASE_SCALE));
+  #endif
+
+  mpu_fixed_t angle_2;  // Squared angle
+  mpu_fixed_t result;
+
+  // --- Reduce the angle ---
+  angle %= MPU_FIXED_TWO_PI;
+  if (angle > MPU_FIXED_PI) angle -= MPU_FIXED_TWO_PI;
+  else if (angle < -MPU_FIXED_PI) angle += MPU_FIXED_TWO_PI;
+  if (angle > MPU_FIXED_HALF_PI) angle = MPU_FIXED_PI - angle;
+  else if (angle < -MPU_FIXED_HALF_PI) angle = -MPU_FIXED_PI - angle;
+
+  // --- Polynomial ---
+  // sin(x) = x * (1 - 0.16666*x^2 + 0.0083143*x^4 - 0.00018542*x^6)
+  angle_2 = fixedMul(angle, angle);
+  result = -12;
+  result = 545 + fixedMul(angle_2, result);
+  result = -10922 + fixedMul(angle_2, result);
+  result = MPU_FIXED_ONE + fixedMul(angle_2, result);
+  return fixedMul(angle, result);
+}
+
+mpu_fixed_t MpuDev::fixedCos(mpu_fixed_t angle) {
+  /*
+   * This function calculates the cosine as cos(x) = sin(x + pi/2).
+   *
+   * Parameters:
+   *      @param angle              --> (Q16.16) Angle in rad
+   *      @return cos(angle)        --> (Q16.16) Cosine of the angle
+   */
+
+  return fixedSin(angle + MPU_FIXED_HALF_PI);
+}
+
+mpu_fixed_t MpuDev::fixedAtan2(int32_t y, int32_t x) {
+  /*
+   * This function approximates atan2(y, x) with a 9th order polynomial (error < 2e-5 rad).
+   * The inputs only need to have the same scale. They are reduced to 15 bits so only 32 bit divisions are needed.
+   *
+   * Parameters:
+   *      @param y                  --> Y value
+   *      @param x                  --> X value
+   *      @return atan2(y, x)       --> (Q16.16) Angle in rad [-pi, pi]
+   */
+
+  // --- Lookup table ---
+  #ifdef MPU_FAST_TRIG
+    return tableAtan2(y, x);
+  #endif
+
+  uint32_t abs_x = (x < 0) ? -x : x;
+  uint32_t abs_y = (y < 0) ? -y : y;
+  mpu_fixed_t ratio;    // Ratio in [0, 1]
+  mpu_fixed_t ratio_2;  // Squared ratio
+  mpu_fixed_t result;
+
+  if ((abs_x == 0) && (abs_y == 0)) return 0;
+
+  // --- Reduce the inputs ---
+  while ((abs_x | abs_y) >= 0x8000) {
+    abs_x >>= 1;
+    abs_y >>= 1;
+  }
+
+  // --- Polynomial ---
+  // atan(z) = z * (0.999866 - 0.3302995*z^2 + 0.180141*z^4 - 0.085133*z^6 + 0.0208351*z^8) for z in [0, 1]
+  if (abs_x >= abs_y) ratio = ((mpu_fixed_t)abs_y << MPU_FIXED_SHIFT) / abs_x;
+  else ratio = ((mpu_fixed_t)abs_x << MPU_FIXED_SHIFT) / abs_y;
+
+  ratio_2 = fixedMul(ratio, ratio);
+  result = 1365;
+  result = -5579 + fixedMul(ratio_2, result);
+  result = 11806 + fixedMul(ratio_2, result);
+  result = -21647 + fixedMul(ratio_2, result);
+  result = 65527 + fixedMul(ratio_2, result);
+  result = fixedMul(ratio, result);
+
+  // --- Get the quadrant ---
+  if (abs_x < abs_y) result = MPU_FIXED_HALF_PI - result;
+  if (x < 0) result = MPU_FIXED_PI - result;
+  if (y < 0) result = -result;
+
+  return result;
+}
+
+void MpuDev::refineValuesFixed(int16_t *raw_values, mpu_fixed_t *measurements_funct) {
+  /* This function refines the given raw accelerometer and gyroscope measurements in fixed-point (check refineValues()).
+   * 
+   * Parameters:
+   *      @param *raw_values              --> (int16_t) pointer to the raw measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @param *measurements_funct      --> (Q16.16) pointer to an array for the measurements with the same order (g and rad/s).
+   */
+
+  // --- Refine values ---
+  for (uint8_t i = 0; i < 6; i++) {
+    // -- Offset correction --
+    int32_t value_funct = (int32_t)raw_values[i] - offset_correction[i];
+
+    // -- Obtain magnitudes --
+    // The scales are Q8.24, so the result is shifted to Q16.16 (the product fits in 31 bits)
+    if (i < 3) measurements_funct[i] = (value_funct * working_accel_scale_fixed) >> 8;  // Accelerations
+    else       measurements_funct[i] = (value_funct * working_gyro_scale_fixed) >> 8;   // Gyroscopes
+  }
+}
+
+void MpuDev::rotateFixed(mpu_fixed_t *measurements_ref, mpu_fixed_t *rotated_values) {
+  /*
+   * This function rotates the current angular speed measurement from the IMU reference to the global one in fixed-point (check rotate()).
+   *
+   * Parameters:
+   *      @param *measurements_ref   --> (Q16.16) Pointer to the refined measurements array
+   *      @param *rotated_values     --> (Q16.16) Pointer to the rotated angular speed array
+   */
+
+  // --- Trigonometric values ---
+  mpu_fixed_t sin_0 = fixedSin(state_fixed[0]);
+  mpu_fixed_t cos_0 = fixedCos(state_fixed[0]);
+  mpu_fixed_t sin_1 = fixedSin(state_fixed[1]);
+  mpu_fixed_t cos_1 = fixedCos(state_fixed[1]);
+
+  // --- Rotation ---
+  // -- Rotate w_x --
+  rotated_values[0] = fixedMul(measurements_ref[3], cos_0) + fixedMul(measurements_ref[5], sin_1);
+  // -- Rotate w_y --
+  rotated_values[1] = fixedMul(measurements_ref[3], fixedMul(sin_0, sin_1)) +
+                      fixedMul(measurements_ref[4], cos_0) -
+                      fixedMul(measurements_ref[5], fixedMul(sin_0, cos_1));
+}
+
+void MpuDev::accelStateFixed(mpu_fixed_t *measurements_ref, mpu_fixed_t *state_pred, mpu_fixed_t *accel_cov_funct) {
+  /*
+   * This function calculates the state based on the measurements from the accelerometer in fixed-point (check accelState()).
+   * The accelerations are shifted to fit in 15 bits so the squares of the three components can be added in 32 bits with the best
+   * resolution possible. The atan2 doesn't need the values to be normalized.
+   * 
+   * Parameters:
+   *      @param *measurements_ref   --> (Q16.16) Pointer to the refined measurements array
+   *      @param *state_pred         --> (Q16.16) Pointer to the accelerometer state prediction array (it will be overwritten)
+   *      @param *accel_cov_funct    --> (Q8.24) Pointer to the accelerometer state prediction covariance value (it will be overwritten)
+   */
+
+  // --- Definitions ---
+  int32_t accel_funct[3];  // Shifted accelerations
+  uint32_t squares[3];     // Squared accelerations
+  uint32_t max_funct = 0;  // Maximum absolute value of the accelerations
+  uint8_t shift = 0;       // Shift applied to the accelerations
+  mpu_fixed_t norm;        // Norm of the acceleration in Q16.16
+  mpu_fixed_t difference;  // Difference between the norm and 1g
+
+  // --- Scale the values ---
+  for (uint8_t i = 0; i < 3; i++) max_funct |= (measurements_ref[i] < 0) ? -measurements_ref[i] : measurements_ref[i];
+  while ((max_funct >> shift) >= 0x8000) shift++;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    accel_funct[i] = measurements_ref[i] >> shift;
+    squares[i] = (uint32_t)(accel_funct[i] * accel_funct[i]);
+  }
+
+  // --- Normalization ---
+  norm = (mpu_fixed_t)fixedSqrt(squares[0] + squares[1] + squares[2]) << shift;
+  // -- check for error --
+  if (norm == 0) {  // If there is an error return the current state and high covariance
+    state_pred[0] = state_fixed[0];
+    state_pred[1] = state_fixed[1];
+    *accel_cov_funct = MPU_FIXED_COV_MAX;
+    return;
+  }
+
+  // -- Covariance calculation --
+  difference = (norm < MPU_FIXED_ONE) ? (MPU_FIXED_ONE - norm) : (norm - MPU_FIXED_ONE);
+  norm = norm + MPU_FIXED_ONE + (10 * fixedMul(difference, difference));
+  *accel_cov_funct = (norm < (MPU_FIXED_COV_MAX >> 8)) ? (norm << 8) : MPU_FIXED_COV_MAX;
+
+  // --- State calculation ---
+  state_pred[0] = fixedAtan2(accel_funct[1], fixedSqrt(squares[0] + squares[2]));
+  state_pred[1] = -fixedAtan2(accel_funct[0], fixedSqrt(squares[1] + squares[2]));
+}
+
+mpu_fixed_t* MpuDev::simplifiedKFFixed(unsigned long current_time, int16_t *raw_values) {
+  /*
+   * This function is the fixed-point version of simplifiedKF(), the same steps and simplifications are used. It takes the raw measurements
+   * so no floating point operation is done. getFixedState() can be used to compare the result with the one of simplifiedKF().
+   * The only 64 bit divisions are the ones of the Kalman gains.
+   * 
+   * Parameters:
+   *      @param current_time       --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *raw_values        --> (int16_t) Pointer to the raw measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return *state_fixed      --> (Q16.16) Pointer to the state array (state = X_angle, Y_angle)
+   */
+
+  // --- Initialization ---
+  // -- Definitions --
+  mpu_fixed_t measurements_funct[6];  // Array for the refined measurements
+  mpu_fixed_t angular_speed_1[2];     // Array for the current rotated speed
+  mpu_fixed_t delta_time;             // Time interval since the filter was called in s (Q8.24)
+  mpu_fixed_t state_accel[2];         // State calculation from the accelerometer values
+  mpu_fixed_t accel_cov_funct;        // Covariance of the accelerometer state (Q8.24)
+  mpu_fixed_t gain;                   // Kalman gain (Q8.24)
+
+  // -- Get Measurements --
+  refineValuesFixed(raw_values, measurements_funct);
+
+  // --- Prediction ---
+  // -- Rotate the angular speeds --
+  rotateFixed(measurements_funct, angular_speed_1);
+  // -- Integrate --
+  // The time is Q8.24 so the resolution is good enough at 1kHz (delta_time * angular_speed is Q40, shifted 25 bits to also divide by 2)
+  delta_time = getDeltaTimeFixed(current_time, prev_time_fixed);
+  state_fixed[0] += (mpu_fixed_t)((((int64_t)delta_time * (angular_speed_1[0] + rotated_ang_speed_prev_fixed[0])) + (1L << 24)) >> 25);
+  state_fixed[1] += (mpu_fixed_t)((((int64_t)delta_time * (angular_speed_1[1] + rotated_ang_speed_prev_fixed[1])) + (1L << 24)) >> 25);
+  // -- Covariance --
+  // delta_time^2 is Q48 and gyro_covariance_fixed Q16, so it is shifted 34 bits to obtain Q30 (it fits in 64 bits with the maximum time step)
+  state_covariance_fixed[0] += (mpu_fixed_t)((((int64_t)delta_time * delta_time) * gyro_covariance_fixed) >> 34);
+  if (state_covariance_fixed[0] < 0) state_covariance_fixed[0] = MPU_FIXED_COV_MAX;  // Saturate
+  state_covariance_fixed[1] += (mpu_fixed_t)((((int64_t)delta_time * delta_time) * gyro_covariance_fixed) >> 34);
+  if (state_covariance_fixed[1] < 0) state_covariance_fixed[1] = MPU_FIXED_COV_MAX;  // Saturate
+
+  // --- Innovation ---
+  // -- State calculation with the accelerometer --
+  accelStateFixed(measurements_funct, state_accel, &accel_cov_funct);
+  // -- obtain innovation --
+  state_accel[0] -= state_fixed[0];
+  state_accel[1] -= state_fixed[1];
+
+  // --- Update ---
+  // The gains are very small at high sample rates, so they are calculated in Q8.24
+  // -- x-axis --
+  gain = (mpu_fixed_t)(((int64_t)state_covariance_fixed[0] << 24) / 
+                       (state_covariance_fixed[0] + ((int64_t)accel_cov_funct << 6)));  // Kalman gain
+  state_fixed[0] += (mpu_fixed_t)((((int64_t)gain * state_accel[0]) + (1L << 23)) >> 24);
+  state_covariance_fixed[0] -= (mpu_fixed_t)((((int64_t)gain * state_covariance_fixed[0]) + (1L << 23)) >> 24);
+  // -- y-axis --
+  gain = (mpu_fixed_t)(((int64_t)state_covariance_fixed[1] << 24) / 
+                       (state_covariance_fixed[1] + ((int64_t)accel_cov_funct << 6)));  // Kalman gain
+  state_fixed[1] += (mpu_fixed_t)((((int64_t)gain * state_accel[1]) + (1L << 23)) >> 24);
+  state_covariance_fixed[1] -= (mpu_fixed_t)((((int64_t)gain * state_covariance_fixed[1]) + (1L << 23)) >> 24);
+
+  // --- Done ---
+  rotated_ang_speed_prev_fixed[0] = angular_speed_1[0];
+  rotated_ang_speed_prev_fixed[1] = angular_speed_1[1];
+  prev_time_fixed = current_time;
+  return state_fixed;
+}
+
+void MpuDev::getFixedState(mpu_real_t *state_funct) {
+  /*
+   * This function converts the state of the fixed-point Kalman filter to rad, so it can be compared with the one of simplifiedKF().
+   *
+   * Parameters:
+   *      @param *state_funct       --> (mpu_real_t) Pointer to an array for the state (X_angle, Y_angle) in rad
+   */
+
+  state_funct[0] = (mpu_real_t)state_fixed[0] / MPU_FIXED_ONE;
+  state_funct[1] = (mpu_real_t)state_fixed[1] / MPU_FIXED_ONE;
+}
+
+#endif
+
+//            **************************
+//            *       PROFILING        *
+//            **************************
+// The stages are timed with micros() (4 us resolution in the Arduino Nano), so they add about 10 us per stage. The data is only stored,
+// so it can be sent whenever the timing isn't critical.
+
+#ifdef MPU_PROFILING
+
+void MpuDev::profileStage(uint8_t stage, unsigned long start_time) {
+  /*
+   * This function adds the time since start_time to the statistics of the stage.
+   *
+   * Parameters:
+   *      @param stage              --> (uint8_t) Stage of the pipeline (MPU_STAGE_*)
+   *      @param start_time         --> (unsigned long) micros() when the stage started
+   */
+
+  unsigned long elapsed_funct = micros() - start_time;
+  MpuStageStats *stats_funct = &profile.stages[stage];
+
+  if (elapsed_funct > 0xFFFF) elapsed_funct = 0xFFFF;  // Saturate
+
+  // --- Update the statistics ---
+  if ((stats_funct->count == 0) || (elapsed_funct < stats_funct->min_us)) stats_funct->min_us = elapsed_funct;
+  if (elapsed_funct > stats_funct->max_us) stats_funct->max_us = elapsed_funct;
+  stats_funct->total_us += elapsed_funct;
+  stats_funct->count++;
+}
+
+void MpuDev::getProfile(MpuProfile *profile_funct) {
+  /*
+   * This function copies the profiling data. The interrupts are disabled during the copy so the values are consistent.
+   *
+   * Parameters:
+   *      @param *profile_funct     --> (MpuProfile) Pointer to the structure where the data will be copied
+   */
+
+  noInterrupts();
+  *profile_funct = profile;
+  profile_funct->overruns = dropped_samples - profile_dropped_base;  // Since the last resetProfile() (the wrap around is handled)
+  interrupts();
+}
+
+void MpuDev::resetProfile() {
+  /*
+   * This function clears the profiling data. dropped_samples isn't changed, the overruns are counted from its current value.
+   */
+
+  noInterrupts();
+  memset(&profile, 0, sizeof(profile));
+  profile_dropped_base = dropped_samples;
+  interrupts();
+}
+
+#endif  // MPU_PROFILING
+
+
+//            **************************
+//            *         TIMING         *
+//            **************************
+// The estimators use the time stamps given to them (time_buffer), which depend on MPU_TIMING_MODE. With MPU_TIMING_FIXED the time stamp 
+// is the sample sequence number, so dt doesn't have any jitter and the samples that weren't read (dropped_samples) are still counted.
+
+void MpuDev::dataReadyInterrupt() {
+  /*
+   * This function should be called by the data ready interrupt routine (pin INT of the MPU). It counts the samples, records
+   * the time stamp of the sample in time_buffer and sets mpu_data_ready.
+   * If mpu_data_ready is still set, the previous sample hasn't been read and it has been overwritten (dropped_samples).
+   *
+   * Parameters:
+   *      NA        --> This function doesn't require or return any parameter
+   */
+
+  // --- Count the samples ---
+  sample_sequence++;
+  if (mpu_data_ready) dropped_samples++;
+
+  // --- Time stamp ---
+  #if MPU_TIMING_MODE == MPU_TIMING_FIXED
+    time_buffer = sample_sequence;
+  #else
+    time_buffer = MPU_TIME_NOW();
+  #endif
+
+  mpu_data_ready = true;
+}
+
+mpu_real_t MpuDev::getDeltaTime(unsigned long current_time, unsigned long previous_time) {
+  /*
+   * This function calculates the time between two time stamps. The subtraction is done with unsigned values, so the wrap around of
+   * millis(), micros() or the sample sequence is handled.
+   *
+   * Parameters:
+   *      @param current_time       --> (unsigned long) Current time stamp (see MPU_TIMING_MODE)
+   *      @param previous_time      --> (unsigned long) Previous time stamp
+   *      @return delta_time        --> (mpu_real_t) Time in s
+   */
+
+  #if MPU_TIMING_MODE == MPU_TIMING_FIXED
+    return (mpu_real_t)(current_time - previous_time) * working_sample_period;
+  #else
+    return (mpu_real_t)(current_time - previous_time) / MPU_TIME_UNITS_PER_SECOND;
+  #endif
+}
+
+#ifdef MPU_FIXED_POINT
+mpu_fixed_t MpuDev::getDeltaTimeFixed(unsigned long current_time, unsigned long previous_time) {
+  /*
+   * This function calculates the time between two time stamps in fixed-point. It is saturated to MPU_FIXED_MAX_DELTA_TIME to avoid overflows.
+   *
+   * Parameters:
+   *      @param current_time       --> (unsigned long) Current time stamp (see MPU_TIMING_MODE)
+   *      @param previous_time      --> (unsigned long) Previous time stamp
+   *      @return delta_time        --> (Q8.24) Time in s
+   */
+
+  unsigned long delta_funct = current_time - previous_time;
+  const mpu_fixed_t max_delta_funct = ((mpu_fixed_t)MPU_FIXED_MAX_DELTA_TIME << 24) / 1000;
+
+  #if MPU_TIMING_MODE == MPU_TIMING_FIXED
+    if (delta_funct > (unsigned long)(max_delta_funct / working_sample_period_fixed)) return max_delta_funct;
+    return (mpu_fixed_t)delta_funct * working_sample_period_fixed;
+  #elif MPU_TIMING_MODE == MPU_TIMING_MICROS
+    if (delta_funct > MPU_FIXED_MAX_DELTA_TIME * 1000UL) return max_delta_funct;
+    return (mpu_fixed_t)((((int64_t)delta_funct << 24) + 500000) / 1000000);
+  #else
+    if (delta_funct > MPU_FIXED_MAX_DELTA_TIME) return max_delta_funct;
+    return (((mpu_fixed_t)delta_funct << 24) + 500) / 1000;
+  #endif
+}
+#endif
+
+//            **************************
+//            *       ESTIMATORS       *
+//            **************************
+
+bool MpuDev::updateEstimators(unsigned long current_time) {
+  /*
+   * This function reads one sample from the MPU and updates all the estimators enabled in enabled_estimators with it.
+   * This way the MPU is read only once per sample and all the estimators use the same measurements.
+   *
+   * Parameters:
+   *      @param current_time       --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @return status            --> (bool) true if the measurements were read correctly
+   */
+
+  int16_t raw_values[6];            // Array for the raw measurements
+
+  // -- Get Measurements --
+  getParameter6(raw_values);
+
+  if (mpu_state_global != MPU_CORRECT) return false;
+
+  return updateEstimators(current_time, raw_values);
+}
+
+bool MpuDev::updateEstimators(unsigned long current_time, int16_t *raw_values) {
+  /*
+   * This function updates all the estimators enabled in enabled_estimators with the given raw measurements (e.g. from the FIFO or the
+   * sample buffer). The fixed-point filter uses them directly and the rest use the refined values.
+   *
+   * Parameters:
+   *      @param current_time       --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *raw_values        --> (int16_t) Pointer to the raw measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return status            --> (bool) true if the MPU is working correctly (false while the background self-test is running)
+   * With MPU_PREFILTER the sample goes through the pre-filter (raw_values is modified) and only the decimated ones update the estimators.
+   * With MPU_TEMP_COMPENSATION the gyroscope offset correction follows temperature_raw (updated by the measurement readings, the
+   * asynchronous ones and MpuScheduler::readAll(), and once per readFifoFrames()).
+   */
+
+  mpu_real_t measurements_funct[6]; // Array for the refined measurements
+
+  // -- Background self-test --
+  // The measurements have the self-test full-scale ranges (selfTestStep())
+  if (self_test_state == MPU_SELF_TEST_RUNNING) return false;
+
+  // -- Health monitor --
+  #ifdef MPU_HEALTH_MONITOR
+    monitorSample(raw_values);
+  #endif
+
+  // -- Pre-filter --
+  // Only the decimated samples update the estimators (raw_values is replaced by the filtered sample)
+  #ifdef MPU_PREFILTER
+    if (!prefilterSample(raw_values)) return true;
+  #endif
+
+  // -- Temperature compensation --
+  // Only interpolated when the temperature has changed (MPU_TEMP_COMP_HYSTERESIS)
+  #ifdef MPU_TEMP_COMPENSATION
+    updateTemperatureCompensation(temperature_raw);
+  #endif
+
+  // -- Bias tracking --
+  #ifdef MPU_BIAS_TRACKING
+    trackGyroBias(raw_values);
+  #endif
+
+  // -- Fixed-point --
+  // It uses the raw values so no floating point operation is needed
+  #ifdef MPU_FIXED_POINT
+    if (enabled_estimators & MPU_ESTIMATOR_KF_FIXED) simplifiedKFFixed(current_time, raw_values);
+    if (!(enabled_estimators & ~MPU_ESTIMATOR_KF_FIXED)) return true;  // No other estimator
+  #endif
+
+  // -- Refine --
+  refineValues(raw_values, measurements_funct);
+
+  return updateEstimators(current_time, measurements_funct);
+}
+
+bool MpuDev::updateEstimators(unsigned long current_time, mpu_real_t *measurements_funct) {
+  /*
+   * This function updates all the estimators enabled in enabled_estimators with the given refined measurements.
+   * The fixed-point Kalman filter needs the raw measurements, so it is only updated by updateEstimators(current_time).
+   * The estimators will be updated in this order: gyroscope, accelerometer, bias Kalman filter, Mahony filter and Kalman filter, since the
+   * Kalman filter updates prev_time. The results are stored in state_gyro, state_accel_est, state_bias_kf (and gyro_bias), 
+   * mahony_quaternion and state respectively.
+   *
+   * Parameters:
+   *      @param current_time           --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   *      @param *measurements_funct    --> (mpu_real_t) Pointer to the refined measurements array: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return status                --> (bool) true if the MPU is working correctly
+   */
+
+  // --- Update the estimators ---
+  #ifndef MPU_LEAN_PROFILE
+    if (enabled_estimators & MPU_ESTIMATOR_GYRO)  testGyroEst(current_time, measurements_funct);
+    if (enabled_estimators & MPU_ESTIMATOR_ACCEL) testAccelEst(current_time, measurements_funct);
+  #endif
+  if (enabled_estimators & MPU_ESTIMATOR_KF_BIAS) biasKF(current_time, measurements_funct);
+  if (enabled_estimators & MPU_ESTIMATOR_MAHONY) mahonyFilter(current_time, measurements_funct);
+  if (enabled_estimators & MPU_ESTIMATOR_KF) {
+    simplifiedKF(current_time, measurements_funct);
+  } else {
+    prev_time = current_time;  // This is done by the Kalman filter
+  }
+
+  return (mpu_state_global == MPU_CORRECT);
+}
+
+void MpuDev::initializeMeasurements() {
+  /*
+   * This function resets the data to start with the estimations from the origin.
+   *
+   * Parameters:
+   *      @param initial_time     --> (unsigned long) time stamp of the measurements (time_buffer, see MPU_TIMING_MODE)
+   */
+
+  mpu_data_ready = false;
+
+  while (!mpu_data_ready) {
+    // Just wait
+  }
+
+  resetSignalPath();
 
   mpu_data_ready = false;
 
@@ -1604,4 +5032,655 @@ void MpuDev::initializeMeasurements() {
   }
 
   prev_time = time_buffer;
-}
\ No newline at end of file
+  #ifdef MPU_FIXED_POINT
+    prev_time_fixed = time_buffer;
+  #endif
+}
+
+
+//            **************************
+//            *       SCHEDULER        *
+//            **************************
+
+bool MpuScheduler::addDevice(MpuDev *device) {
+  /* This function adds an MPU to the scheduler. The MPUs will be read in the same order they are added.
+   *
+   * Parameters:
+   *      @param *device            --> (MpuDev) Pointer to the MPU (it must be already initialized)
+   *      @return status            --> (bool) false if there are already MPU_SCHEDULER_MAX_DEVICES MPUs
+   */
+
+  if (device_count >= MPU_SCHEDULER_MAX_DEVICES) return false;
+
+  devices[device_count] = device;
+  device_count++;
+
+  return true;
+}
+
+bool MpuScheduler::readAll(int16_t *values_funct) {
+  /* This function reads the accelerometer and gyroscope measurements of all the MPUs in one bus session: the register address of
+   * each MPU is written and its MPU_MEASUREMENTS_LENGTH registers (with the interrupt status) read with repeated starts, and the STOP is only sent after the last one. So the bus
+   * isn't released between the MPUs and the skew between them is just the transfer time (about 400 us per MPU at 400 kHz).
+   * There are no retries, the MPUs that fail are set to MPU_I2C_ERROR and their values to zero.
+   *
+   * Parameters:
+   *      @param *values_funct      --> (int16_t) Pointer to an array of 6 values per MPU: A_X, A_Y, A_Z, G_X, G_Y, G_Z.
+   *      @return status            --> (bool) true if all the MPUs have been read
+   */
+
+  uint8_t buffer_funct[MPU_MEASUREMENTS_LENGTH];  // Raw data from the registers
+  bool correct_funct = true;        // All the readings are correct
+  bool read_funct;                  // The reading of the current MPU is correct
+  bool last_funct;                  // Last MPU of the session (it sends the STOP)
+  unsigned long start_time_funct;   // Time stamp of the first reading
+
+  // --- Check the bus ---
+  // The bus may be used by an asynchronous reading
+  for (uint8_t i = 0; i < device_count; i++) {
+    if (devices[i]->async_state != MPU_ASYNC_IDLE) return false;
+  }
+
+  start_time_funct = micros();
+
+  for (uint8_t i = 0; i < device_count; i++) {
+    last_funct = (i == (device_count - 1));
+
+    // -- Set the first register --
+    Wire.beginTransmission(devices[i]->i2c_address);
+    Wire.write(MPU_MEASUREMENTS_ADDR);
+    read_funct = (Wire.endTransmission(false) == 0);
+
+    // -- Read (repeated start) --
+    if (read_funct) read_funct = (Wire.requestFrom(devices[i]->i2c_address, (uint8_t)MPU_MEASUREMENTS_LENGTH, (uint8_t)last_funct) == MPU_MEASUREMENTS_LENGTH);
+    for (uint8_t j = 0; j < MPU_MEASUREMENTS_LENGTH; j++) buffer_funct[j] = read_funct ? Wire.read() : 0;
+
+    // -- Convert data --
+    // The temperature (buffer_funct[7] and buffer_funct[8]) is stored in temperature_raw (updateEstimators())
+    int16_t *device_values = values_funct + (i * 6);
+    device_values[0] = (buffer_funct[ 1] << 8) | (buffer_funct[ 2]);
+    device_values[1] = (buffer_funct[ 3] << 8) | (buffer_funct[ 4]);
+    device_values[2] = (buffer_funct[ 5] << 8) | (buffer_funct[ 6]);
+    device_values[3] = (buffer_funct[ 9] << 8) | (buffer_funct[10]);
+    device_values[4] = (buffer_funct[11] << 8) | (buffer_funct[12]);
+    device_values[5] = (buffer_funct[13] << 8) | (buffer_funct[14]);
+    if (read_funct) {
+      devices[i]->temperature_raw = (buffer_funct[7] << 8) | (buffer_funct[8]);
+      devices[i]->interrupt_status |= buffer_funct[0];
+    }
+
+    // -- Communication error --
+    if (!read_funct) {
+      devices[i]->mpu_state_global = MPU_I2C_ERROR;
+      correct_funct = false;
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.print(F("I2C_Error (*.*) scheduler reading "));
+        Serial.println(devices[i]->i2c_address, HEX);
+      #endif
+    }
+  }
+
+  read_skew = micros() - start_time_funct;
+
+  // --- Release the bus ---
+  // If the last reading failed the STOP may have not been sent
+  if (!read_funct && (device_count > 0)) {
+    Wire.beginTransmission(devices[device_count - 1]->i2c_address);
+    Wire.endTransmission(true);
+  }
+
+  return correct_funct;
+}
+
+uint8_t MpuScheduler::update() {
+  /* This function waits until all the MPUs have a sample ready (mpu_data_ready), reads them in one bus session (readAll()) and updates
+   * their estimators with their own time stamps (time_buffer). It doesn't block, so it has to be called periodically (e.g. in loop()).
+   * The MPUs should be configured with the same sample rate, otherwise the fastest ones will drop samples.
+   *
+   * Parameters:
+   *      @return devices           --> (uint8_t) Number of MPUs updated (0 if the samples aren't ready yet)
+   */
+
+  int16_t values_funct[MPU_SCHEDULER_MAX_DEVICES * 6];   // Measurements of all the MPUs
+  unsigned long times_funct[MPU_SCHEDULER_MAX_DEVICES];  // Time stamps of the samples
+  uint8_t updated_funct = 0;                             // MPUs updated
+
+  // --- Check the samples ---
+  for (uint8_t i = 0; i < device_count; i++) {
+    if (!devices[i]->mpu_data_ready) return 0;
+  }
+
+  // --- Get the time stamps ---
+  for (uint8_t i = 0; i < device_count; i++) {
+    times_funct[i] = devices[i]->time_buffer;
+    devices[i]->mpu_data_ready = false;
+  }
+
+  // --- Read ---
+  readAll(values_funct);
+
+  // --- Update the estimators ---
+  for (uint8_t i = 0; i < device_count; i++) {
+    if (devices[i]->mpu_state_global != MPU_CORRECT) continue;
+    devices[i]->updateEstimators(times_funct[i], values_funct + (i * 6));
+    updated_funct++;
+  }
+
+  return updated_funct;
+}
+
+
+//            **************************
+//            *     HEALTH MONITOR     *
+//            **************************
+
+#ifdef MPU_HEALTH_MONITOR
+
+void MpuDev::monitorSample(int16_t *raw_values) {
+  /* This function checks a raw sample for the health monitor (it is called by getRefinedValues() and updateEstimators()):
+   *      -) Frozen data: the noise changes the measurements every sample, so MPU_HEALTH_FROZEN_SAMPLES identical samples mean that the
+   *         registers aren't being updated (or the bus returns the same bytes).
+   *      -) Saturation: 0x7FFF or 0x8000 in any axis. A hit can saturate some samples, so it is only a fault after
+   *         MPU_HEALTH_SATURATED_SAMPLES in a row.
+   * The fault is handled by updateHealth(), so this function only takes some comparisons.
+   *
+   * Parameters:
+   *      @param *raw_values        --> (int16_t) Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
+   */
+
+  bool same_funct = true;                                 // The sample is identical to the previous one
+  bool saturated_funct = false;                           // An axis is saturated
+
+  for (uint8_t i = 0; i < 6; i++) {
+    if (raw_values[i] != health_last_sample[i]) same_funct = false;
+    if ((raw_values[i] == INT16_MAX) || (raw_values[i] == INT16_MIN)) saturated_funct = true;
+    health_last_sample[i] = raw_values[i];
+  }
+
+  // --- Frozen data ---
+  if (!same_funct) health_frozen_count = 0;
+  else if (++health_frozen_count >= MPU_HEALTH_FROZEN_SAMPLES) health_pending_fault = MPU_FAULT_FROZEN;
+
+  // --- Saturation ---
+  if (!saturated_funct) {
+    health_saturated_count = 0;
+    return;
+  }
+  health_stats.saturated_samples++;
+  if (++health_saturated_count >= MPU_HEALTH_SATURATED_SAMPLES) health_pending_fault = MPU_FAULT_SATURATED;
+}
+
+bool MpuDev::recoverBus() {
+  /* This function releases the I2C bus when a slave holds SDA low (e.g. it lost some SCL edges in the middle of a byte after some EMI):
+   *      1) The I2C peripheral is disabled and the pins are released (pull-up).
+   *      2) Up to MPU_HEALTH_CLOCK_PULSES pulses are sent on SCL until the slave releases SDA (it finishes the byte and the ACK).
+   *      3) A STOP condition is sent (SDA rises while SCL is high) and the I2C is started again.
+   * The pins are driven as open drain (low or input with pull-up). It takes less than 200us.
+   *
+   * Parameters:
+   *      @return stuck             --> (bool) true if SDA was stuck low
+   */
+
+  bool stuck_funct;
+
+  // --- Release the pins ---
+  Wire.end();
+  pinMode(MPU_SDA_PIN, INPUT_PULLUP);
+  pinMode(MPU_SCL_PIN, INPUT_PULLUP);
+  delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+  stuck_funct = (digitalRead(MPU_SDA_PIN) == LOW);
+
+  // --- Clock-out ---
+  for (uint8_t i = 0; (i < MPU_HEALTH_CLOCK_PULSES) && (digitalRead(MPU_SDA_PIN) == LOW); i++) {
+    digitalWrite(MPU_SCL_PIN, LOW);   // The pull-up is disabled before driving the pin
+    pinMode(MPU_SCL_PIN, OUTPUT);
+    delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+    pinMode(MPU_SCL_PIN, INPUT_PULLUP);
+    delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+  }
+
+  // --- STOP ---
+  digitalWrite(MPU_SCL_PIN, LOW);
+  pinMode(MPU_SCL_PIN, OUTPUT);
+  digitalWrite(MPU_SDA_PIN, LOW);
+  pinMode(MPU_SDA_PIN, OUTPUT);
+  delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+  pinMode(MPU_SCL_PIN, INPUT_PULLUP);
+  delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+  pinMode(MPU_SDA_PIN, INPUT_PULLUP);
+  delayMicroseconds(MPU_HEALTH_HALF_PERIOD);
+
+  // --- Start the I2C ---
+  Wire.begin();
+  #ifdef I2C_CONFIGURE_MPU
+    Wire.setClock(I2C_CLK_SPEED);
+  #endif
+  #ifdef WIRE_HAS_TIMEOUT
+    Wire.setWireTimeout(MPU_HEALTH_WIRE_TIMEOUT, true);
+    Wire.clearWireTimeoutFlag();
+  #endif
+
+  return stuck_funct;
+}
+
+uint8_t MpuDev::updateHealth() {
+  /* This function detects the faults of the MPU and recovers it without blocking, so it has to be called periodically (e.g. in loop()).
+   * The faults are:
+   *      -) I2C error: mpu_state_global is MPU_I2C_ERROR (readMpuRegisters() failed after I2C_MPU_RETRIES) or a Wire transfer timed out
+   *         (WIRE_HAS_TIMEOUT, MPU_HEALTH_WIRE_TIMEOUT), so a stuck bus is detected even if the reading doesn't fail.
+   *      -) Frozen or saturated data (monitorSample()).
+   *      -) Timeout: no data ready interrupts (sample_sequence) for MPU_HEALTH_DATA_TIMEOUT in MPU_POWER_ACTIVE. It is only checked after
+   *         the first interrupt, so it can't be detected if the interrupts aren't used.
+   * The recovery is done in steps, each one of them takes less than a few ms:
+   *      1) MPU_HEALTH_BUS_RECOVERY: the I2C bus is released (recoverBus()) and the MPU is reset (DEVICE_RESET).
+   *      2) MPU_HEALTH_RESETTING: after MPU_HEALTH_RESET_TIME the MPU is initialized with the calibration record (initializeFast(), with
+   *         MPU_DMP_MODE the firmware is loaded again, so it takes longer), the FIFO sensors (enableFifo()) and the power state from
+   *         before the fault are restored (setPowerState(), MPU_POWER_WAKING is restored as MPU_POWER_ACTIVE). If it fails, it is
+   *         retried after MPU_HEALTH_RETRY_TIME.
+   * The samples aren't valid while the MPU is being recovered (mpu_state_global isn't MPU_CORRECT). At the end prev_time is updated, so
+   * the estimators skip the time of the recovery.
+   *
+   * Parameters:
+   *      @return health_state      --> (uint8_t) State of the health monitor (MPU_HEALTH_OK if the MPU is working)
+   */
+
+  unsigned long time_funct = millis();
+  uint8_t fault_funct = MPU_FAULT_NONE;
+
+  switch (health_state) {
+    // --- Detection ---
+    case MPU_HEALTH_OK:
+      // -- Data timeout --
+      if ((sample_sequence != health_last_sequence) || (power_state != MPU_POWER_ACTIVE)) {
+        health_last_sequence = sample_sequence;
+        health_sequence_time = time_funct;
+      }
+      else if ((health_last_sequence != 0) && ((time_funct - health_sequence_time) > MPU_HEALTH_DATA_TIMEOUT)) {
+        fault_funct = MPU_FAULT_TIMEOUT;
+      }
+
+      if (mpu_state_global == MPU_I2C_ERROR) fault_funct = MPU_FAULT_I2C;
+      else if (health_pending_fault != MPU_FAULT_NONE) fault_funct = health_pending_fault;
+      #ifdef WIRE_HAS_TIMEOUT
+        if (Wire.getWireTimeoutFlag()) fault_funct = MPU_FAULT_I2C;   // Cleared by recoverBus()
+      #endif
+      if (fault_funct == MPU_FAULT_NONE) break;
+
+      // -- Fault --
+      health_stats.faults[fault_funct - 1]++;
+      health_stats.last_fault = fault_funct;
+      health_fault_time = time_funct;
+      health_power_state = (power_state == MPU_POWER_WAKING) ? MPU_POWER_ACTIVE : power_state;
+      health_state = MPU_HEALTH_BUS_RECOVERY;
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.print(F("MPU fault: "));
+        Serial.println(fault_funct);
+      #endif
+      break;
+
+    // --- Bus recovery and reset ---
+    case MPU_HEALTH_BUS_RECOVERY:
+      mpu_state_global = MPU_NOT_INITIALIZED;   // The samples aren't valid
+      async_state = MPU_ASYNC_IDLE;             // Any asynchronous transfer is lost
+      if (recoverBus()) health_stats.bus_clears++;
+      I2Cdev::writeByte(i2c_address, MPU_CLOCK_REF_ADDR, MPU_DEVICE_RESET);  // The bit is cleared by the MPU, so it isn't checked
+      health_step_time = time_funct;
+      health_state = MPU_HEALTH_RESETTING;
+      break;
+
+    // --- Initialization ---
+    case MPU_HEALTH_RESETTING:
+      if ((time_funct - health_step_time) < MPU_HEALTH_RESET_TIME) break;
+
+      power_state = MPU_POWER_ACTIVE;           // The reset sets the working configuration
+      fifo_frame_length = 0;                    // The reset disables the FIFO
+      if (!initializeFast() ||
+          ((fifo_sensors != 0) && !enableFifo(fifo_sensors)) ||
+          ((health_power_state != MPU_POWER_ACTIVE) && !setPowerState(health_power_state, power_wake_rate))) {
+        health_stats.failed_recoveries++;
+        health_step_time = time_funct;
+        health_state = MPU_HEALTH_FAILED;
+        break;
+      }
+
+      // -- Recovered --
+      // time_buffer is from before the fault, so the estimators start from the current time
+      noInterrupts();
+      mpu_data_ready = false;
+      #if MPU_TIMING_MODE == MPU_TIMING_FIXED
+        prev_time = sample_sequence;
+      #else
+        prev_time = MPU_TIME_NOW();
+      #endif
+      #ifdef MPU_FIXED_POINT
+        prev_time_fixed = prev_time;
+      #endif
+      interrupts();
+      health_pending_fault = MPU_FAULT_NONE;
+      health_frozen_count = 0;
+      health_saturated_count = 0;
+      health_last_sequence = sample_sequence;
+      health_sequence_time = millis();
+      health_stats.recoveries++;
+      health_stats.recovery_time = millis() - health_fault_time;
+      health_state = MPU_HEALTH_OK;
+
+      // Debug
+      #ifdef DEBUG_MODE_MPU
+        Serial.print(F("MPU recovered (ms): "));
+        Serial.println(health_stats.recovery_time);
+      #endif
+      break;
+
+    // --- Retry ---
+    case MPU_HEALTH_FAILED:
+      if ((time_funct - health_step_time) >= MPU_HEALTH_RETRY_TIME) health_state = MPU_HEALTH_BUS_RECOVERY;
+      break;
+
+    default:
+      break;
+  }
+
+  return health_state;
+}
+#endif
+
+
+//            **************************
+//            *       TELEMETRY        *
+//            **************************
+
+MpuTelemetry::MpuTelemetry(Print *port_funct) {
+  /* Constructor of the telemetry encoder. The serial port has to be initialized (begin()) in the main code.
+   *
+   * Parameters:
+   *      @param *port_funct        --> (Print) Serial port of the frames (Serial by default), it must implement availableForWrite()
+   */
+
+  port = port_funct;
+}
+
+bool MpuTelemetry::sendRaw(unsigned long time_stamp, int16_t *values_funct) {
+  /* This function sends the raw measurements of a sample (e.g. getParameter6() or popSample()).
+   *
+   * Parameters:
+   *      @param time_stamp         --> (unsigned long) Time stamp of the sample
+   *      @param *values_funct      --> (int16_t) Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
+   *      @return status            --> (bool) false if the frame was dropped (TX buffer full)
+   */
+
+  return sendFrame(MPU_TELEMETRY_RAW, time_stamp, values_funct);
+}
+
+bool MpuTelemetry::sendAngles(unsigned long time_stamp, mpu_real_t *angles_funct, uint8_t count) {
+  /* This function sends up to MPU_TELEMETRY_VALUES angles (e.g. state, state_gyro and state_accel_est). They are sent as integers with
+   * a resolution of 1/MPU_TELEMETRY_ANGLE_SCALE rad and the values not given are set to 0.
+   *
+   * Parameters:
+   *      @param time_stamp         --> (unsigned long) Time stamp of the sample
+   *      @param *angles_funct      --> (mpu_real_t) Angles in rad (+-3.27 rad)
+   *      @param count              --> (uint8_t) Number of angles
+   *      @return status            --> (bool) false if the frame was dropped (TX buffer full)
+   */
+
+  int16_t values_funct[MPU_TELEMETRY_VALUES];             // Scaled angles
+  mpu_real_t value_funct;
+
+  // --- Scale the angles ---
+  for (uint8_t i = 0; i < MPU_TELEMETRY_VALUES; i++) {
+    if (i >= count) {
+      values_funct[i] = 0;
+      continue;
+    }
+    value_funct = angles_funct[i] * MPU_TELEMETRY_ANGLE_SCALE;
+    if (value_funct > 32767) value_funct = 32767;
+    else if (value_funct < -32767) value_funct = -32767;
+    values_funct[i] = (int16_t)(value_funct + ((value_funct >= 0) ? 0.5 : -0.5));
+  }
+
+  return sendFrame(MPU_TELEMETRY_ANGLES, time_stamp, values_funct);
+}
+
+bool MpuTelemetry::sendFrame(uint8_t type, unsigned long time_stamp, int16_t *values_funct) {
+  /* This function encodes a frame and stores it in the TX buffer, then it writes as many bytes as possible without blocking (update()).
+   * If the frame doesn't fit in the buffer it's dropped, but the sequence number is still increased so the decoder counts it as lost.
+   *
+   * Parameters:
+   *      @param type               --> (uint8_t) Type of the frame (MPU_TELEMETRY_RAW or MPU_TELEMETRY_ANGLES)
+   *      @param time_stamp         --> (unsigned long) Time stamp of the sample
+   *      @param *values_funct      --> (int16_t) MPU_TELEMETRY_VALUES values
+   *      @return status            --> (bool) false if the frame was dropped (TX buffer full)
+   */
+
+  MpuTelemetryFrame frame_funct;
+  uint8_t encoded_funct[MPU_TELEMETRY_ENCODED_LENGTH];    // COBS encoded frame
+
+  // --- Make room ---
+  update();
+  if ((uint8_t)(MPU_TELEMETRY_TX_BUFFER_SIZE - getPending()) < (MPU_TELEMETRY_ENCODED_LENGTH + 1)) {
+    sequence++;
+    dropped_frames++;
+    return false;
+  }
+
+  // --- Encode ---
+  frame_funct.type = type;
+  frame_funct.sequence = sequence;
+  frame_funct.time_stamp = time_stamp;
+  for (uint8_t i = 0; i < MPU_TELEMETRY_VALUES; i++) frame_funct.values[i] = values_funct[i];
+  encodeFrame(&frame_funct, encoded_funct);
+  sequence++;
+
+  // --- Store (the delimiter ends the frame) ---
+  for (uint8_t i = 0; i < MPU_TELEMETRY_ENCODED_LENGTH; i++) {
+    tx_buffer[tx_head & MPU_TELEMETRY_TX_BUFFER_MASK] = encoded_funct[i];
+    tx_head++;
+  }
+  tx_buffer[tx_head & MPU_TELEMETRY_TX_BUFFER_MASK] = 0x00;
+  tx_head++;
+
+  update();
+
+  return true;
+}
+
+uint8_t MpuTelemetry::update() {
+  /* This function writes the buffered bytes that fit in the TX buffer of the serial port (availableForWrite()), so it never waits for
+   * the port. It has to be called periodically (sendFrame() also calls it) until getPending() is 0.
+   *
+   * Parameters:
+   *      @return written           --> (uint8_t) Number of bytes written to the port
+   */
+
+  int room_funct = port->availableForWrite();             // Bytes that can be written without blocking
+  uint8_t written_funct = 0;
+  uint8_t pending_funct;
+  uint8_t chunk_funct;
+  uint8_t index_funct;
+
+  while (room_funct > 0) {
+    pending_funct = getPending();
+    if (pending_funct == 0) break;
+
+    // -- Contiguous bytes (up to the end of the buffer) --
+    index_funct = tx_tail & MPU_TELEMETRY_TX_BUFFER_MASK;
+    chunk_funct = MPU_TELEMETRY_TX_BUFFER_SIZE - index_funct;
+    if (chunk_funct > pending_funct) chunk_funct = pending_funct;
+    if (chunk_funct > room_funct) chunk_funct = room_funct;
+
+    chunk_funct = port->write(tx_buffer + index_funct, chunk_funct);
+    if (chunk_funct == 0) break;
+    tx_tail += chunk_funct;
+    written_funct += chunk_funct;
+    room_funct -= chunk_funct;
+  }
+
+  return written_funct;
+}
+
+uint8_t MpuTelemetry::getPending() {
+  /* This function returns the number of bytes in the TX buffer that haven't been written to the port yet.
+   *
+   * Parameters:
+   *      @return pending           --> (uint8_t) Number of bytes
+   */
+
+  return (uint8_t)(tx_head - tx_tail);
+}
+
+uint16_t MpuTelemetry::crc16(const uint8_t *data_funct, uint8_t length) {
+  /* This function computes the CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF). It processes one byte at a time without a
+   * table ("123456789" --> 0x29B1).
+   *
+   * Parameters:
+   *      @param *data_funct        --> (uint8_t) Data
+   *      @param length             --> (uint8_t) Number of bytes
+   *      @return crc               --> (uint16_t) CRC of the data
+   */
+
+  uint16_t crc_funct = MPU_TELEMETRY_CRC_INIT;
+  uint8_t x_funct;
+
+  for (uint8_t i = 0; i < length; i++) {
+    x_funct = (crc_funct >> 8) ^ data_funct[i];
+    x_funct ^= x_funct >> 4;
+    crc_funct = (crc_funct << 8) ^ ((uint16_t)x_funct << 12) ^ ((uint16_t)x_funct << 5) ^ x_funct;
+  }
+
+  return crc_funct;
+}
+
+void MpuTelemetry::encodeFrame(const MpuTelemetryFrame *frame, uint8_t *encoded) {
+  /* This function serializes a frame (little endian), adds the CRC and encodes it with COBS, so the encoded frame has no zeros and can
+   * be delimited with 0x00. The frame is shorter than 254 bytes, so the encoded one is always 1 byte longer.
+   *
+   * Parameters:
+   *      @param *frame             --> (MpuTelemetryFrame) Frame
+   *      @param *encoded           --> (uint8_t) Output of MPU_TELEMETRY_ENCODED_LENGTH bytes (the delimiter isn't added)
+   */
+
+  uint8_t raw_funct[MPU_TELEMETRY_FRAME_LENGTH];          // Serialized frame
+  uint16_t crc_funct;
+  uint8_t code_index_funct = 0;                           // Position of the current COBS code byte
+  uint8_t code_funct = 1;                                 // Distance to the next zero
+  uint8_t out_funct = 1;                                  // Position of the next encoded byte
+
+  // --- Serialize ---
+  raw_funct[0] = frame->type;
+  raw_funct[1] = frame->sequence & 0xFF;
+  raw_funct[2] = frame->sequence >> 8;
+  for (uint8_t i = 0; i < 4; i++) raw_funct[3 + i] = (frame->time_stamp >> (8 * i)) & 0xFF;
+  for (uint8_t i = 0; i < MPU_TELEMETRY_VALUES; i++) {
+    raw_funct[7 + 2 * i] = (uint16_t)frame->values[i] & 0xFF;
+    raw_funct[8 + 2 * i] = (uint16_t)frame->values[i] >> 8;
+  }
+  crc_funct = crc16(raw_funct, MPU_TELEMETRY_PAYLOAD_LENGTH);
+  raw_funct[MPU_TELEMETRY_PAYLOAD_LENGTH] = crc_funct & 0xFF;
+  raw_funct[MPU_TELEMETRY_PAYLOAD_LENGTH + 1] = crc_funct >> 8;
+
+  // --- COBS ---
+  for (uint8_t i = 0; i < MPU_TELEMETRY_FRAME_LENGTH; i++) {
+    if (raw_funct[i] == 0) {
+      encoded[code_index_funct] = code_funct;
+      code_index_funct = out_funct++;
+      code_funct = 1;
+    }
+    else {
+      encoded[out_funct++] = raw_funct[i];
+      code_funct++;
+    }
+  }
+  encoded[code_index_funct] = code_funct;
+}
+
+bool MpuTelemetry::decodeFrame(const uint8_t *encoded, uint8_t length, MpuTelemetryFrame *frame) {
+  /* This function decodes a COBS encoded frame (without the delimiter) and checks its length and CRC.
+   *
+   * Parameters:
+   *      @param *encoded           --> (uint8_t) Encoded frame
+   *      @param length             --> (uint8_t) Number of bytes (MPU_TELEMETRY_ENCODED_LENGTH)
+   *      @param *frame             --> (MpuTelemetryFrame) Output frame (only valid if true is returned)
+   *      @return status            --> (bool) false if the data isn't a valid frame
+   */
+
+  uint8_t raw_funct[MPU_TELEMETRY_FRAME_LENGTH];          // Decoded frame
+  uint8_t in_funct = 0;                                   // Position of the next encoded byte
+  uint8_t out_funct = 0;                                  // Position of the next decoded byte
+  uint8_t code_funct;
+
+  if (length != MPU_TELEMETRY_ENCODED_LENGTH) return false;
+
+  // --- COBS ---
+  while (in_funct < length) {
+    code_funct = encoded[in_funct++];
+    if ((code_funct == 0) || ((in_funct + code_funct - 1) > length)) return false;
+    for (uint8_t i = 1; i < code_funct; i++) raw_funct[out_funct++] = encoded[in_funct++];
+    if (in_funct < length) {
+      if (out_funct >= MPU_TELEMETRY_FRAME_LENGTH) return false;
+      raw_funct[out_funct++] = 0;
+    }
+  }
+  if (out_funct != MPU_TELEMETRY_FRAME_LENGTH) return false;
+
+  // --- CRC ---
+  if (crc16(raw_funct, MPU_TELEMETRY_PAYLOAD_LENGTH) !=
+      (raw_funct[MPU_TELEMETRY_PAYLOAD_LENGTH] | ((uint16_t)raw_funct[MPU_TELEMETRY_PAYLOAD_LENGTH + 1] << 8))) return false;
+
+  // --- Deserialize ---
+  frame->type = raw_funct[0];
+  frame->sequence = raw_funct[1] | ((uint16_t)raw_funct[2] << 8);
+  frame->time_stamp = 0;
+  for (uint8_t i = 0; i < 4; i++) frame->time_stamp |= (uint32_t)raw_funct[3 + i] << (8 * i);
+  for (uint8_t i = 0; i < MPU_TELEMETRY_VALUES; i++) {
+    frame->values[i] = (int16_t)(raw_funct[7 + 2 * i] | ((uint16_t)raw_funct[8 + 2 * i] << 8));
+  }
+
+  return true;
+}
+
+bool MpuTelemetryDecoder::feed(uint8_t data_funct, MpuTelemetryFrame *frame) {
+  /* This function adds a received byte to the decoder. The bytes are stored until a delimiter (0x00) is received, then they are decoded
+   * (decodeFrame()). Anything that isn't a frame (e.g. text printed on the same port) is counted as a framing error and skipped, so the
+   * decoder synchronizes with the next delimiter.
+   *
+   * Parameters:
+   *      @param data_funct         --> (uint8_t) Received byte
+   *      @param *frame             --> (MpuTelemetryFrame) Output frame (only valid if true is returned)
+   *      @return status            --> (bool) true if a frame has been decoded
+   */
+
+  uint8_t length_funct;
+
+  // --- Store ---
+  if (data_funct != 0x00) {
+    if (length < MPU_TELEMETRY_ENCODED_LENGTH) buffer[length] = data_funct;
+    if (length < 0xFF) length++;
+    return false;
+  }
+
+  // --- Delimiter ---
+  length_funct = length;
+  length = 0;
+  if (length_funct == 0) return false;                    // Empty frame (e.g. the delimiter sent to synchronize)
+
+  if (length_funct != MPU_TELEMETRY_ENCODED_LENGTH) {
+    framing_errors++;
+    return false;
+  }
+  if (!MpuTelemetry::decodeFrame(buffer, length_funct, frame)) {
+    crc_errors++;
+    return false;
+  }
+
+  // --- Sequence ---
+  if (started) lost_frames += (uint16_t)(frame->sequence - next_sequence);
+  next_sequence = frame->sequence + 1;
+  started = true;
+  frames++;
+
+  return true;
+}
@@ -35,12 +35,11 @@
 #include <EEPROM.h>
 #include "I2Cdev.h"
 #include <math.h>
+#include <stddef.h>                               // offsetof() for the EEPROM records
 //#include "MPU6050.h"
 //#include <I2Cdev.h>
 //#include <MPU6050.h>
 
-//volatile bool mpu_data_ready;
-
 /*            *********************
  *            *       STATE       *
  *            *********************
@@ -61,6 +60,9 @@
                                                             // 3 = A_X, 4 = A_Y, 5 = A_Z, 6 = G_X, 7 = G_Y, 8 = G_Z
 #define MPU_NOT_CALIBRATED                9                 // MPU needs to be calibrated
 #define MPU_CALIBRATION_ERROR             10                // MPU couldn't be calibrated
+#define MPU_FIFO_OVERFLOW                 11                // The FIFO has overflowed and samples were lost (call resetFifo() to recover)
+#define MPU_DMP_ERROR                     12                // The DMP firmware couldn't be loaded
+#define MPU_EEPROM_ERROR                  13                // The calibration record couldn't be stored in the EEPROM
 
 
 /*            *********************
@@ -78,6 +80,113 @@
   #define SERIAL_SPEED                    115200            // Serial baud
 #endif
 
+//--------------------------------------------------
+// Memory profile
+//--------------------------------------------------
+// Lean profile for the boards with 2KB of SRAM (Arduino Nano/Uno): the test estimators (testGyroEst() and testAccelEst()) and their
+// states are removed, the floating point values are float (double is already float on AVR, so it also saves SRAM on ARM and ESP32)
+// and the sensitivity tables are stored in PROGMEM. DEBUG_MODE_MPU can't be used, its messages need String (heap).
+// The flash and SRAM of both profiles are measured with avr-size (check "Memory footprint" in the README).
+//#define MPU_LEAN_PROFILE                                  // Uncomment to build the lean profile
+#ifdef MPU_LEAN_PROFILE
+  typedef float mpu_real_t;                                 // Floating point type of the measurements and the filters
+  #ifdef DEBUG_MODE_MPU
+    #error "DEBUG_MODE_MPU can't be used with MPU_LEAN_PROFILE"
+  #endif
+#else
+  typedef double mpu_real_t;                                // Floating point type of the measurements and the filters
+#endif
+
+//--------------------------------------------------
+// Profiling
+//--------------------------------------------------
+// The time of each stage of the pipeline and the I2C errors are recorded in an MpuProfile (getProfile()), without printing anything
+//#define MPU_PROFILING                                     // Uncomment to record the time of each stage (it adds two micros() calls per stage)
+
+//--------------------------------------------------
+// Fixed-point
+//--------------------------------------------------
+//#define MPU_FIXED_POINT                                   // Uncomment to build the fixed-point (int32_t) Kalman filter for the boards without FPU
+
+//--------------------------------------------------
+// Fast math
+//--------------------------------------------------
+//#define MPU_FAST_TRIG                                     // Uncomment to use lookup tables (PROGMEM) for sin, cos and atan2 instead of math.h
+#define MPU_TRIG_TABLE_BITS               7                 // Size of each table: 2^MPU_TRIG_TABLE_BITS + 1 entries of 2 bytes (5 to 8)
+#define MPU_TRIG_INTERPOLATION                              // Comment to use the nearest entry, faster but less accurate
+                                                            // Max error with interpolation: 5 bits --> 3e-4, 6 --> 1e-4, 7 --> 6e-5, 8 --> 5e-5
+                                                            // Max error without interpolation: 5 bits --> 3e-2, 6 --> 2e-2, 7 --> 7e-3, 8 --> 4e-3
+
+//--------------------------------------------------
+// Timing
+//--------------------------------------------------
+#define MPU_TIMING_MILLIS                 0                 // The time stamps are millis() (dt has a 1ms resolution)
+#define MPU_TIMING_MICROS                 1                 // The time stamps are micros() (the wrap around is handled by the unsigned subtraction)
+#define MPU_TIMING_FIXED                  2                 // The time stamps are the sample sequence numbers, dt = samples elapsed * sample period
+#define MPU_TIMING_MODE                   MPU_TIMING_MICROS // Time stamps used by the estimators (time_buffer is set by dataReadyInterrupt())
+
+//--------------------------------------------------
+// DMP
+//--------------------------------------------------
+// The Digital Motion Processor fuses the measurements in the MPU and loads the quaternion into the FIFO. It needs the MotionApps20
+// firmware of the MPU6050 library (https://github.com/jrowberg/i2cdevlib), which can't be included anywhere else in the sketch.
+//#define MPU_DMP_MODE                                      // Uncomment to load the DMP firmware and read the quaternion from the FIFO
+
+//--------------------------------------------------
+// Sample buffer
+//--------------------------------------------------
+//#define MPU_SAMPLE_BUFFER                                 // Uncomment to build the ring buffer of time stamped samples (16 bytes per sample)
+#define MPU_SAMPLE_BUFFER_SIZE            16                // Number of samples of the ring buffer (power of two, up to 128)
+
+//--------------------------------------------------
+// Temperature compensation
+//--------------------------------------------------
+// The gyroscope offsets drift with the temperature. The table stores the gyroscope offset correction at several temperatures (one point
+// per band), learned while the MPU is still, and the correction is interpolated at the current temperature.
+//#define MPU_TEMP_COMPENSATION                             // Uncomment to use the temperature table (8 bytes per point in the EEPROM records)
+#define MPU_TEMP_TABLE_POINTS             4                 // Number of points of the table (up to 8)
+#define MPU_TEMP_TABLE_MIN                0                 // Temperature of the first band in degC
+#define MPU_TEMP_TABLE_STEP               15                // Width of each band in degC
+
+//--------------------------------------------------
+// Gyroscope bias tracking
+//--------------------------------------------------
+// The gyroscope bias also drifts with the time. While the MPU is still (low variance of the gyroscopes and of the norm of the accelerations)
+// the gyroscope offset correction is updated with the samples that are already being refined, so there isn't any extra I2C reading.
+//#define MPU_BIAS_TRACKING                                 // Uncomment to track the gyroscope bias while the MPU is still
+#define MPU_STILL_WINDOW                  32                // Samples of the exponential window of the stillness detector (up to 255)
+#define MPU_BIAS_TRACKING_WINDOW          1024              // Still samples of the exponential window of the bias update
+
+//--------------------------------------------------
+// Pre-filter
+//--------------------------------------------------
+// Anti-aliasing decimator between the raw measurements and the estimators (updateEstimators()), so the MPU can sample at 1kHz with
+// vibrations and the fusion runs at a lower rate (e.g. 250 Hz with a decimation of 4). It only uses integer operations.
+//#define MPU_PREFILTER                                     // Uncomment to filter and decimate the raw measurements
+#define MPU_PREFILTER_CIC                 0                 // CIC decimator (cascaded moving averages, no multiplications)
+#define MPU_PREFILTER_BIQUAD              1                 // Low pass biquad (Q14 coefficients, setPrefilterBiquad()) and decimation
+#ifndef MPU_PREFILTER_TYPE                                  // It can also be set by the build (e.g. make FLAGS="-DMPU_PREFILTER_TYPE=1")
+  #define MPU_PREFILTER_TYPE              MPU_PREFILTER_CIC // Filter of the pre-filter
+#endif
+#define MPU_PREFILTER_DECIMATION          4                 // Default decimation factor (1 to 16, setPrefilter())
+#define MPU_PREFILTER_CIC_ORDER           2                 // Order of the CIC decimator (1 to 3)
+#define MPU_PREFILTER_BIQUAD_DEFAULT      {329, 658, 329, -25576, 10508}  // b0, b1, b2, a1, a2 in Q14: Butterworth at fs/20
+                                                            // (50 Hz at 1kHz). The DC gain has to be 1: b0 + b1 + b2 = 16384 + a1 + a2
+
+//--------------------------------------------------
+// Health monitor
+//--------------------------------------------------
+// Detects the I2C errors, the frozen or saturated data and the lost data ready interrupts, and recovers the MPU (I2C bus clock-out,
+// device reset and initializeFast()) in the steps of updateHealth(), so the loop is never blocked for more than a few ms.
+//#define MPU_HEALTH_MONITOR                                // Uncomment to build the health monitor (it needs a calibration record)
+#define MPU_SDA_PIN                       SDA               // SDA pin of the I2C bus (for the bus recovery)
+#define MPU_SCL_PIN                       SCL               // SCL pin of the I2C bus (for the bus recovery)
+
+//--------------------------------------------------
+// Telemetry
+//--------------------------------------------------
+#define MPU_TELEMETRY_TX_BUFFER_SIZE      64                // Bytes of the TX buffer of each MpuTelemetry (power of two, up to 128, 23 bytes per frame)
+
 //--------------------------------------------------
 // I2C BUS
 //--------------------------------------------------
@@ -93,6 +202,17 @@
 #endif
 #define I2C_TIMEOUT_CON                   100               // I2C timeout in ms
 #define I2C_MPU_RETRIES                   5                 // Number of retries after a timeout
+#define I2C_BURST_WRITE_LENGTH            16                // Maximum number of registers written in one burst (writeMpuRegisters())
+
+// --- Asynchronous reading ---
+// On AVR boards the asynchronous transfers drive the TWI peripheral directly (polling the TWINT flag), so they never wait for the bus.
+// On the other boards they fall back to the blocking reading. No other I2C transfer should be done while one is in progress.
+#define I2C_ASYNC_TIMEOUT_US              1000              // Maximum time in us without progress in an asynchronous transfer before it is retried
+#define I2C_ASYNC_BUFFER_LENGTH           16                // Maximum number of registers read in one asynchronous transfer
+#define MPU_ASYNC_IDLE                    0                 // No asynchronous transfer in progress
+#define MPU_ASYNC_BUSY                    1                 // Asynchronous transfer in progress
+#define MPU_ASYNC_DONE                    2                 // Asynchronous transfer completed, the data is ready
+#define MPU_ASYNC_ERROR                   3                 // Asynchronous transfer failed after I2C_MPU_RETRIES retries
 
 // --- Device ID ---
 #define MPU_DEVICE_ID_REG                 0x75              // Register address with the device ID
@@ -114,17 +234,18 @@
 // #define MPU_ACCEL_FS_16G                                     // Uncommnet this to set the working full-scale range of the accelerometer to 16g
 #ifdef MPU_ACCEL_FS_16G
   #define MPU_ACCEL_CONFIG_VALUE          0x18              // This will set the full-scale to 16g
-  const double accel_1g_value = 2048;                       // Sensitivity at 16g full-scale
+  constexpr mpu_real_t accel_1g_value = 2048;               // Sensitivity at 16g full-scale
 #elif defined MPU_ACCEL_FS_8G
   #define MPU_ACCEL_CONFIG_VALUE          0x10              // This will set the full-scale to 8g
-  const double accel_1g_value = 4096;                       // Sensitivity at 8g full-scale 
+  constexpr mpu_real_t accel_1g_value = 4096;               // Sensitivity at 8g full-scale 
 #elif defined MPU_ACCEL_FS_4G
   #define MPU_ACCEL_CONFIG_VALUE          0x08              // This will set the full-scale to 4g
-  const double accel_1g_value = 8192;                       // Sensitivity at 4g full-scale 
+  constexpr mpu_real_t accel_1g_value = 8192;               // Sensitivity at 4g full-scale 
 #else
   #define MPU_ACCEL_CONFIG_VALUE          0x00              // This will set the full-scale to 2g
-  const double accel_1g_value = 16384;                      // Sensitivity at 2g full-scale. This is de default value
+  constexpr mpu_real_t accel_1g_value = 16384;              // Sensitivity at 2g full-scale. This is de default value
 #endif    
+constexpr mpu_real_t accel_scale = 1.0 / accel_1g_value;    // Reciprocal of the sensitivity (g per LSB), so there is no division per sample
 
 // --- Gyroscope ---
 #define MPU_GYRO_CONF_ADDR                0x1B              // Register address to configure the gyroscope
@@ -137,16 +258,30 @@
 // #define MPU_GYRO_FS_2000DPS                                // Uncomment to set the working full-scale range of the gyroscope to 2000dps
 #ifdef MPU_GYRO_FS_2000DPS
   #define MPU_GYRO_CONFIG_VALUE           0x18              // This will set the full-scale to 2000dps
-  const double gyro_1dps_value = 16.4;                      // Sensitivity at 2000dps full-scale
+  constexpr mpu_real_t gyro_1dps_value = 16.4;              // Sensitivity at 2000dps full-scale
 #elif defined MPU_GYRO_FS_1000DPS
   #define MPU_GYRO_CONFIG_VALUE           0x10              // This will set the full-scale to 1000dps
-  const double gyro_1dps_value = 32.8;                      // Sensitivity at 1000dps full-scale 
+  constexpr mpu_real_t gyro_1dps_value = 32.8;              // Sensitivity at 1000dps full-scale 
 #elif defined MPU_GYRO_FS_500DPS
   #define MPU_GYRO_CONFIG_VALUE           0x08              // This will set the full-scale to 500dps
-  const double gyro_1dps_value = 65.5;                      // Sensitivity at 500dps full-scale 
+  constexpr mpu_real_t gyro_1dps_value = 65.5;              // Sensitivity at 500dps full-scale 
 #else
   #define MPU_GYRO_CONFIG_VALUE           0x00              // This will set the full-scale to 250dps
-  const double gyro_1dps_value = 131;                       // Sensitivity at 250dps full-scale- This is the default value
+  constexpr mpu_real_t gyro_1dps_value = 131;               // Sensitivity at 250dps full-scale- This is the default value
+#endif
+constexpr mpu_real_t gyro_scale = M_PI / (180.0 * gyro_1dps_value); // rad/s per LSB, so there is no division per sample
+
+// --- Runtime full-scale ---
+#define MPU_FULL_SCALE_MASK               0x18              // Bits of the configuration registers with the full-scale range (for setFullScale())
+#define MPU_FULL_SCALE_SHIFT              3                 // Position of the full-scale range bits
+#ifdef MPU_LEAN_PROFILE
+  const float accel_1g_values[4] PROGMEM = {16384, 8192, 4096, 2048};  // Accelerometer sensitivity of each full-scale range (2g, 4g, 8g and 16g)
+  const float gyro_1dps_values[4] PROGMEM = {131, 65.5, 32.8, 16.4};   // Gyroscope sensitivity of each full-scale range (250, 500, 1000 and 2000dps)
+  #define MPU_SENSITIVITY(table, index)   pgm_read_float(&table[index])  // Reads a sensitivity table
+#else
+  const double accel_1g_values[4] = {16384, 8192, 4096, 2048};  // Accelerometer sensitivity of each full-scale range (2g, 4g, 8g and 16g)
+  const double gyro_1dps_values[4] = {131, 65.5, 32.8, 16.4};   // Gyroscope sensitivity of each full-scale range (250, 500, 1000 and 2000dps)
+  #define MPU_SENSITIVITY(table, index)   table[index]      // Reads a sensitivity table
 #endif
 
 // --- Configuration ---
@@ -154,16 +289,24 @@
 #define MPU_SELF_TEST_THRESHOLD           14                // Maximum percentage allowwed for the self-test, 14% according to the datasheet
 #define MPU_SELF_TEST_RESULT_ADDR_BASE    0x0D              // Base address for the Self-test results
 
+// --- Background self-test (self_test_state) ---
+#define MPU_SELF_TEST_IDLE                0                 // Not requested
+#define MPU_SELF_TEST_PENDING             1                 // Deferred by initializeFast(), it is started by selfTestStep()
+#define MPU_SELF_TEST_RUNNING             2                 // Self-test full-scale ranges set, the samples are discarded
+#define MPU_SELF_TEST_PASSED              3                 // All the axes passed the self-test
+#define MPU_SELF_TEST_FAILED              4                 // An axis failed (check mpu_state_global) or the results couldn't be read
+
 
 //--------------------------------------------------
 // Configuration
 //--------------------------------------------------
 
 // --- Clock reference ---
-#define MPU_CLOCK_REF_ADDR                0x1B              // Address of the register to configure the clock reference of the MPU
+#define MPU_CLOCK_REF_ADDR                0x6B              // Address of the register to configure the clock reference of the MPU (PWR_MGMT_1)
 #define MPU_CLOCK_REF_MASK                0x07              // Mask for the clock reference configuration
 #define MPU_CLOCK_ZGYRO                   0x03              // Sets the Gyro-Z PLL as reference (default used)
 #define MPU_CLOCK_XGYRO                   0x01              // Sets the Gyro_x PLL as reference
+#define MPU_CLOCK_INTERNAL                0x00              // Sets the internal 8MHz oscillator as reference (used while the gyroscopes are in standby)
 
 // --- Digital low-pass filter ---
 #define MPU_DLPF_ADDR                     0x1A              // Address of the register to configure the digital low-pass filter 
@@ -179,6 +322,16 @@
 #define MPU_INTERRUPT_CONF_MASK           0x19              // Mask for the interrupt configuration register
 #define MPU_INTERRUPT_DEFAULT             0x01              // Default value for the Interrupt configuration register. This will set an interrupt when all
                                                             // the measurements have been updated in the corresponding registers
+#define MPU_INTERRUPT_DATA_READY          0x01              // DATA_RDY_EN: interrupt when a new sample is in the measurement registers
+#define MPU_INTERRUPT_FIFO_OVERFLOW       0x10              // FIFO_OFLOW_EN: interrupt when the FIFO overflows (MPU_INTERRUPT_MOTION is MOT_EN)
+#define MPU_INT_PIN_CFG_ADDR              0x37              // Address of the interrupt pin configuration register (INT_PIN_CFG, just before INT_ENABLE)
+#define MPU_INT_PIN_CFG_MASK              0xF0              // Bits set by configureInterrupt() (the I2C bypass and FSYNC bits aren't changed)
+#define MPU_INT_PIN_ACTIVE_LOW            0x80              // INT_LEVEL: the pin is active low (attach the interrupt as FALLING)
+#define MPU_INT_PIN_OPEN_DRAIN            0x40              // INT_OPEN: open drain output (it needs a pull-up), so several MPUs can share a pin
+#define MPU_INT_PIN_LATCH                 0x20              // LATCH_INT_EN: the pin is held until the interrupt is cleared (otherwise a 50us pulse)
+#define MPU_INT_PIN_CLEAR_ON_READ         0x10              // INT_RD_CLEAR: any reading clears the interrupt (otherwise only reading INT_STATUS). As
+                                                            // the measurements are read with INT_STATUS it is only needed by the other readings
+#define MPU_INT_PIN_DEFAULT               0x00              // Default pin configuration: active high, push-pull, 50us pulse (the power-on value)
 
 // --- Sample rate ---
 #define MPU_SAMPLE_RATE_ADDR              0x19              // Address of the register to configure the sample rate for the MPU
@@ -186,6 +339,14 @@
                                                             //        Sample Rate = (PLL freq)/(MPU_SAMPLE_RATE_DEFAULT + 1)
                                                             // Default value sets it to 1kHz
 #define MPU_SAMPLE_RATE_WORKING           0x1F              // Value of the sample rate register during normal operation. Set to 31.25Hz
+#define MPU_GYRO_RATE_DLPF_OFF            8000              // Gyroscope output rate in Hz when the DLPF is disabled (DLPF_CFG = 0 or 7)
+#define MPU_GYRO_RATE_DLPF_ON             1000              // Gyroscope output rate in Hz when the DLPF is enabled
+#define MPU_FAST_CONFIG_ADDR              MPU_SAMPLE_RATE_ADDR  // First of the registers restored by initializeFast() in one burst:
+                                                            // sample rate, DLPF, gyroscope and accelerometer configuration (0x19 to 0x1C)
+
+#define MPU_SAMPLE_PERIOD_WORKING         ((MPU_SAMPLE_RATE_WORKING + 1.0) / ((((MPU_DLPF_REG_VALUE_WORKING & 0x07) == 0) || \
+                                          ((MPU_DLPF_REG_VALUE_WORKING & 0x07) == 7)) ? MPU_GYRO_RATE_DLPF_OFF : MPU_GYRO_RATE_DLPF_ON))
+                                                            // Sample period in s of the working configuration
 
 // --- Signal path reset ---
 #define MPU_RESET_SIGNAL_PATH_ADDR        0x68              // Address for the signal path reset register
@@ -199,6 +360,92 @@
 #define MPU_LOW_POWER_MODE_ENABLE         0x40              // Register value to set the MPU into sleep mode
 #define MPU_LOW_POWER_MODE_DISABLE        0x00              // Register value to disable the sleep mode and wake the MPU
 
+// --- Power states ---
+// The accelerometer only mode wakes up at the LP_WAKE_CTRL rate to take one sample (the gyroscopes and the temperature are disabled)
+#define MPU_POWER_ACTIVE                  0                 // Full rate, accelerometer and gyroscopes (working configuration)
+#define MPU_POWER_CYCLE                   1                 // Accelerometer only at the wake-up rate, with the data ready interrupt
+#define MPU_POWER_MOTION                  2                 // Accelerometer only at the wake-up rate, only the motion interrupt (wake-on-motion)
+#define MPU_POWER_SLEEP                   3                 // Sleep mode, no measurements
+#define MPU_POWER_WAKING                  4                 // Going back to MPU_POWER_ACTIVE, waiting for the gyroscopes to start up
+#define MPU_PWR_MGMT_1_MASK               0x6F              // Mask of the sleep, cycle, temperature disable and clock bits of PWR_MGMT_1
+#define MPU_PWR_MGMT_1_CYCLE              0x28              // PWR_MGMT_1 value for the cycle mode (CYCLE and TEMP_DIS set, internal clock)
+#define MPU_PWR_MGMT_1_ACTIVE             MPU_CLOCK_ZGYRO   // PWR_MGMT_1 value for the active mode (Gyro-Z PLL clock)
+#define MPU_PWR_MGMT_2_ADDR               0x6C              // Address of the power management register 2 (wake-up rate and standby bits)
+#define MPU_PWR_MGMT_2_STBY_GYRO          0x07              // Standby bits of the three gyroscopes
+#define MPU_LP_WAKE_1_25HZ                0x00              // LP_WAKE_CTRL values (wake-up rate of the accelerometer only modes)
+#define MPU_LP_WAKE_5HZ                   0x40
+#define MPU_LP_WAKE_20HZ                  0x80
+#define MPU_LP_WAKE_40HZ                  0xC0
+#define MPU_LP_WAKE_MASK                  0xC0              // Bits of LP_WAKE_CTRL in PWR_MGMT_2
+#define MPU_GYRO_STARTUP_TIME             35000             // Time in us for the gyroscopes to start up after the standby (30ms typical)
+
+// --- Motion detection ---
+#define MPU_MOT_THR_ADDR                  0x1F              // Address of the motion threshold register (2mg per LSB)
+#define MPU_MOT_DUR_ADDR                  0x20              // Address of the motion duration register (1ms per LSB)
+#define MPU_MOTION_THRESHOLD              20                // Default motion threshold (40mg)
+#define MPU_MOTION_DURATION               1                 // Default motion duration in ms (samples above the threshold)
+#define MPU_ACCEL_HPF_MASK                0x07              // Bits of the accelerometer high-pass filter (used by the motion detection)
+#define MPU_ACCEL_HPF_5HZ                 0x01              // High-pass filter at 5Hz, so only the changes of acceleration are detected
+#define MPU_ACCEL_HPF_OFF                 0x00              // High-pass filter disabled (normal operation)
+#define MPU_INTERRUPT_MOTION              0x40              // Value of the interrupt configuration register with only the motion interrupt
+#define MPU_INTERRUPT_POWER_MASK          0x59              // Mask of the interrupt configuration register including the motion interrupt
+#define MPU_INT_STATUS_ADDR               0x3A              // Address of the interrupt status register (cleared when read)
+#define MPU_INT_STATUS_MOTION             0x40              // Motion detection bit of the interrupt status register
+#define MPU_INT_STATUS_FIFO_OVERFLOW      0x10              // FIFO overflow bit of the interrupt status register
+#define MPU_INT_STATUS_DATA_READY         0x01              // Data ready bit of the interrupt status register
+
+// --- Health monitor ---
+#define MPU_HEALTH_OK                     0                 // The MPU is working (or the fault hasn't been detected yet)
+#define MPU_HEALTH_BUS_RECOVERY           1                 // A fault was detected, the bus is recovered and the MPU reset in the next step
+#define MPU_HEALTH_RESETTING              2                 // Waiting MPU_HEALTH_RESET_TIME after the device reset
+#define MPU_HEALTH_FAILED                 3                 // The MPU couldn't be initialized, waiting MPU_HEALTH_RETRY_TIME to retry
+#define MPU_FAULT_NONE                    0                 // Faults (health_stats.last_fault)
+#define MPU_FAULT_I2C                     1                 // I2C error (MPU_I2C_ERROR)
+#define MPU_FAULT_FROZEN                  2                 // MPU_HEALTH_FROZEN_SAMPLES identical samples
+#define MPU_FAULT_SATURATED               3                 // MPU_HEALTH_SATURATED_SAMPLES samples in a row with a saturated value (0x7FFF or 0x8000)
+#define MPU_FAULT_TIMEOUT                 4                 // No data ready interrupts for MPU_HEALTH_DATA_TIMEOUT in MPU_POWER_ACTIVE
+#define MPU_FAULT_TYPES                   4                 // Number of fault types
+#define MPU_HEALTH_FROZEN_SAMPLES         50                // Identical samples for a frozen data fault (the noise changes the values)
+#define MPU_HEALTH_SATURATED_SAMPLES      500               // Samples in a row with a saturated axis for a fault (a hit can saturate a few)
+#define MPU_HEALTH_DATA_TIMEOUT           100               // Time in ms without data ready interrupts for a timeout fault
+#define MPU_HEALTH_RESET_TIME             100               // Time in ms after the device reset before the initialization (datasheet)
+#define MPU_HEALTH_RETRY_TIME             1000              // Time in ms between the recovery attempts after a failed one
+#define MPU_HEALTH_CLOCK_PULSES           9                 // SCL pulses to release a stuck SDA (a byte and the ACK)
+#define MPU_HEALTH_HALF_PERIOD            5                 // Half period of the SCL pulses in us (100 kHz)
+#define MPU_HEALTH_WIRE_TIMEOUT           25000             // Timeout of the Wire transfers in us (WIRE_HAS_TIMEOUT), a stuck bus fails the
+                                                            // transfer (MPU_FAULT_I2C) instead of blocking the loop
+#define MPU_DEVICE_RESET                  0x80              // DEVICE_RESET bit of PWR_MGMT_1 (all the registers are reset)
+
+// --- FIFO ---
+// The FIFO is used to store the measurements in the MPU so they can be read in bursts instead of one transaction per sample
+#define MPU_USER_CTRL_ADDR                0x6A              // Address of the user control register (FIFO enable and reset)
+#define MPU_USER_CTRL_FIFO_MASK           0x44              // Mask for the FIFO bits of the user control register
+#define MPU_USER_CTRL_FIFO_ENABLE         0x40              // Register value to enable the FIFO
+#define MPU_USER_CTRL_FIFO_RESET          0x04              // Register value to reset the FIFO (the bit is cleared automatically by the MPU)
+#define MPU_FIFO_EN_ADDR                  0x23              // Address of the register that selects which sensors are loaded into the FIFO
+#define MPU_FIFO_TEMP                     0x80              // Loads the temperature into the FIFO (2 bytes per frame)
+#define MPU_FIFO_XG                       0x40              // Loads the X gyroscope into the FIFO (2 bytes per frame)
+#define MPU_FIFO_YG                       0x20              // Loads the Y gyroscope into the FIFO (2 bytes per frame)
+#define MPU_FIFO_ZG                       0x10              // Loads the Z gyroscope into the FIFO (2 bytes per frame)
+#define MPU_FIFO_ACCEL                    0x08              // Loads the three accelerometer axes into the FIFO (6 bytes per frame)
+#define MPU_FIFO_SENSORS_DEFAULT          0x78              // Accelerometer + gyroscope, so each frame has the same order as getParameter6()
+#define MPU_FIFO_COUNT_ADDR               0x72              // Address of the FIFO count registers (high byte first)
+#define MPU_FIFO_R_W_ADDR                 0x74              // Address of the FIFO read/write register (the bytes are removed when read,
+                                                            // so it is read with one attempt, a retry would be shifted)
+#define MPU_FIFO_SIZE                     1024              // Size of the FIFO in bytes. If it is full the oldest data is overwritten (overflow)
+#define MPU_FIFO_BURST_LENGTH             240               // Maximum number of bytes read in one I2C transaction (it must fit in a uint8_t)
+
+// --- DMP ---
+// The DMP firmware expects this configuration, so startDmp() sets it (offset_correction is scaled to it)
+#define MPU_USER_CTRL_DMP_MASK            0xCC              // Mask for the DMP and FIFO bits of the user control register
+#define MPU_USER_CTRL_DMP_START           0xCC              // Register value to reset and enable the DMP and the FIFO
+#define MPU_DMP_PACKET_LENGTH             42                // Bytes of each DMP packet: quaternion (16), gyroscope (12), accelerometer (12), footer (2)
+#define MPU_DMP_SAMPLE_RATE_REG           4                 // Sample rate divider used by the DMP (200 Hz packets)
+#define MPU_DMP_DLPF_REG                  3                 // DLPF used by the DMP (42 Hz)
+#define MPU_DMP_ACCEL_CONFIG              0x00              // Accelerometer full-scale used by the DMP (+-2g)
+#define MPU_DMP_GYRO_CONFIG               0x18              // Gyroscope full-scale used by the DMP (+-2000 deg/s)
+#define MPU_DMP_QUATERNION_SCALE          1073741824.0      // LSB of the quaternion components (Q2.30)
+
 
 //--------------------------------------------------
 // Calibration
@@ -211,13 +458,28 @@
 #define CALIBRATION_INITIAL_ERROR         5                 // Maximum error for which the number of calibrations should be increased to CALIBRATION_AVERAGES
 #define CALIBRATION_MIN_ERROR             1                 // Maximum difference allowed between the high and low offset values to stop the calibration 
                                                             // process
+#define MPU_ALL_AXES                      0x3F              // Axes mask with all the axes (bit 0 = A_X ... bit 5 = G_Z)
+#define CALIBRATION_MIN_SAMPLES           32                // Minimum number of samples of each mean before checking its confidence interval
+#define CALIBRATION_CONFIDENCE_Z2         4                 // Squared z-score of the confidence interval of the means (4 --> 95%). The sampling of an
+                                                            // axis stops when the interval is within +-CALIBRATION_MIN_ERROR LSB
 
 // --- Offset correction ---
 #define CALIBRATION_CORRECTION_AVERAGES   1000              // Number of averages that will be made to calculate the offset correction array
 #define FAST_CALIBRATION_CORRECTION                         // Sets the calibration correction at 1kHz sample frequency if not commented
 
 // --- Calibration adjustments ---
-#define CALIBRATION_OFFSET_ADJUSTMENT     1000              // Change done to the offset when finding the initial range
+#define CALIBRATION_SENSITIVITY_STEP      64                // Change done to the offsets to measure the sensitivity (LSB per offset step)
+#define CALIBRATION_MIN_SENSITIVITY       0.5               // Minimum sensitivity accepted, the lower ones are considered noise (LSB per offset step)
+
+// --- Calibration states (calibration_state) ---
+#define MPU_CALIB_IDLE                    0                 // No calibration in progress
+#define MPU_CALIB_SENSITIVITY             1                 // Measuring with the initial offsets
+#define MPU_CALIB_SENSITIVITY_STEP        2                 // Measuring with the offsets increased by CALIBRATION_SENSITIVITY_STEP
+#define MPU_CALIB_SEARCH                  3                 // Secant search of the offsets
+#define MPU_CALIB_SEARCH_DONE             4                 // Offsets found, they will be stored in the EEPROM
+#define MPU_CALIB_CORRECTION              5                 // Measuring the offset correction values
+#define MPU_CALIB_DONE                    6                 // Calibration completed (the MPU is ready)
+#define MPU_CALIB_ERROR                   7                 // Calibration failed (check mpu_state_global)
 
 // --- Calibration targets ---
 #define X_ACCEL_TARGET                    0                 // Target for the X accelerometer measurement (0 by default)
@@ -231,7 +493,20 @@
 // --- Temperature calibration threshold ---
 #define CALIBRATION_MAX_TEMP_DIFF         25                // Maximum temeperature difference between the calibration temperature and the current one
                                                             // It should be considered that the temperature stabilization won't be achieved when the
-                                                            // reading is done (temperature in celsius)
+                                                            // reading is done (temperature in celsius). Not used with MPU_TEMP_COMPENSATION
+
+// --- Temperature compensation ---
+#define MPU_TEMP_LSB_PER_DEGREE           340               // Sensitivity of the temperature sensor (degC = raw / 340 + 36.53)
+#define MPU_TEMP_OFFSET_DEGREES           36.53             // Temperature in degC for a raw value of 0
+#define MPU_TEMP_COMP_HYSTERESIS          34                // Temperature change in LSB (0.1 degC) before the correction is interpolated again
+#define MPU_TEMP_LEARN_SAMPLES            512               // Number of still samples averaged for each point of the table
+#define MPU_TEMP_LEARN_MAX_RATE           262               // Maximum gyroscope deviation in LSB from the correction while learning (2 deg/s at 250dps)
+#define MPU_TEMP_SAVE_THRESHOLD           4                 // Change in LSB of a point that is stored in the EEPROM (to reduce the writes)
+
+// --- Gyroscope bias tracking ---
+#define MPU_STILL_GYRO_STD                0.01              // Maximum standard deviation of the gyroscopes in rad/s (0.6 deg/s)
+#define MPU_STILL_GYRO_RATE               0.035             // Maximum mean rate after the offset correction in rad/s (2 deg/s)
+#define MPU_STILL_ACCEL_STD               0.01              // Maximum standard deviation of the norm of the accelerations in g
 
 // --- Offsets registers ---
 #define MPU_ACCEL_OFFSETS_BASE_ADDR       0x06              // Base register address for the accelerometer offset adjustment
@@ -249,11 +524,26 @@
 // --- Gyroscope ---
 #define MPU_GYRO_REG_BASE                 0x43              // Base address of the registers with the gyroscope values 
 
+// --- Measurements ---
+// INT_STATUS is just before the accelerometer registers, so it is read (and cleared) in the same burst as the measurements
+#define MPU_MEASUREMENTS_ADDR             MPU_INT_STATUS_ADDR  // First register of the measurements reading
+#define MPU_MEASUREMENTS_LENGTH           15                // INT_STATUS, accelerometer (6), temperature (2) and gyroscope (6)
+
 //--------------------------------------------------
 // EEPROM
 //--------------------------------------------------
 // It is defined here for the moment, maybe it will be moved...
-#define MPU_EEPROM_OFFSET_ADDRESS         15                // Offset for the MPU calibration EEPROM addess. it has a size of 17 bytes
+#define MPU_EEPROM_OFFSET_ADDRESS         15                // Offset for the MPU calibration EEPROM addess
+#ifdef MPU_TEMP_COMPENSATION
+  #define MPU_EEPROM_RECORD_VERSION       4                 // Version of MpuCalibrationRecord with the temperature table
+#else
+  #define MPU_EEPROM_RECORD_VERSION       3                 // Version of MpuCalibrationRecord (the records of other versions are ignored,
+                                                            // 1 and 2 had a different size on AVR and on 32-bit boards)
+#endif
+#define MPU_EEPROM_RECORDS                4                 // Records of each MPU, they are written in turns to spread the wear (up to 127)
+#define MPU_EEPROM_SAVE_INTERVAL          600000            // Minimum time in ms between the records stored by flushEEPROM() (wear)
+#define MPU_EEPROM_SLOT_SIZE              (MPU_EEPROM_RECORDS * sizeof(MpuCalibrationRecord))  // Size of the calibration data of each MPU
+                                                            // (slot n starts at MPU_EEPROM_OFFSET_ADDRESS + n * MPU_EEPROM_SLOT_SIZE)
 
 
 //            *********************
@@ -267,48 +557,380 @@
 // --- I2C Address ---
 
 //By default the AD0 address has to be connected to gnd
+#define I2C_ADDRESS_MPU_LOW               B1101000          // I2C address with AD0 set to '0'
+#define I2C_ADDRESS_MPU_HIGH              B1101001          // I2C address with AD0 set to '1'
+
+// Default address of the MpuDev objects
 #ifdef I2C_ADDRESS_HIGH
-  #define I2C_ADDRESS_MPU                 B1101001          // I2C address with AD0 set to '1'
+  #define I2C_ADDRESS_MPU                 I2C_ADDRESS_MPU_HIGH
 #else
-  #define I2C_ADDRESS_MPU                 B1101000          // I2C address with AD0 set to '0'
+  #define I2C_ADDRESS_MPU                 I2C_ADDRESS_MPU_LOW
 #endif
 
+// --- Multiple sensors ---
+#define MPU_SCHEDULER_MAX_DEVICES         2                 // Maximum number of MPUs read by each MpuScheduler
+
 //--------------------------------------------------
 // Kalman Filter
 //--------------------------------------------------
 
 // --- Constants ---
-const double gyro_covariance = 0.203263527368261;           // Gyroscope covariance (deg/s)^2
-const double accel_covariance = 1;                        // Accelerometer covariance (m/s^2)^2
+const mpu_real_t gyro_covariance = 0.203263527368261;       // Gyroscope covariance (deg/s)^2
+const mpu_real_t accel_covariance = 1;                    // Accelerometer covariance (m/s^2)^2
+const mpu_real_t gyro_bias_covariance = 0.000001;         // Random walk of the gyroscope bias (rad/s)^2 per second
+const mpu_real_t gyro_bias_initial_covariance = 0.0001;   // Initial covariance of the gyroscope bias (rad/s)^2
+
+// --- Accelerometer decimation ---
+// simplifiedKF() predicts with the gyroscope every sample, but the accelerometer update (accelState(), with a square root and two atan2)
+// is done every MPU_KF_ACCEL_PERIOD samples with the mean of the accelerometer measurements. Its covariance is divided by the number of
+// samples, so one update has the same weight as the individual ones.
+#define MPU_KF_ACCEL_PERIOD               1                 // Samples between the accelerometer updates of simplifiedKF() (1 to 255, 1 = every sample)
+
+// --- Bias Kalman filter ---
+// The covariance and the gains of biasKF() are propagated and updated once every MPU_BIAS_KF_GAIN_PERIOD samples (the other samples
+// reuse the last gains). 1 is the full filter, higher values are cheaper (the gains converge in a few seconds and then barely change).
+#define MPU_BIAS_KF_GAIN_PERIOD           1                 // Samples between the covariance updates of the bias Kalman filter (1 to 255)
+
+// --- Estimators ---
+// Estimators updated by updateEstimators() with the same sample (they can be combined: MPU_ESTIMATOR_KF | MPU_ESTIMATOR_GYRO)
+#define MPU_ESTIMATOR_KF                  0x01              // Simplified Kalman filter, the result is stored in state
+#define MPU_ESTIMATOR_GYRO                0x02              // Gyroscope only estimation (testing), the result is stored in state_gyro (not in MPU_LEAN_PROFILE)
+#define MPU_ESTIMATOR_ACCEL               0x04              // Accelerometer only estimation (testing), the result is stored in state_accel_est (not in MPU_LEAN_PROFILE)
+#define MPU_ESTIMATOR_KF_FIXED            0x08              // Fixed-point Kalman filter (needs MPU_FIXED_POINT), the result is stored in state_fixed
+#define MPU_ESTIMATOR_KF_BIAS             0x10              // Kalman filter with gyroscope bias states, the result is stored in state_bias_kf and gyro_bias
+#define MPU_ESTIMATOR_MAHONY              0x20              // Mahony filter, the result is stored in mahony_quaternion (getMahonyState() for the angles)
+
+// --- Mahony filter ---
+// The gyroscope is integrated every sample and the accelerometer correction is done every MPU_MAHONY_ACCEL_PERIOD samples with their mean
+#define MPU_MAHONY_KP                     2.0               // Proportional gain of the accelerometer correction (rad/s per unit of error)
+#define MPU_MAHONY_KI                     0.05              // Integral gain of the accelerometer correction (estimates the gyroscope bias)
+#define MPU_MAHONY_ACCEL_PERIOD           4                 // Samples between the accelerometer corrections (1 to 255)
+#define MPU_MAHONY_ACCEL_TOLERANCE        0.4               // The correction is skipped if |a|^2 isn't in 1 +- tolerance (g^2), the MPU is accelerating
+
+// --- Fixed-point ---
+// The fixed-point filter uses Q16.16 values (1.0 = MPU_FIXED_ONE) for the angles, angular speeds, accelerations and trigonometric
+// values, Q2.30 for the state covariance and Q8.24 for the accelerometer covariance
+#ifdef MPU_FIXED_POINT
+  typedef int32_t mpu_fixed_t;                              // Fixed-point value
+  #define MPU_FIXED_SHIFT                 16                // Number of fractional bits of the Q16.16 values
+  #define MPU_FIXED_ONE                   65536L            // 1.0 in Q16.16
+  #define MPU_FIXED_PI                    205887L           // pi in Q16.16
+  #define MPU_FIXED_HALF_PI               102944L           // pi/2 in Q16.16
+  #define MPU_FIXED_TWO_PI                411775L           // 2*pi in Q16.16
+  #define MPU_FIXED_COV_MAX               0x7FFFFFFFL       // Saturation value for the covariances
+  #define MPU_FIXED_MAX_DELTA_TIME        100               // Maximum time step in ms of the fixed-point filter (longer steps are saturated)
+  const mpu_fixed_t gyro_covariance_fixed = 13321;          // gyro_covariance in Q16.16
+  const mpu_fixed_t accel_covariance_fixed = 16777216L;     // accel_covariance in Q8.24
+  constexpr mpu_fixed_t accel_scale_fixed = (mpu_fixed_t)(16777216.0 * accel_scale + 0.5);  // accel_scale in Q8.24 (g per LSB)
+  constexpr mpu_fixed_t gyro_scale_fixed = (mpu_fixed_t)(16777216.0 * gyro_scale + 0.5);    // gyro_scale in Q8.24 (rad/s per LSB)
+#endif
+
+// --- Timing ---
+#if MPU_TIMING_MODE == MPU_TIMING_MICROS
+  #define MPU_TIME_NOW()                  micros()          // Time stamp of the samples
+  #define MPU_TIME_UNITS_PER_SECOND       1000000.0         // Time stamp units per second
+#elif MPU_TIMING_MODE == MPU_TIMING_MILLIS
+  #define MPU_TIME_NOW()                  millis()          // Time stamp of the samples
+  #define MPU_TIME_UNITS_PER_SECOND       1000.0            // Time stamp units per second
+#endif
+
+// --- Fast math ---
+#ifdef MPU_FAST_TRIG
+  #define MPU_TRIG_TABLE_SIZE             (1 << MPU_TRIG_TABLE_BITS)            // Number of steps of the tables (a quarter of a turn for the sine)
+  #define MPU_TRIG_PHASE_SCALE            (MPU_TRIG_TABLE_SIZE * 512.0 / M_PI)  // Phase units (1/256 of a table step) per rad
+  #define MPU_TRIG_FIXED_PHASE_SCALE      ((int32_t)(MPU_TRIG_PHASE_SCALE + 0.5))  // Phase units per rad as a Q16.16 factor (for Q16.16 angles)
+  #define MPU_TRIG_HALF_PI                102944L                               // pi/2 in Q16.16
+  #define MPU_TRIG_PI                     205887L                               // pi in Q16.16
+#endif
+
 
 
 
+// --- Sample buffer ---
+#ifdef MPU_SAMPLE_BUFFER
+  #if (MPU_SAMPLE_BUFFER_SIZE & (MPU_SAMPLE_BUFFER_SIZE - 1)) || (MPU_SAMPLE_BUFFER_SIZE > 128) || (MPU_SAMPLE_BUFFER_SIZE < 2)
+    #error "MPU_SAMPLE_BUFFER_SIZE must be a power of two between 2 and 128"
+  #endif
+  #define MPU_SAMPLE_BUFFER_MASK          (MPU_SAMPLE_BUFFER_SIZE - 1)  // Mask to wrap the buffer indexes
+  #define MPU_SAMPLE_DRAIN_FRAMES         8                 // Number of FIFO frames read at once by drainFifoToBuffer() (12 bytes of stack each)
+
+  struct MpuSample {
+    int16_t values[6];                                      // Raw measurements: A_X, A_Y, A_Z, G_X, G_Y, G_Z
+    unsigned long time_stamp;                               // Time stamp of the sample (see MPU_TIMING_MODE)
+  };
+#endif
+
+// --- Pre-filter ---
+#ifdef MPU_PREFILTER
+  #if (MPU_PREFILTER_DECIMATION < 1) || (MPU_PREFILTER_DECIMATION > 16)
+    #error "MPU_PREFILTER_DECIMATION must be between 1 and 16"
+  #endif
+  #if (MPU_PREFILTER_TYPE == MPU_PREFILTER_CIC) && ((MPU_PREFILTER_CIC_ORDER < 1) || (MPU_PREFILTER_CIC_ORDER > 3))
+    #error "MPU_PREFILTER_CIC_ORDER must be between 1 and 3"
+  #endif
+  #define MPU_PREFILTER_MAX_DECIMATION    16                // The CIC gain (decimation^order) fits in 13 bits, so the sums fit in an int32_t
+  #define MPU_PREFILTER_Q                 14                // Fractional bits of the biquad coefficients
+  #if MPU_PREFILTER_TYPE == MPU_PREFILTER_CIC
+    #define MPU_PREFILTER_WARM_UP         MPU_PREFILTER_CIC_ORDER  // Outputs discarded after a restart (one per comb)
+  #else
+    #define MPU_PREFILTER_WARM_UP         1                 // The biquad state is set with the first sample
+  #endif
+#endif
+
+// --- Profiling ---
+#ifdef MPU_PROFILING
+  #define MPU_STAGE_I2C_READ              0                 // readMpuRegisters()
+  #define MPU_STAGE_REFINE                1                 // refineValues() (offset correction and conversion)
+  #define MPU_STAGE_ROTATE                2                 // rotate()
+  #define MPU_STAGE_ACCEL_STATE           3                 // accelState()
+  #define MPU_STAGE_KF_UPDATE             4                 // Kalman gain and update of simplifiedKF()
+  #define MPU_STAGE_KF_TOTAL              5                 // Whole simplifiedKF() with the given measurements
+  #define MPU_PROFILE_STAGES              6                 // Number of stages
+
+  struct MpuStageStats {
+    uint32_t count;                                         // Number of times the stage has been executed
+    uint32_t total_us;                                      // Total time in us (mean = total_us / count)
+    uint16_t min_us;                                        // Minimum time in us
+    uint16_t max_us;                                        // Maximum time in us
+  };
+
+  struct MpuProfile {
+    MpuStageStats stages[MPU_PROFILE_STAGES];               // Time of each stage (MPU_STAGE_*)
+    uint16_t i2c_retries;                                   // I2C transfers that had to be repeated
+    uint16_t i2c_errors;                                    // I2C transfers that failed after all the retries (timeouts or wrong values)
+    uint16_t overruns;                                      // Samples overwritten before being read (dropped_samples since resetProfile())
+  };
+#endif
+
+// --- Telemetry ---
+// Frame (little endian): type (1 byte), sequence (2), time stamp (4), values (6 x 2) and CRC-16/CCITT-FALSE of the previous bytes (2).
+// The frame is COBS encoded, so it has no zeros, and followed by a 0x00 delimiter.
+#if (MPU_TELEMETRY_TX_BUFFER_SIZE & (MPU_TELEMETRY_TX_BUFFER_SIZE - 1)) || (MPU_TELEMETRY_TX_BUFFER_SIZE > 128) || (MPU_TELEMETRY_TX_BUFFER_SIZE < 32)
+  #error "MPU_TELEMETRY_TX_BUFFER_SIZE must be a power of two between 32 and 128"
+#endif
+#define MPU_TELEMETRY_TX_BUFFER_MASK      (MPU_TELEMETRY_TX_BUFFER_SIZE - 1)  // Mask to wrap the buffer indexes
+#define MPU_TELEMETRY_RAW                 0x01              // Frame with the raw measurements (A_X, A_Y, A_Z, G_X, G_Y, G_Z in LSB)
+#define MPU_TELEMETRY_ANGLES              0x02              // Frame with angles (rad * MPU_TELEMETRY_ANGLE_SCALE, unused values set to 0)
+#define MPU_TELEMETRY_VALUES              6                 // Number of values of each frame
+#define MPU_TELEMETRY_ANGLE_SCALE         10000.0           // Angles resolution (1e-4 rad, range +-3.27 rad)
+#define MPU_TELEMETRY_PAYLOAD_LENGTH      19                // Bytes of the frame covered by the CRC
+#define MPU_TELEMETRY_FRAME_LENGTH        21                // Bytes of the frame (payload and CRC)
+#define MPU_TELEMETRY_ENCODED_LENGTH      22                // Bytes of the COBS encoded frame (without the delimiter)
+#define MPU_TELEMETRY_CRC_INIT            0xFFFF            // Initial value of the CRC (polynomial 0x1021)
+
+struct MpuTelemetryFrame {
+  uint8_t type;                                             // MPU_TELEMETRY_RAW or MPU_TELEMETRY_ANGLES
+  uint16_t sequence;                                        // Sequence number (the gaps are the frames lost)
+  uint32_t time_stamp;                                      // Time stamp of the sample (see MPU_TIMING_MODE)
+  int16_t values[MPU_TELEMETRY_VALUES];                     // Measurements or scaled angles
+};
+
+// --- Temperature compensation ---
+#ifdef MPU_TEMP_COMPENSATION
+  #if (MPU_TEMP_TABLE_POINTS > 8) || (MPU_TEMP_TABLE_POINTS < 1)
+    #error "MPU_TEMP_TABLE_POINTS must be between 1 and 8"
+  #endif
+
+  struct MpuTemperaturePoint {
+    int16_t temperature;                                    // Raw temperature of the point (see MPU_TEMP_LSB_PER_DEGREE)
+    int16_t gyro_correction[3];                             // Gyroscope offset correction (G_X, G_Y, G_Z) in LSB
+  };
+#endif
+
+// --- Calibration record ---
+// Calibration data stored in the EEPROM. The compiler pads the structures to the alignment of the float on 32-bit boards (4 bytes),
+// but not on AVR, so the fields add up to a multiple of 4 (reserved) and the EEPROM layout is the same on every board
+struct MpuCalibrationRecord {
+  float temperature;                                        // Temperature of the calibration in degC
+  int16_t offsets[6];                                       // Offsets of the MPU (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+  int16_t offset_correction[6];                             // Offset correction after the calibration
+  #ifdef MPU_TEMP_COMPENSATION
+    MpuTemperaturePoint temp_table[MPU_TEMP_TABLE_POINTS];  // Temperature table (only valid with the same gyroscope full-scale)
+    uint8_t temp_table_valid;                               // Points of the table with data (one bit per point)
+  #endif
+  uint8_t version;                                          // MPU_EEPROM_RECORD_VERSION
+  uint8_t sequence;                                         // Write counter, the valid record with the highest one is the newest
+  uint8_t accel_reg;                                        // Accelerometer full-scale of the offset correction (working_accel_reg)
+  uint8_t gyro_reg;                                         // Gyroscope full-scale of the offset correction (working_gyro_reg)
+  #ifdef MPU_TEMP_COMPENSATION
+    uint8_t reserved;                                       // Always 0, so the size is a multiple of 4 (any MPU_TEMP_TABLE_POINTS)
+  #else
+    uint8_t reserved[2];                                    // Always 0, so the size is a multiple of 4
+  #endif
+  uint16_t crc;                                             // CRC-16 of the previous fields (MpuTelemetry::crc16())
+};
+static_assert((offsetof(MpuCalibrationRecord, crc) + sizeof(uint16_t) == sizeof(MpuCalibrationRecord)) &&
+              (sizeof(MpuCalibrationRecord) % 4 == 0), "MpuCalibrationRecord has padding, the EEPROM layout depends on the board");
+
+// --- Health statistics ---
+struct MpuHealthStats {
+  uint16_t faults[MPU_FAULT_TYPES];                         // Faults detected of each type (MPU_FAULT_* - 1)
+  uint16_t bus_clears;                                      // Recoveries with SDA stuck low (released with the SCL pulses)
+  uint16_t recoveries;                                      // Successful recoveries
+  uint16_t failed_recoveries;                               // Recovery attempts that couldn't initialize the MPU
+  uint32_t saturated_samples;                               // Samples with a saturated value
+  unsigned long recovery_time;                              // Time in ms from the fault detection to the end of the last recovery
+  uint8_t last_fault;                                       // Last fault detected (MPU_FAULT_*)
+};
+
+// --- Calibration statistics ---
+struct MpuCalibrationStats {
+  uint16_t iterations[6];                                   // Number of measurements of each axis (A_X, A_Y, A_Z, G_X, G_Y, G_Z)
+  uint32_t samples[6];                                      // Number of samples taken for each axis
+  unsigned long time_ms[6];                                 // Time in ms spent sampling each axis
+  unsigned long total_time_ms;                              // Duration of the whole calibration in ms
+};
+
+// --- Calibration context ---
+// State of the offset search and of the incremental means, so the calibration can be advanced one sample at a time (calibrationStep())
+struct MpuCalibrationContext {
+  int16_t offsets[6];                                       // Current offsets
+  int16_t prev_offsets[6];                                  // Offsets of the previous measurement
+  int16_t low_offsets[6];                                   // Highest offsets with a negative mean
+  int16_t high_offsets[6];                                  // Lowest offsets with a positive mean
+  int16_t best_offsets[6];                                  // Offsets with the lowest absolute mean
+  float prev_means[6];                                      // Means of the previous measurement
+  float best_means[6];                                      // Lowest absolute means
+  float sensitivity[6];                                     // LSB per offset step of each axis
+  uint8_t found_low;                                        // Axes with a low offset found (one bit per axis)
+  uint8_t found_high;                                       // Axes with a high offset found (one bit per axis)
+  uint8_t pending_axes;                                     // Axes that haven't been calibrated yet (one bit per axis)
+  uint16_t iterations;                                      // Number of search iterations
+  unsigned long start_time;                                 // millis() when the calibration was started
+  // -- Incremental means --
+  int16_t targets[6];                                       // Expected values
+  float means[6];                                           // Running means (mean - target)
+  float m2[6];                                              // Sum of the squared differences to the mean (variance * n)
+  uint16_t samples[6];                                      // Number of samples of each axis
+  uint8_t means_axes;                                       // Axes being sampled
+  uint8_t pending_means;                                    // Axes that haven't reached the confidence interval yet
+  bool means_early_stop;                                    // Stop the axes once they reach the confidence interval
+  uint16_t means_count;                                     // Number of samples taken
+  uint16_t means_max_samples;                               // Maximum number of samples
+  unsigned long means_start_time;                           // millis() when the means were started
+};
+
 //            *********************
 //            *   Class object    *
 //            *********************
 class MpuDev{
 
+  friend class MpuScheduler;
+
   public:
+    // --- Constructor ---
+    MpuDev(uint8_t i2c_address_funct = I2C_ADDRESS_MPU,
+           uint8_t eeprom_slot = 0);                        // Sets the I2C address and the EEPROM slot of the calibration data
+
     // --- Variables ---
     // -- MPU state --
     uint8_t mpu_state_global;                               // State of the MPU
+    // -- Data ready --
+    volatile bool mpu_data_ready = false;                   // Set by dataReadyInterrupt() when there is a new sample (true = new data ready)
+    volatile unsigned long time_buffer = 0;                 // Time stamp of the last sample (see MPU_TIMING_MODE)
     // -- Kalman Filter --
-    double state[2] = {0, 0};                               // State for the Kalman filter (angle X, angle Y) in rad
-    double state_covariance[2] = {0, 0};                    // Covariance "matrix of the state" it is assumed to be diagonal (it shouldn't be) in rad^2
-    double rotated_ang_speed_prev[2] = {0, 0};              // Previous rotated angular speed in rad/s
-    unsigned long prev_time = 0;                            // Previous time stamp in ms
+    mpu_real_t state[2] = {0, 0};                           // State for the Kalman filter (angle X, angle Y) in rad
+    mpu_real_t state_covariance[2] = {0, 0};                // Covariance "matrix of the state" it is assumed to be diagonal (it shouldn't be) in rad^2
+    mpu_real_t rotated_ang_speed_prev[2] = {0, 0};          // Previous rotated angular speed in rad/s
+    unsigned long prev_time = 0;                            // Previous time stamp (see MPU_TIMING_MODE)
+    uint8_t enabled_estimators = MPU_ESTIMATOR_KF;          // Estimators updated by updateEstimators()
+    // -- Bias Kalman filter --
+    // Two independent filters (X and Y) with the states angle and gyroscope bias, each with its full 2x2 covariance matrix
+    mpu_real_t state_bias_kf[2] = {0, 0};                   // Angles estimated by the bias Kalman filter (angle X, angle Y) in rad
+    mpu_real_t gyro_bias[2] = {0, 0};                       // Estimated bias of the X and Y gyroscopes (MPU frame) in rad/s
+    mpu_real_t bias_kf_covariance[2][3] = {{0, 0, gyro_bias_initial_covariance}, 
+                                       {0, 0, gyro_bias_initial_covariance}};  // Covariance of each axis: P_angle, P_angle_bias, P_bias
+    // -- Mahony filter --
+    mpu_real_t mahony_quaternion[4] = {1, 0, 0, 0};         // Orientation of the MPU (W, X, Y, Z) from the MPU frame to the global one
+    mpu_real_t state_mahony[2] = {0, 0};                    // Angles of the Mahony filter (angle X, angle Y) in rad, updated by getMahonyState()
     // -- Testing --
-    double state_gyro[2] = {0, 0};                          // State to test gyro
-    double state_gyro_cov[2] = {0, 0};                      // State covariance to test gyro
-    double rotated_ang_speed_prev_2[2] = {0, 0};            // Previous rotated angular speed in rad/s
-    double state_accel_est[2] = {0, 0};                     // State to test accel
-    double state_accel_cov[2] = {0, 0};                     // State covariance to test accel
+    #ifndef MPU_LEAN_PROFILE
+      mpu_real_t state_gyro[2] = {0, 0};                    // State to test gyro
+      mpu_real_t state_gyro_cov[2] = {0, 0};                // State covariance to test gyro
+      mpu_real_t rotated_ang_speed_prev_2[2] = {0, 0};      // Previous rotated angular speed in rad/s
+      mpu_real_t state_accel_est[2] = {0, 0};               // State to test accel
+      mpu_real_t state_accel_cov[2] = {0, 0};               // State covariance to test accel
+    #endif
+    // -- Fixed-point Kalman Filter --
+    #ifdef MPU_FIXED_POINT
+      mpu_fixed_t state_fixed[2] = {0, 0};                  // State for the fixed-point Kalman filter (angle X, angle Y) in rad (Q16.16)
+      mpu_fixed_t state_covariance_fixed[2] = {0, 0};       // Covariance of the fixed-point state in rad^2 (Q2.30)
+      mpu_fixed_t rotated_ang_speed_prev_fixed[2] = {0, 0}; // Previous rotated angular speed in rad/s (Q16.16)
+      unsigned long prev_time_fixed = 0;                    // Previous time stamp of the fixed-point filter
+    #endif
+    // -- Working configuration --
+    uint8_t working_accel_reg = MPU_ACCEL_CONFIG_VALUE;     // Working value of the accelerometer configuration register
+    uint8_t working_gyro_reg = MPU_GYRO_CONFIG_VALUE;       // Working value of the gyroscope configuration register
+    uint8_t working_sample_rate_reg = MPU_SAMPLE_RATE_WORKING;  // Working value of the sample rate divider register
+    uint8_t working_dlpf_reg = MPU_DLPF_REG_VALUE_WORKING;  // Working value of the DLPF register
+    mpu_real_t working_sample_period = MPU_SAMPLE_PERIOD_WORKING; // Sample period in s (used with MPU_TIMING_FIXED)
+    mpu_real_t working_accel_scale = accel_scale;           // Accelerometer scale (g per LSB) used by refineValues()
+    mpu_real_t working_gyro_scale = gyro_scale;             // Gyroscope scale (rad/s per LSB) used by refineValues()
+    uint8_t working_int_enable_reg = MPU_INTERRUPT_DEFAULT; // Working value of the interrupt enable register (configureInterrupt())
+    uint8_t working_int_pin_reg = MPU_INT_PIN_DEFAULT;      // Working value of the interrupt pin configuration register (configureInterrupt())
+    #ifdef MPU_FIXED_POINT
+      mpu_fixed_t working_sample_period_fixed = (mpu_fixed_t)(MPU_SAMPLE_PERIOD_WORKING * 16777216.0 + 0.5);  // working_sample_period in Q8.24
+      mpu_fixed_t working_accel_scale_fixed = accel_scale_fixed;  // working_accel_scale in Q8.24
+      mpu_fixed_t working_gyro_scale_fixed = gyro_scale_fixed;    // working_gyro_scale in Q8.24
+    #endif
+    // -- Temperature --
+    int16_t temperature_raw = 0;                            // Raw temperature of the last reading of the measurements (readMpuMeasurements(),
+                                                            // pollReadMpuMeasurements(), MpuScheduler::readAll() and readFifoFrames())
+    #ifdef MPU_TEMP_COMPENSATION
+      MpuTemperaturePoint temp_table[MPU_TEMP_TABLE_POINTS];  // Temperature table of the gyroscope offset correction (one point per band)
+      uint8_t temp_table_valid = 0;                         // Points of the table with data (one bit per point)
+    #endif
+    // -- Gyroscope bias tracking --
+    #ifdef MPU_BIAS_TRACKING
+      bool mpu_still = false;                               // The stillness detector considers the MPU still (the bias is being tracked)
+      unsigned long bias_updates = 0;                       // Number of samples used to update the gyroscope offset correction
+    #endif
+    // -- Pre-filter --
+    #ifdef MPU_PREFILTER
+      uint8_t prefilter_decimation = MPU_PREFILTER_DECIMATION;  // Input samples per output sample of the pre-filter (setPrefilter())
+    #endif
+    // -- Calibration --
+    MpuCalibrationStats calibration_stats;                  // Per-axis statistics of the last calibration (calibrate())
+    uint8_t calibration_state = MPU_CALIB_IDLE;             // State of the calibration (calibrate() and calibrationStep())
+    uint8_t self_test_state = MPU_SELF_TEST_IDLE;           // State of the self-test (checkMpu() and selfTestStep())
+    // -- DMP --
+    #ifdef MPU_DMP_MODE
+      float dmp_quaternion[4] = {1, 0, 0, 0};               // Last quaternion of the DMP (W, X, Y, Z)
+      float dmp_gravity[3] = {0, 0, 1};                     // Gravity direction in the MPU frame (X, Y, Z) in g
+      float dmp_ypr[3] = {0, 0, 0};                         // Yaw, pitch and roll in rad
+    #endif
+    // -- Sample buffer --
+    #ifdef MPU_SAMPLE_BUFFER
+      volatile uint16_t sample_buffer_drops = 0;            // Samples discarded because the buffer was full
+      uint8_t sample_buffer_high_water = 0;                 // Maximum number of samples stored in the buffer
+    #endif
+    // -- Timing --
+    volatile unsigned long sample_sequence = 0;             // Number of data ready interrupts (dataReadyInterrupt())
+    volatile uint16_t dropped_samples = 0;                  // Samples overwritten before being read (interrupts with mpu_data_ready still set)
+    // -- FIFO --
+    uint8_t fifo_frame_length = 0;                          // Number of bytes of each FIFO frame (0 = FIFO disabled)
+    // -- Interrupt status --
+    uint8_t interrupt_status = 0;                           // INT_STATUS bits read with the measurements since the last getInterruptStatus()
+    // -- Power management --
+    uint8_t power_state = MPU_POWER_ACTIVE;                 // Power state of the MPU (setPowerState() and updatePowerState())
+    uint8_t motion_threshold = MPU_MOTION_THRESHOLD;        // Motion threshold of MPU_POWER_MOTION (2mg per LSB)
+    uint8_t motion_duration = MPU_MOTION_DURATION;          // Motion duration of MPU_POWER_MOTION in ms
+    unsigned long wake_latency = 0;                         // Time in us from the last wake-up to the first full rate sample
+    uint16_t wake_count = 0;                                // Number of wake-ups (from MPU_POWER_MOTION or setPowerState())
+    // -- Health monitor --
+    #ifdef MPU_HEALTH_MONITOR
+      uint8_t health_state = MPU_HEALTH_OK;                 // State of the health monitor (updateHealth())
+      MpuHealthStats health_stats = {};                     // Faults and recoveries
+    #endif
+    // -- Asynchronous reading --
+    void (*async_callback)(MpuDev *mpu) = NULL;             // Called by the poll functions when an asynchronous reading is completed (optional)
 
     // --- Functions ---
     // -- Tools/other --
     bool readMpuRegisters(uint8_t address_funct, 
                           uint8_t *buffer_funct, 
-                          uint8_t lenght_funct);            // This function read the value of multiple sequential registers
+                          uint8_t lenght_funct,
+                          uint8_t attempts_funct = I2C_MPU_RETRIES);  // This function read the value of multiple sequential registers
 
     bool readMpuRegister(uint8_t address_funct, 
                          uint8_t *buffer_funct);            // This function reads one register of the MPU
@@ -322,65 +944,437 @@ class MpuDev{
                           uint8_t buffer_funct, 
                           bool check_funct = true);         // This function writes one register of the MPU
 
+    bool writeMpuRegisters(uint8_t address_funct,
+                           uint8_t *buffer_funct,
+                           uint8_t length_funct,
+                           bool check_funct = true);        // This function writes multiple sequential registers in one burst
+
     bool updateMpuRegister(uint8_t address_funct,         
                            uint8_t values_funct,
                            uint8_t mask_funct, 
                            bool check_funct = true);        // This function updates the specified bits on the register
 
+    // -- Asynchronous reading --
+    bool startReadMpuRegisters(uint8_t address_funct,
+                               uint8_t length_funct);       // Starts an asynchronous reading of sequential registers
+    uint8_t pollReadMpuRegisters();                         // Advances the asynchronous reading and returns its state
+    uint8_t getAsyncRegisters(uint8_t *buffer_funct);       // Gets the registers of the completed asynchronous reading and frees it
+    bool startReadMpuMeasurements();                        // Starts the asynchronous reading of the measurements
+    uint8_t pollReadMpuMeasurements(int16_t *data_funct);   // Advances the asynchronous measurements reading and loads the values when done
+
     // -- configuration --
     bool initialize_1();                                    // First initialization, configures the device to start measuring
     bool initialize_2();                                    // Second initialization, perform the calibration and offset correction calculations
+    bool initializeFast();                                  // Initialization from the EEPROM record for warm restarts (self-test deferred)
     bool checkMpu();                                        // Checks that the MPU is not damaged
+    uint8_t selfTestStep();                                 // Advances the background self-test (after initializeFast())
     void configureMpu();                                    // Configures the MPU for normal operation
     void resetSignalPath();                                 // Resets the signal path and waits for it to be completed
     void changeFullScale(uint8_t accel_reg,                 // Sets the configuration registers for the accelerometer and gyroscope
                          uint8_t gyro_reg);             
-    void setSampleRate();                                   // Sets the sample rate for the MPU
+    void setSampleRate();                                   // Sets the working sample rate and DLPF for the MPU
+    bool setSampleRate(uint8_t sample_rate_reg,
+                       uint8_t dlpf_reg);                   // Changes the working sample rate divider and DLPF
+    bool setFullScale(uint8_t accel_reg,
+                      uint8_t gyro_reg);                    // Changes the working full-scale ranges and the scale factors
+    bool setWorkingConfig(uint8_t accel_reg,
+                          uint8_t gyro_reg,
+                          uint8_t sample_rate_reg,
+                          uint8_t dlpf_reg);                // Changes the whole working configuration (e.g. idle <--> high rate modes)
+    float getSampleRate();                                  // Gets the working sample rate in Hz
     void setLowPowerMode(bool sleep_enabled);               // Sets the MPU to low power mode or wakes it up
+    bool setPowerState(uint8_t power_state_funct,
+                       uint8_t wake_rate = MPU_LP_WAKE_5HZ);  // Changes the power state (MPU_POWER_*)
+    bool configureInterrupt(uint8_t int_enable_reg,
+                            uint8_t int_pin_reg = MPU_INT_PIN_DEFAULT);  // Sets the enabled interrupts and the INT pin configuration
+    uint8_t getInterruptStatus();                           // Gets and clears the interrupt status bits read since the last call
+    bool checkMotion();                                     // Reads and clears the motion interrupt
+    uint8_t updatePowerState();                             // Wakes up on motion and finishes the wake-up (call it periodically)
+    #ifdef MPU_HEALTH_MONITOR
+      uint8_t updateHealth();                               // Detects the faults and recovers the MPU in steps (call it periodically)
+    #endif
 
     // -- Calibration --
-    void setOffsets(int16_t *offsets);                      // Sets the offsets of the MPU
+    void setOffsets(int16_t *offsets,
+                    uint8_t axes_mask = MPU_ALL_AXES);      // Sets the offsets of the MPU (only the axes in the mask)
+    bool getOffsets(int16_t *offsets);                      // Reads the offset registers of the MPU
     void calculateAverages(int16_t *averages_funct,     
                            uint16_t number_of_iterations, 
                            int16_t *targets_funct);         // Calculates the averages with the given offset values
+    void startMeans(uint16_t max_iterations,
+                    int16_t *targets_funct,
+                    uint8_t axes_mask,
+                    bool early_stop = true);                // Starts an incremental mean calculation
+    bool updateMeans(int16_t *values_raw);                  // Adds one sample to the means, returns true when they are done
+    uint16_t calculateMeans(float *means_funct,
+                            uint16_t max_iterations,
+                            int16_t *targets_funct,
+                            uint8_t axes_mask = MPU_ALL_AXES);  // Calculates the means, stopping once they are accurate enough
+    void startOffsetSearch(int16_t *offsets_funct);         // Starts the offset search of the calibration
+    void advanceOffsetSearch();                             // Advances the offset search when the means are done
     bool calibrate(int16_t *offsets);                       // Main function for the calibration process
     void getOffsetCorrection();                             // Gets the offset correction values
+    void setOffsetCorrection(int16_t *correction_funct);    // Sets the measured offset correction (and the temperature table point)
+    bool needsOffsetCorrection();                           // Checks if the offset correction has to be measured (temperature table)
     bool checkCalibration();                                // Check if the calibration is needed or not
     bool performCalibration();                              // Does the calibration
+    bool configureCalibration();                            // Configures the MPU for the calibration
+    bool storeCalibration(int16_t *offsets_funct);          // Sets the calibration offsets and stores them in the EEPROM
+    bool configureOffsetCorrection();                       // Configures the MPU to get the offset correction values
+    bool finishOffsetCorrection();                          // Restores the working configuration after the offset correction
+    bool finishInitialization();                            // Ends the initialization (finishOffsetCorrection() and the DMP start)
+    bool startCalibration();                                // Starts the non-blocking calibration (same as initialize_2())
+    uint8_t calibrationStep();                              // Advances the non-blocking calibration with the ready sample
+    uint8_t getCalibrationProgress();                       // Gets the progress of the calibration in % (100 = done)
 
     // EEPROM
     bool loadFromEEPROM(float *temperature_mpu,             // Load the calibration data from the EEPROM 
                         int16_t *offsets_funct);      
-    void saveOnEEPROM(float *temperature_mpu,               // Store the calibration data on the EEPROM
+    bool saveOnEEPROM(float *temperature_mpu,               // Store the calibration data on the EEPROM
                       int16_t *offsets_funct);        
+    bool flushEEPROM();                                     // Stores the changes of the operation (temperature table), call it when idle
 
     // Measurements
     float getTemperature();                                 // Get the temperature measurements of the MPU
     void getParameter6(int16_t *values_funct);              // Get the measurements from the MPU
-    void getRefinedValues(double *measurements_funct);      // Get the refined measurements from the MPU
+    void refineValues(int16_t *raw_values,
+                      mpu_real_t *measurements_funct);      // Refine the given raw measurements
+    void getRefinedValues(mpu_real_t *measurements_funct);  // Get the refined measurements from the MPU
+    void refineBatch(int16_t *raw_axes,
+                     float *refined_axes,
+                     uint16_t count);                       // Refines a block of raw samples (structure of arrays)
+    static void deinterleaveFrames(int16_t *frames_funct,
+                                   int16_t *raw_axes,
+                                   uint16_t count);         // Converts frames (readFifoFrames()) to the layout of refineBatch()
+
+    // Temperature compensation
+    #ifdef MPU_TEMP_COMPENSATION
+      bool updateTemperatureCompensation(int16_t temperature_funct,
+                                         bool force = false);  // Interpolates the gyroscope correction at the given raw temperature
+      bool learnTemperaturePoint(int16_t *values_raw);      // Adds a still sample to the point being learned, true when it is done
+      void addTemperaturePoint(int16_t temperature_funct,
+                               int16_t *gyro_correction);   // Sets the point of the band of the temperature (stored by flushEEPROM())
+    #endif
+
+    // Pre-filter
+    #ifdef MPU_PREFILTER
+      bool setPrefilter(uint8_t decimation_funct);          // Sets the decimation factor and restarts the pre-filter
+      #if MPU_PREFILTER_TYPE == MPU_PREFILTER_BIQUAD
+        void setPrefilterBiquad(int16_t *coefficients_funct);  // Sets the biquad coefficients (b0, b1, b2, a1, a2 in Q14)
+      #endif
+      bool prefilterSample(int16_t *raw_values);            // Filters a raw sample, true when a decimated sample is ready
+    #endif
+
+    // FIFO
+    bool enableFifo(uint8_t sensors_funct = MPU_FIFO_SENSORS_DEFAULT);  // Enables the FIFO for the given sensors
+    bool disableFifo();                                     // Disables the FIFO
+    bool resetFifo();                                       // Clears the FIFO (and the overflow state)
+    uint16_t getFifoCount();                                // Gets the number of bytes stored in the FIFO
+    uint16_t readFifoFrames(int16_t *frames_funct,
+                            uint16_t max_frames);           // Reads the stored FIFO frames in bursts
+
+    // DMP
+    #ifdef MPU_DMP_MODE
+      bool startDmp();                                      // Sets the DMP configuration and starts the DMP
+      bool readDmp();                                       // Reads the newest DMP packet and updates the quaternion, gravity and yaw-pitch-roll
+    #endif
+
+    // Profiling
+    #ifdef MPU_PROFILING
+      void getProfile(MpuProfile *profile_funct);           // Gets a copy of the profiling data
+      void resetProfile();                                  // Clears the profiling data
+      void profileStage(uint8_t stage,
+                        unsigned long start_time);          // Adds the time since start_time (micros()) to the stage
+    #endif
+
+    // Sample buffer
+    // Single producer (pushSample(), acquireSample() or drainFifoToBuffer()) and single consumer (popSample() or processSamples()).
+    #ifdef MPU_SAMPLE_BUFFER
+      bool pushSample(int16_t *values_funct,
+                      unsigned long time_stamp);            // Stores a sample in the buffer (it can be called from an interrupt)
+      bool popSample(MpuSample *sample_funct);              // Gets the oldest sample from the buffer
+      uint8_t getSampleCount();                             // Gets the number of samples stored in the buffer
+      bool acquireSample();                                 // Reads the ready sample (asynchronously) and stores it in the buffer
+      uint16_t drainFifoToBuffer();                         // Reads the FIFO frames and stores them in the buffer
+      uint8_t processSamples(uint8_t max_samples = MPU_SAMPLE_BUFFER_SIZE);  // Updates the estimators with the stored samples
+    #endif
+
+    // Fast math
+    #ifdef MPU_FAST_TRIG
+      int32_t tableSin(int32_t phase);                      // Q16.16 sine from the lookup table (phase in 1/256 of a table step)
+      int32_t tableAtan(uint32_t ratio);                    // Q16.16 atan from the lookup table (ratio in [0, 1] with MPU_TRIG_TABLE_BITS + 8 fractional bits)
+      int32_t tableAtan2(int32_t y, int32_t x);             // Q16.16 atan2 from the lookup table (y and x can use any scale)
+      mpu_real_t fastSin(mpu_real_t x);                     // Sine using the lookup table
+      mpu_real_t fastCos(mpu_real_t x);                     // Cosine using the lookup table
+      mpu_real_t fastAtan2(mpu_real_t y, mpu_real_t x);     // atan2 using the lookup table
+    #endif
 
     // Kalman filter
-    void integrate(double d_time, 
-                   double *angular_speed_1, 
-                   double *angular_speed_2,
-                   double *integration_result);             // Trapezoidal numeric integration
-    void rotate(double *measurements_ref, 
-                double *rotated_values);                    // Rotate the angular speed measurements
-    double square(double x);                                // Returns the squared number X^2 = X * X = X**2
-    void accelState(double *measurements_ref, 
-                    double *state_pred,
-                    double *accel_cov_funct);               // State calculation from accelerometer measuremetns
-    double* simplifiedKF(unsigned long current_time);       // Kalman Filter main function
+    void integrate(mpu_real_t d_time, 
+                   mpu_real_t *angular_speed_1, 
+                   mpu_real_t *angular_speed_2,
+                   mpu_real_t *integration_result);         // Trapezoidal numeric integration
+    void rotate(mpu_real_t *measurements_ref, 
+                mpu_real_t *rotated_values,
+                mpu_real_t *angles_funct = NULL);           // Rotate the angular speed measurements (with state by default)
+    mpu_real_t square(mpu_real_t x);                        // Returns the squared number X^2 = X * X = X**2
+    void accelState(mpu_real_t *measurements_ref, 
+                    mpu_real_t *state_pred,
+                    mpu_real_t *accel_cov_funct);           // State calculation from accelerometer measuremetns
+    mpu_real_t* simplifiedKF(unsigned long current_time);   // Kalman Filter main function
+    mpu_real_t* simplifiedKF(unsigned long current_time,
+                             mpu_real_t *measurements_funct); // Kalman Filter with the given refined measurements
+    mpu_real_t* biasKF(unsigned long current_time);         // Kalman Filter with gyroscope bias estimation
+    mpu_real_t* biasKF(unsigned long current_time,
+                       mpu_real_t *measurements_funct);     // Kalman Filter with gyroscope bias estimation with the given refined measurements
+    mpu_real_t* mahonyFilter(unsigned long current_time);   // Mahony filter (quaternion, no trigonometric functions)
+    mpu_real_t* mahonyFilter(unsigned long current_time,
+                             mpu_real_t *measurements_funct); // Mahony filter with the given refined measurements
+    mpu_real_t* getMahonyState();                           // Converts the Mahony quaternion into the X and Y angles (state_mahony)
 
     // Test
-    double* testGyroEst(unsigned long current_time);        // Test gyro estimation
-    double* testAccelEst(unsigned long current_time);       // Test accel estimation
+    #ifndef MPU_LEAN_PROFILE
+      mpu_real_t* testGyroEst(unsigned long current_time);  // Test gyro estimation
+      mpu_real_t* testGyroEst(unsigned long current_time,
+                              mpu_real_t *measurements_funct);  // Test gyro estimation with the given refined measurements
+      mpu_real_t* testAccelEst(unsigned long current_time); // Test accel estimation
+      mpu_real_t* testAccelEst(unsigned long current_time,
+                               mpu_real_t *measurements_funct);  // Test accel estimation with the given refined measurements
+    #endif
+
+    // Fixed-point Kalman filter
+    #ifdef MPU_FIXED_POINT
+      mpu_fixed_t fixedMul(mpu_fixed_t a, mpu_fixed_t b);   // Q16.16 multiplication
+      uint32_t fixedSqrt(uint32_t x);                       // Integer square root
+      mpu_fixed_t fixedSin(mpu_fixed_t angle);              // Q16.16 sine
+      mpu_fixed_t fixedCos(mpu_fixed_t angle);              // Q16.16 cosine
+      mpu_fixed_t fixedAtan2(int32_t y, int32_t x);         // Q16.16 arc tangent of y/x (y and x can use any scale)
+      void refineValuesFixed(int16_t *raw_values,
+                             mpu_fixed_t *measurements_funct);  // Refine the given raw measurements in fixed-point
+      void rotateFixed(mpu_fixed_t *measurements_ref,
+                       mpu_fixed_t *rotated_values);        // Rotate the angular speed measurements in fixed-point
+      void accelStateFixed(mpu_fixed_t *measurements_ref,
+                           mpu_fixed_t *state_pred,
+                           mpu_fixed_t *accel_cov_funct);   // State calculation from accelerometer measurements in fixed-point
+      mpu_fixed_t* simplifiedKFFixed(unsigned long current_time,
+                                     int16_t *raw_values);  // Fixed-point Kalman Filter
+      void getFixedState(mpu_real_t *state_funct);          // Converts state_fixed to rad (to compare it with state)
+    #endif
+
+    // Timing
+    void dataReadyInterrupt();                              // Data ready interrupt routine: sets mpu_data_ready and time_buffer
+    mpu_real_t getDeltaTime(unsigned long current_time,
+                            unsigned long previous_time);   // Time between two time stamps in s (see MPU_TIMING_MODE)
+    #ifdef MPU_FIXED_POINT
+      mpu_fixed_t getDeltaTimeFixed(unsigned long current_time,
+                                    unsigned long previous_time);  // Time between two time stamps in s (Q8.24), saturated
+    #endif
+
+    // Estimators
+    bool updateEstimators(unsigned long current_time);      // Reads one sample and updates all the enabled estimators with it
+    bool updateEstimators(unsigned long current_time,
+                          int16_t *raw_values);             // Updates all the enabled estimators with the given raw measurements
+    bool updateEstimators(unsigned long current_time,
+                          mpu_real_t *measurements_funct);  // Updates all the enabled estimators with the given refined measurements
 
     // TBD
     void initializeMeasurements();                          // This function is to initialize the measurements for the kalman filter
       
   private:
-    int16_t offset_correction[6];                           // Offset correction array
+    int16_t offset_correction[6] = {0, 0, 0, 0, 0, 0};      // Offset correction array
+    MpuCalibrationContext calibration;                      // State of the calibration in progress
+    // -- Asynchronous reading --
+    uint8_t async_state = MPU_ASYNC_IDLE;                   // State of the asynchronous transfer
+    uint8_t async_step;                                     // Current step of the I2C transfer
+    uint8_t async_address;                                  // Register address of the asynchronous transfer
+    uint8_t async_length;                                   // Number of registers of the asynchronous transfer
+    uint8_t async_index;                                    // Number of registers already received
+    uint8_t async_retries;                                  // Number of retries done
+    unsigned long async_step_time;                          // micros() time when the last step was started
+    uint8_t async_buffer[I2C_ASYNC_BUFFER_LENGTH];          // Registers received
+    bool async_notified = false;                            // async_callback has been called (blocking reading of the boards without TWI)
+    #ifdef MPU_ASYNC_TWI
+      void releaseAsyncBus();                               // Sends the stop and gives the bus back to the Wire library
+    #endif
+    // -- Profiling --
+    #ifdef MPU_PROFILING
+      MpuProfile profile = {};                              // Profiling data (check getProfile())
+      uint16_t profile_dropped_base = 0;                    // dropped_samples at the last resetProfile()
+    #endif
+    // -- Kalman filter accelerometer decimation --
+    #if MPU_KF_ACCEL_PERIOD > 1
+      mpu_real_t kf_accel_sum[3] = {0, 0, 0};               // Sum of the accelerometer measurements since the last update in g
+      uint8_t kf_accel_count = 0;                           // Samples since the last accelerometer update
+    #endif
+    // -- Bias Kalman filter --
+    mpu_real_t rotated_ang_speed_prev_bias[2] = {0, 0};     // Previous rotated angular speed (without bias) in rad/s
+    mpu_real_t bias_kf_gain[2][2] = {{0, 0}, {0, 0}};       // Last gains of each axis: K_angle, K_bias
+    mpu_real_t bias_kf_time = 0;                            // Time since the last covariance update in s
+    mpu_real_t bias_kf_time_sq = 0;                         // Sum of the squared time steps since the last covariance update in s^2
+    uint8_t bias_kf_count = 0;                              // Samples since the last covariance update
+    // -- Mahony filter --
+    mpu_real_t mahony_integral[3] = {0, 0, 0};              // Integral of the accelerometer error (gyroscope bias) in rad/s
+    mpu_real_t mahony_accel_sum[3] = {0, 0, 0};             // Sum of the accelerometer measurements since the last correction in g
+    mpu_real_t mahony_time = 0;                             // Time since the last accelerometer correction in s
+    uint8_t mahony_count = 0;                               // Samples since the last accelerometer correction
+    void rotateQuaternion(mpu_real_t *quaternion_funct,
+                          mpu_real_t *angle_funct);         // Rotates the quaternion by the small rotation vector angle_funct
+    // -- DMP --
+    #ifdef MPU_DMP_MODE
+      bool loadDmpFirmware();                               // Resets the MPU and loads the DMP firmware
+      bool dmp_started = false;                             // The DMP is running (the FIFO is used by its packets)
+    #endif
+    // -- Full-scale --
+    static int16_t rescaleCorrection(int16_t correction_funct,
+                                     int8_t shift_funct);   // Converts a correction in LSB after a range change (setFullScale())
+    // -- Initialization --
+    bool startMpu();                                        // Starts the I2C, checks the device ID and wakes up the MPU
+    bool system_started = false;                            // The I2C and the serial debug have been started by startMpu()
+    bool checkSelfTest(uint8_t *values_raw);                // Checks the self-test results
+    unsigned long self_test_start_time;                     // millis() when the background self-test was started
+    // -- EEPROM --
+    float calibration_temperature;                          // Temperature of the last calibration (stored by finishOffsetCorrection())
+    bool eeprom_save_pending = false;                       // The calibration has to be stored in the EEPROM
+    unsigned long eeprom_save_time = 0;                     // millis() of the last record stored by flushEEPROM()
+    bool offset_correction_loaded = false;                  // The offset correction has been loaded from the EEPROM
+    int8_t findEepromRecord(MpuCalibrationRecord *record_funct);  // Finds the newest valid calibration record
+    // -- Temperature compensation --
+    #ifdef MPU_TEMP_COMPENSATION
+      int16_t temp_comp_temperature = INT16_MIN;            // Raw temperature of the last interpolation
+      bool temp_comp_valid = false;                         // The last interpolation had points on both sides or in the same band
+      int32_t temp_learn_sums[3] = {0, 0, 0};               // Sum of the gyroscope measurements of the point being learned
+      int32_t temp_learn_temperature = 0;                   // Sum of the raw temperatures of the point being learned
+      uint16_t temp_learn_count = 0;                        // Samples of the point being learned
+      int8_t getTemperatureBand(int16_t temperature_funct); // Band of the table of a raw temperature
+    #endif
+    // -- Gyroscope bias tracking --
+    #ifdef MPU_BIAS_TRACKING
+      float still_gyro_mean[3];                             // Mean of the gyroscopes after the offset correction in LSB
+      float still_gyro_var[3];                              // Variance of the gyroscopes in LSB^2
+      float still_accel_mean;                               // Mean of the norm of the accelerations in g
+      float still_accel_var;                                // Variance of the norm of the accelerations in g^2
+      float still_gyro_var_limit;                           // MPU_STILL_GYRO_STD in LSB^2 (with the current full-scale)
+      float still_gyro_rate_limit;                          // MPU_STILL_GYRO_RATE in LSB
+      float bias_estimate[3];                               // Gyroscope offset correction being tracked in LSB (without rounding)
+      uint8_t still_samples = 0;                            // Samples in the window of the detector (0 = restart)
+      void trackGyroBias(int16_t *raw_values);              // Updates the stillness detector and the bias with a raw sample
+    #endif
+    // -- Pre-filter --
+    #ifdef MPU_PREFILTER
+      uint8_t prefilter_count = 0;                          // Input samples since the last output
+      uint8_t prefilter_warm_up = MPU_PREFILTER_WARM_UP;    // Outputs to discard after a restart (transient of the filter)
+      #if MPU_PREFILTER_TYPE == MPU_PREFILTER_CIC
+        int32_t prefilter_integrators[MPU_PREFILTER_CIC_ORDER][6] = {};  // Integrators (input rate, the wrap around is cancelled by the combs)
+        int32_t prefilter_combs[MPU_PREFILTER_CIC_ORDER][6] = {};  // Previous inputs of the combs (output rate)
+      #else
+        int16_t prefilter_coefficients[5] = MPU_PREFILTER_BIQUAD_DEFAULT;  // b0, b1, b2, a1, a2 in Q14
+        int16_t prefilter_inputs[2][6];                     // Previous inputs of the biquad (x[n-1], x[n-2])
+        int32_t prefilter_outputs[2][6];                    // Previous outputs of the biquad (y[n-1], y[n-2]) in LSB (Q14)
+      #endif
+    #endif
+    // -- FIFO --
+    uint8_t fifo_sensors = 0;                               // Sensors loaded into the FIFO (enableFifo()), restored by updateHealth()
+    // -- Power management --
+    unsigned long wake_start_time = 0;                      // micros() when the last wake-up was started
+    uint8_t power_wake_rate = MPU_LP_WAKE_5HZ;              // Wake-up rate of the last accelerometer only state (setPowerState())
+    // -- Health monitor --
+    #ifdef MPU_HEALTH_MONITOR
+      int16_t health_last_sample[6] = {0, 0, 0, 0, 0, 0};   // Previous sample (frozen data detection)
+      uint16_t health_frozen_count = 0;                     // Identical samples in a row
+      uint16_t health_saturated_count = 0;                  // Samples in a row with a saturated value
+      uint8_t health_pending_fault = MPU_FAULT_NONE;        // Fault detected by monitorSample()
+      unsigned long health_last_sequence = 0;               // sample_sequence in the last check (data timeout)
+      unsigned long health_sequence_time = 0;               // millis() when sample_sequence changed
+      unsigned long health_fault_time = 0;                  // millis() when the fault was detected
+      unsigned long health_step_time = 0;                   // millis() at the start of the current recovery step
+      uint8_t health_power_state = MPU_POWER_ACTIVE;        // Power state when the fault was detected (restored after the recovery)
+      void monitorSample(int16_t *raw_values);              // Checks a raw sample (frozen and saturated data)
+      bool recoverBus();                                    // Releases the I2C bus (SCL clock-out and STOP), true if SDA was stuck
+    #endif
+    // -- Device --
+    uint8_t i2c_address;                                    // I2C address of the MPU
+    int eeprom_address;                                     // EEPROM address of the calibration data
+    // -- Sample buffer --
+    #ifdef MPU_SAMPLE_BUFFER
+      MpuSample sample_buffer[MPU_SAMPLE_BUFFER_SIZE];      // Ring buffer of samples
+      volatile uint8_t sample_head = 0;                     // Number of samples stored (free running, only written by the producer)
+      volatile uint8_t sample_tail = 0;                     // Number of samples read (free running, only written by the consumer)
+      unsigned long sample_acquire_time;                    // Time stamp of the sample being read by acquireSample()
+      unsigned long fifo_sequence = 0;                      // Sequence number of the last FIFO frame (MPU_TIMING_FIXED time stamps)
+    #endif
+};
+
+//            *********************
+//            *     SCHEDULER     *
+//            *********************
+// It reads several MPUs on the same bus back to back (repeated starts, one STOP at the end), so they are sampled with minimal skew.
+
+class MpuScheduler{
+
+  public:
+    // --- Variables ---
+    uint8_t device_count = 0;                               // Number of MPUs added
+    unsigned long read_skew = 0;                            // Time between the first and the last reading of the last session in us
+
+    // --- Functions ---
+    bool addDevice(MpuDev *device);                         // Adds an MPU to the scheduler (up to MPU_SCHEDULER_MAX_DEVICES)
+    bool readAll(int16_t *values_funct);                    // Reads the measurements of all the MPUs in one bus session (6 values per MPU)
+    uint8_t update();                                       // Reads all the MPUs when all of them have a sample ready and updates their estimators
+
+  private:
+    MpuDev *devices[MPU_SCHEDULER_MAX_DEVICES];             // MPUs read by the scheduler
+};
+
+//            *********************
+//            *     TELEMETRY     *
+//            *********************
+// It sends fixed-size binary frames (23 bytes) instead of text, so the serial port isn't the bottleneck. The frames are buffered and
+// only the bytes that fit in the serial TX buffer are written (availableForWrite()), so sending never blocks the loop.
+
+class MpuTelemetry{
+
+  public:
+    // --- Variables ---
+    uint16_t sequence = 0;                                  // Sequence number of the next frame
+    uint16_t dropped_frames = 0;                            // Frames discarded because the TX buffer was full
+
+    // --- Functions ---
+    MpuTelemetry(Print *port_funct = &Serial);              // Constructor (the port has to be initialized in the main code)
+    bool sendRaw(unsigned long time_stamp, int16_t *values_funct);  // Sends the 6 raw measurements
+    bool sendAngles(unsigned long time_stamp, mpu_real_t *angles_funct, uint8_t count); // Sends up to 6 angles in rad
+    bool sendFrame(uint8_t type, unsigned long time_stamp, int16_t *values_funct);  // Encodes and buffers a frame
+    uint8_t update();                                       // Writes the buffered bytes without blocking (call it periodically)
+    uint8_t getPending();                                   // Bytes still in the TX buffer
+
+    // -- Frame coding (also used by the PC decoder in extras/telemetry) --
+    static uint16_t crc16(const uint8_t *data_funct, uint8_t length);  // CRC-16/CCITT-FALSE
+    static void encodeFrame(const MpuTelemetryFrame *frame, uint8_t *encoded);  // Frame --> MPU_TELEMETRY_ENCODED_LENGTH COBS bytes
+    static bool decodeFrame(const uint8_t *encoded, uint8_t length, MpuTelemetryFrame *frame);  // COBS bytes --> frame (checks the CRC)
+
+  private:
+    Print *port;                                            // Serial port of the frames
+    uint8_t tx_buffer[MPU_TELEMETRY_TX_BUFFER_SIZE];        // Ring buffer of encoded bytes
+    uint8_t tx_head = 0;                                    // Number of bytes stored (free running)
+    uint8_t tx_tail = 0;                                    // Number of bytes written to the port (free running)
+};
+
+class MpuTelemetryDecoder{
+
+  public:
+    // --- Variables ---
+    uint32_t frames = 0;                                    // Frames decoded
+    uint32_t lost_frames = 0;                               // Frames missing according to the sequence numbers
+    uint16_t crc_errors = 0;                                // Frames with a wrong CRC or COBS coding
+    uint16_t framing_errors = 0;                            // Data between delimiters that isn't a frame (e.g. text or partial frames)
+
+    // --- Functions ---
+    bool feed(uint8_t data_funct, MpuTelemetryFrame *frame);  // Adds a received byte, true when a frame has been decoded
+
+  private:
+    uint8_t buffer[MPU_TELEMETRY_ENCODED_LENGTH];           // Bytes received since the last delimiter
+    uint8_t length = 0;                                     // Number of bytes received (can exceed the buffer)
+    bool started = false;                                   // A frame has already been decoded (the sequence can be checked)
+    uint16_t next_sequence = 0;                             // Expected sequence number
 };
 
 #endif
@@ -9,15 +9,17 @@
 
 #define TEST_LIMIT_TEST					10		// Just for testing. This is the number measurements that will be ignored
 
+//--- Output ---
+//#define TEXT_OUTPUT										// Uncomment to print the angles as text instead of the telemetry frames (extras/telemetry)
+
 //            **************************
 //            *      VARIABLES         *
 //            **************************
 
 //--- MPU ---
 MpuDev test;  																			// Main MPU class object
-extern volatile bool mpu_data_ready = false;				// Flag to check if there is new data available (true = new data ready)
+MpuTelemetry telemetry;																// Binary output of the angles (Serial)
 volatile unsigned long count = 0;										// This is just for testing to delay
-extern volatile unsigned long time_buffer = 0;			// This is to get the timing correct
 volatile bool overflow = false;											// This indicates if there has been an overflow with the data from the MPU
 
 // Test
@@ -44,7 +46,7 @@ void mpuDataReady() {
 	 
 	count++;
 	if (count >= TEST_LIMIT_TEST) {
-		mpu_data_ready = true;
+		test.mpu_data_ready = true;
 		count = 0;
 	}
 	*/
@@ -52,14 +54,14 @@ void mpuDataReady() {
 	/* This function is called every time the MPU interrupt on pin 2 is set 'high'
 	 * During the interrupt routine, millis() won´t update so it will record the time when the interrupt was called
 	 * This is better for this case since I only want to log that :)
+	 * The time stamp depends on MPU_TIMING_MODE (micros() by default), the dropped samples are counted by the library.
 	 */
 
 	// Check if the previous MPU values have been updated
-	if (mpu_data_ready) overflow = true;
+	if (test.mpu_data_ready) overflow = true;
 
 	// Update time
-	mpu_data_ready = true;
-	time_buffer = millis();
+	test.dataReadyInterrupt();	// Sets mpu_data_ready and time_buffer
 	
 }
 
@@ -130,13 +132,13 @@ void setup() {
 
 	Serial.println(F("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n"));
 	Serial.println("-------------------------------------------------------");
-	mpu_data_ready = false;
+	test.mpu_data_ready = false;
 }
 
 /*
 void loop() {
   // remember to print the value of the interrupt pin :)
-  if (mpu_data_ready) {
+  if (test.mpu_data_ready) {
   	// Get time
   	unsigned long difference = millis() - previous_time;
   	previous_time = millis();
@@ -153,10 +155,10 @@ void loop() {
   	}
   	Serial.println(F(""));
   	//delayMicroseconds(100);
-  	mpu_data_ready = false;
+  	test.mpu_data_ready = false;
   }
 
-  digitalWrite(13, mpu_data_ready);
+  digitalWrite(13, test.mpu_data_ready);
 }
 
 void loop() {
@@ -171,10 +173,10 @@ void loop() {
 
   // Get data from the IMU
   while (captured_data < 30){
-  	if (mpu_data_ready) {
+  	if (test.mpu_data_ready) {
   	
   	// Get time
-  	//time_buffer = millis();
+  	//test.time_buffer = millis();
   	
   	// Get data
   	test.getParameter6(values); // This has to be done as close as possible the the time capture
@@ -188,11 +190,11 @@ void loop() {
   	gz[captured_data] = values[5];
 
   	// Process time
-  	time[captured_data] = time_buffer - previous_time;
-  	previous_time = time_buffer;
+  	time[captured_data] = test.time_buffer - previous_time;
+  	previous_time = test.time_buffer;
 
   	// Reset
-  	mpu_data_ready = false;
+  	test.mpu_data_ready = false;
   	
   	// Increment the data count
   	captured_data++;
@@ -231,8 +233,8 @@ void loop() {
 
 	// Variables
 	int16_t values[6];
-	double *phy;
-	double *phy_gyro, *phy_accel;
+	mpu_real_t *phy;
+	mpu_real_t *phy_gyro, *phy_accel;
 	uint16_t captured_data;
 	unsigned long time_buffer2;
 
@@ -243,46 +245,83 @@ void loop() {
 	Serial.println(".");
 
 	// --- Initialize measurements ---
+	#ifdef MPU_LEAN_PROFILE
+		test.enabled_estimators = MPU_ESTIMATOR_KF;	// The test estimators aren't built
+	#else
+		test.enabled_estimators = MPU_ESTIMATOR_KF | MPU_ESTIMATOR_GYRO | MPU_ESTIMATOR_ACCEL;
+	#endif
+	#ifdef MPU_FIXED_POINT
+		test.enabled_estimators |= MPU_ESTIMATOR_KF_FIXED;	// Compare the fixed-point filter with the double one
+	#endif
 	test.initializeMeasurements();
 
   // Get data from the IMU
   while (true) {
-	  if (mpu_data_ready) {
+	  #ifdef MPU_HEALTH_MONITOR
+	  	if (test.updateHealth() != MPU_HEALTH_OK) continue;	// Recovering the MPU (it doesn't block)
+	  #endif
+	  if (test.mpu_data_ready) {
 	  	
 	  	// Get time
-	  	//time_buffer = millis();
+	  	//test.time_buffer = millis();
 	  	
 	  	// Get data
 	  	// test.getParameter6(values); // This has to be done as close as possible the the time capture
 
-	  	if(test.mpu_state_global != MPU_CORRECT) error(10);
+	  	#ifndef MPU_HEALTH_MONITOR
+	  		if(test.mpu_state_global != MPU_CORRECT) error(10);
+	  	#endif
 
-	  	time_buffer2 = time_buffer;
+	  	time_buffer2 = test.time_buffer;
 
-	  	// process data
-	  	phy_gyro = test.testGyroEst(time_buffer2);
-	  	phy_accel = test.testAccelEst(time_buffer2);
-	  	phy = test.simplifiedKF(time_buffer2);
+	  	// process data (one reading for all the estimators)
+	  	test.updateEstimators(time_buffer2);
+	  	#ifdef MPU_LEAN_PROFILE
+	  		phy_gyro = test.state;
+	  		phy_accel = test.state;
+	  	#else
+	  		phy_gyro = test.state_gyro;
+	  		phy_accel = test.state_accel_est;
+	  	#endif
+	  	phy = test.state;
 
-	  	if(test.mpu_state_global != MPU_CORRECT) error(10);
+	  	#ifndef MPU_HEALTH_MONITOR
+	  		if(test.mpu_state_global != MPU_CORRECT) error(10);
+	  	#endif
 
 	  	// Reset
-	  	mpu_data_ready = false;
+	  	test.mpu_data_ready = false;
 
 	  	//Print data
-	  	Serial.print(String(phy[0] * 180/M_PI));
-	  	Serial.print(F(", "));
-	  	Serial.print(String(phy[1] * 180/M_PI));
-	  	Serial.print(F(", "));
-	  	Serial.print(String(phy_gyro[0] * 180/M_PI));
-	  	Serial.print(F(", "));
-	  	Serial.print(String(phy_gyro[1] * 180/M_PI));
-	  	Serial.print(F(", "));
-	  	Serial.print(String(phy_accel[0] * 180/M_PI));
-	  	Serial.print(F(", "));
-	  	Serial.println(String(phy_accel[1] * 180/M_PI));
+	  	#ifdef TEXT_OUTPUT
+	  		Serial.print(String(phy[0] * 180/M_PI));
+	  		Serial.print(F(", "));
+	  		Serial.print(String(phy[1] * 180/M_PI));
+	  		Serial.print(F(", "));
+	  		Serial.print(String(phy_gyro[0] * 180/M_PI));
+	  		Serial.print(F(", "));
+	  		Serial.print(String(phy_gyro[1] * 180/M_PI));
+	  		Serial.print(F(", "));
+	  		Serial.print(String(phy_accel[0] * 180/M_PI));
+	  		Serial.print(F(", "));
+	  		#ifdef MPU_FIXED_POINT
+	  			mpu_real_t phy_fixed[2];
+	  			test.getFixedState(phy_fixed);
+	  			Serial.print(String(phy_accel[1] * 180/M_PI));
+	  			Serial.print(F(", "));
+	  			Serial.print(String(phy_fixed[0] * 180/M_PI));
+	  			Serial.print(F(", "));
+	  			Serial.println(String(phy_fixed[1] * 180/M_PI));
+	  		#else
+	  			Serial.println(String(phy_accel[1] * 180/M_PI));
+	  		#endif
+	  	#else
+	  		mpu_real_t angles[6] = {phy[0], phy[1], phy_gyro[0], phy_gyro[1], phy_accel[0], phy_accel[1]};
+	  		telemetry.sendAngles(time_buffer2, angles, 6);	// Non-blocking, the frame is dropped if the port is too slow
+	  	#endif
 	  }
   	// don't do anything here -_- (need to measure if the code is fast enough)
+  	telemetry.update();		// Writes the pending telemetry bytes
 
   	if (overflow) digitalWrite(13, HIGH);
 	  overflow = false;